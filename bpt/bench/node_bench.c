@@ -0,0 +1,374 @@
+// make microbench, or one configuration with the flags of the microbench
+// target in the Makefile and -DRECORD_CNT=... -DENTRY_CNT=...
+#define _GNU_SOURCE
+#include "bpt.h"
+#include "bpt_internal.h"
+#include "file.h"
+#include "helper_mock.h"
+#include "stats.h"
+#include <inttypes.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* CPU cost of the node operations with the disk taken out: file.h is served
+ * from MOCK_PAGES of test/support/helper_mock.c, the same in-memory store the
+ * tests run on. Each configuration of RECORD_CNT/ENTRY_CNT is its own build.
+ *
+ * A tree of shuffled keys is built once and saved. Every sample prepares the
+ * pages it needs (a leaf with room, a full leaf, an underfull leaf next to a
+ * neighbor), times the one call, and puts back the pages it wrote, so each
+ * sample starts from the same tree. The clock's own cost is measured and
+ * subtracted, the thread stays on one CPU, warm-up samples are dropped and
+ * the report is the 10th, 50th and 90th percentile of the rest.
+ */
+
+#define BENCH_SAMPLES 5000
+#define BENCH_WARMUP 500
+#define FIND_BATCH 256    // find_leaf calls per sample
+#define KEY_STEP 1024     // tree keys are multiples, fresh keys lie between
+#define MAX_TREE_KEYS 20000
+#define BENCH_VALUE "value-of-thirty-two-bytes-long.."
+
+static char value[] = BENCH_VALUE;
+static int64_t tree_keys;
+static uint64_t rng = 0x9e3779b97f4a7c15ULL;
+static uint64_t clock_overhead;
+
+// pages of the saved tree and the ones a sample wrote since
+static page_t *saved;
+static pagenum_t saved_pages;
+static bool dirty[MAX_MOCK_PAGES];
+static pagenum_t dirty_list[MAX_MOCK_PAGES];
+static int dirty_count;
+
+static uint64_t samples[BENCH_SAMPLES];
+
+// ---------------file.h over the mock store-------------------
+
+static void touch(pagenum_t pagenum) {
+  if (pagenum < saved_pages && !dirty[pagenum]) {
+    dirty[pagenum] = true;
+    dirty_list[dirty_count++] = pagenum;
+  }
+}
+
+pagenum_t file_alloc_page(pagenum_t hint) {
+  return MOCK_file_alloc_page(hint, 0);
+}
+
+pagenum_t file_alloc_page_at_end(void) {
+  return MOCK_file_alloc_page_at_end(0);
+}
+
+void file_free_page(pagenum_t pagenum) {
+  touch(pagenum);
+  MOCK_file_free_page(pagenum, 0);
+}
+
+void file_free_pages(const pagenum_t *pagenums, size_t count) {
+  for (size_t i = 0; i < count; i++) {
+    file_free_page(pagenums[i]);
+  }
+}
+
+void file_truncate(void) {
+  memset(MOCK_PAGES, 0, sizeof(MOCK_PAGES));
+  init_header_page_for_mock();
+}
+
+void file_read_page(pagenum_t pagenum, page_t *dest) {
+  MOCK_file_read_page(pagenum, dest, 0);
+}
+
+void file_write_page(pagenum_t pagenum, const page_t *src) {
+  touch(pagenum);
+  MOCK_file_write_page(pagenum, src, 0);
+}
+
+int file_enable_compression(const char *map_pathname) { return FAILURE; }
+
+void file_disable_compression(void) {}
+
+// ---------------saved tree-------------------
+
+static page_t *saved_page(pagenum_t pagenum) {
+  return (page_t *)((char *)saved + pagenum * page_size);
+}
+
+static void save_tree(void) {
+  saved_pages = get_header_page().num_of_pages;
+  saved = malloc(saved_pages * page_size);
+  if (saved == NULL) {
+    perror("Failure to allocate the saved tree");
+    exit(EXIT_FAILURE);
+  }
+  for (pagenum_t i = 0; i < saved_pages; i++) {
+    memcpy(saved_page(i), &MOCK_PAGES[i], page_size);
+  }
+}
+
+/**
+ * @brief put back the header page and every saved page written since
+ */
+static void restore_tree(void) {
+  memcpy(&MOCK_PAGES[HEADER_PAGE_POS], saved_page(HEADER_PAGE_POS), page_size);
+  for (int i = 0; i < dirty_count; i++) {
+    memcpy(&MOCK_PAGES[dirty_list[i]], saved_page(dirty_list[i]), page_size);
+    dirty[dirty_list[i]] = false;
+  }
+  dirty_count = 0;
+  forget_rightmost_leaf();
+  bump_smo_epoch();
+}
+
+// ---------------measurement-------------------
+
+static uint64_t next_random(void) {
+  // xorshift64*
+  rng ^= rng >> 12;
+  rng ^= rng << 25;
+  rng ^= rng >> 27;
+  return rng * 2685821657736338717ULL;
+}
+
+// a key between two keys of the tree, in the leaf of the tree key below it
+static int64_t fresh_key(void) {
+  return (int64_t)(next_random() % tree_keys) * KEY_STEP + 1;
+}
+
+static int compare_samples(const void *a, const void *b) {
+  uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+  return (x > y) - (x < y);
+}
+
+static uint64_t elapsed(uint64_t start) {
+  uint64_t ns = stats_clock() - start;
+  return ns > clock_overhead ? ns - clock_overhead : 0;
+}
+
+static void measure_clock(void) {
+  for (int i = 0; i < BENCH_SAMPLES; i++) {
+    uint64_t start = stats_clock();
+    samples[i] = stats_clock() - start;
+  }
+  qsort(samples, BENCH_SAMPLES, sizeof(uint64_t), compare_samples);
+  clock_overhead = samples[BENCH_SAMPLES / 2];
+}
+
+static void report(const char *name, int per_sample) {
+  uint64_t *kept = samples + BENCH_WARMUP;
+  int count = BENCH_SAMPLES - BENCH_WARMUP;
+  qsort(kept, count, sizeof(uint64_t), compare_samples);
+  printf("%-34s %8d %10.1f %10.1f %10.1f\n", name, count,
+         (double)kept[count / 10] / per_sample,
+         (double)kept[count / 2] / per_sample,
+         (double)kept[count * 9 / 10] / per_sample);
+}
+
+// ---------------operations-------------------
+
+static void bench_find_leaf(void) {
+  int64_t keys[FIND_BATCH];
+  for (int i = 0; i < BENCH_SAMPLES; i++) {
+    for (int j = 0; j < FIND_BATCH; j++) {
+      keys[j] = fresh_key();
+    }
+    uint64_t start = stats_clock();
+    for (int j = 0; j < FIND_BATCH; j++) {
+      find_leaf(keys[j]);
+    }
+    samples[i] = elapsed(start);
+  }
+  report("find_leaf", FIND_BATCH);
+}
+
+static void bench_insert_into_leaf(void) {
+  tree_path_t path;
+  page_t leaf_buf;
+  for (int i = 0; i < BENCH_SAMPLES;) {
+    int64_t key = fresh_key();
+    pagenum_t leaf = find_leaf_path(key, &path, &leaf_buf);
+    if (!leaf_has_room((leaf_page_t *)&leaf_buf, value)) {
+      continue;
+    }
+    uint64_t start = stats_clock();
+    insert_into_leaf(leaf, &leaf_buf, key, value);
+    samples[i++] = elapsed(start);
+    restore_tree();
+  }
+  report("insert_into_leaf", 1);
+}
+
+static void bench_insert_into_leaf_after_splitting(void) {
+  tree_path_t path;
+  page_t leaf_buf;
+  for (int i = 0; i < BENCH_SAMPLES; i++) {
+    int64_t key = fresh_key();
+    pagenum_t leaf = find_leaf_path(key, &path, &leaf_buf);
+    // fill the leaf with the keys after key
+    for (int64_t fill = key + 1;
+         leaf_has_room((leaf_page_t *)&leaf_buf, value); fill++) {
+      insert_into_leaf(leaf, &leaf_buf, fill, value);
+    }
+    uint64_t start = stats_clock();
+    insert_into_leaf_after_splitting(&path, key, value);
+    samples[i] = elapsed(start);
+    restore_tree();
+  }
+  report("insert_into_leaf_after_splitting", 1);
+}
+
+/**
+ * @brief the leaf of key cut down and its neighbor through the parent as
+ * handle_underflow finds it. To refill, the leaf keeps one record and the
+ * neighbor is filled up; to merge, the leaf keeps a quarter of its records.
+ * False when the pages would not take that path
+ */
+static bool prepare_underflow(int64_t key, bool fill,
+                              tree_path_t *path, pagenum_t *neighbor_num,
+                              int *kprime_index_from_get, int *k_prime_index,
+                              int64_t *k_prime) {
+  page_t leaf_buf, parent_buf, neighbor_buf;
+  pagenum_t leaf = find_leaf_path(key, path, &leaf_buf);
+  if (path->height < 2) {
+    return false;
+  }
+  leaf_page_t *leaf_page = (leaf_page_t *)&leaf_buf;
+  uint32_t keep = fill ? 1 : leaf_page->num_of_keys / 4;
+  while (leaf_page->num_of_keys > keep) {
+    leaf_remove_record(leaf_page, leaf_page->num_of_keys - 1);
+  }
+  file_write_page(leaf, &leaf_buf);
+
+  file_read_page(path->page_nums[path->height - 2], &parent_buf);
+  *kprime_index_from_get =
+      find_neighbor_and_kprime(leaf, (internal_page_t *)&parent_buf,
+                               neighbor_num, k_prime_index);
+  *k_prime = internal_key((internal_page_t *)&parent_buf, *k_prime_index);
+
+  file_read_page(*neighbor_num, &neighbor_buf);
+  leaf_page_t *neighbor_page = (leaf_page_t *)&neighbor_buf;
+  for (int64_t fill_key = leaf_key(neighbor_page, 0) + 1;
+       fill && leaf_has_room(neighbor_page, value); fill_key++) {
+    insert_into_leaf(*neighbor_num, &neighbor_buf, fill_key, value);
+  }
+
+  // the same test handle_underflow makes between merging and refilling
+  bool fits = leaf_page->num_of_keys + neighbor_page->num_of_keys <
+                  RECORD_CNT &&
+              leaf_can_merge(neighbor_page, leaf_page);
+  return fits != fill;
+}
+
+static void bench_coalesce_nodes(void) {
+  tree_path_t path;
+  pagenum_t neighbor_num;
+  int kprime_index_from_get, k_prime_index;
+  int64_t k_prime;
+  for (int i = 0; i < BENCH_SAMPLES;) {
+    if (!prepare_underflow(fresh_key(), false, &path, &neighbor_num,
+                           &kprime_index_from_get, &k_prime_index, &k_prime)) {
+      restore_tree();
+      continue;
+    }
+    uint64_t start = stats_clock();
+    coalesce_nodes(&path, path.height - 1, neighbor_num,
+                   kprime_index_from_get, k_prime);
+    samples[i++] = elapsed(start);
+    restore_tree();
+  }
+  report("coalesce_nodes", 1);
+}
+
+static void bench_redistribute_nodes(void) {
+  tree_path_t path;
+  pagenum_t neighbor_num;
+  int kprime_index_from_get, k_prime_index;
+  int64_t k_prime;
+  for (int i = 0; i < BENCH_SAMPLES;) {
+    if (!prepare_underflow(fresh_key(), true, &path, &neighbor_num,
+                           &kprime_index_from_get, &k_prime_index, &k_prime)) {
+      restore_tree();
+      continue;
+    }
+    uint64_t start = stats_clock();
+    redistribute_nodes(&path, path.height - 1, neighbor_num,
+                       kprime_index_from_get, k_prime_index, k_prime);
+    samples[i++] = elapsed(start);
+    restore_tree();
+  }
+  report("redistribute_nodes", 1);
+}
+
+// ---------------setup-------------------
+
+static void build_tree(void) {
+  tree_keys = (int64_t)RECORD_CNT * 1000;
+  if (tree_keys > MAX_TREE_KEYS) {
+    tree_keys = MAX_TREE_KEYS;
+  }
+  int64_t *order = malloc(tree_keys * sizeof(int64_t));
+  if (order == NULL) {
+    perror("Failure to allocate the keys");
+    exit(EXIT_FAILURE);
+  }
+  for (int64_t i = 0; i < tree_keys; i++) {
+    order[i] = i;
+  }
+  for (int64_t i = tree_keys - 1; i > 0; i--) {
+    int64_t j = (int64_t)(next_random() % (uint64_t)(i + 1));
+    int64_t tmp = order[i];
+    order[i] = order[j];
+    order[j] = tmp;
+  }
+
+  setup_data_store();
+  init_header_page_for_mock();
+  for (int64_t i = 0; i < tree_keys; i++) {
+    if (insert(order[i] * KEY_STEP, value) != SUCCESS) {
+      fprintf(stderr, "Failure to insert key %" PRId64 "\n", order[i]);
+      exit(EXIT_FAILURE);
+    }
+    if (get_header_page().num_of_pages >= MAX_MOCK_PAGES / 2) {
+      fprintf(stderr, "MAX_MOCK_PAGES is too small for %" PRId64 " keys\n",
+              tree_keys);
+      exit(EXIT_FAILURE);
+    }
+  }
+  free(order);
+  save_tree();
+}
+
+static void pin_to_cpu(void) {
+  cpu_set_t cpus;
+  CPU_ZERO(&cpus);
+  CPU_SET(sched_getcpu(), &cpus);
+  if (sched_setaffinity(0, sizeof(cpus), &cpus) != 0) {
+    perror("Failure to pin to a CPU, samples may move between CPUs");
+  }
+}
+
+int main(void) {
+  pin_to_cpu();
+  build_tree();
+  measure_clock();
+
+  tree_path_t path;
+  page_t leaf_buf;
+  find_leaf_path(0, &path, &leaf_buf);
+  printf("RECORD_CNT=%d ENTRY_CNT=%d page_size=%u keys=%" PRId64
+         " pages=%" PRIu64 " height=%d clock=%" PRIu64 "ns\n",
+         (int)RECORD_CNT, (int)ENTRY_CNT, page_size, tree_keys, saved_pages,
+         path.height, clock_overhead);
+  printf("%-34s %8s %10s %10s %10s\n", "ns per call", "samples", "p10", "p50",
+         "p90");
+  bench_find_leaf();
+  bench_insert_into_leaf();
+  bench_insert_into_leaf_after_splitting();
+  bench_coalesce_nodes();
+  bench_redistribute_nodes();
+  free(saved);
+  return 0;
+}
@@ -0,0 +1,454 @@
+// make bench && ./bench/ycsb -w A -d zipfian -n 10000 -t 4 -D 10
+#include "db_api.h"
+#include <getopt.h>
+#include <inttypes.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* YCSB-style driver for db_api.h. The load phase inserts keys 0 .. records - 1
+ * in key order, then the threads run the workload through a warm-up that is
+ * not measured and the measured run. The result goes to stdout as one JSON
+ * object: throughput, latency percentiles per operation and the page I/O of
+ * the run from db_get_stats.
+ *
+ *   A  50% read, 50% update
+ *   B  95% read, 5% update
+ *   C  100% read
+ *   D  95% read, 5% insert, reads favor the latest keys
+ *   E  95% scan, 5% insert
+ *   F  50% read, 50% read-modify-write
+ */
+
+#define ZIPFIAN_THETA 0.99
+#define MAX_SCAN_LENGTH 100
+#define MAX_VALUE_SIZE 65536
+
+typedef enum { OP_READ, OP_UPDATE, OP_INSERT, OP_SCAN, OP_RMW, OP_CNT } op_t;
+
+static const char *op_names[OP_CNT] = {"read", "update", "insert", "scan",
+                                       "rmw"};
+
+typedef enum { DIST_UNIFORM, DIST_ZIPFIAN, DIST_SEQUENTIAL } distribution_t;
+
+static const char *distribution_names[] = {"uniform", "zipfian",
+                                           "sequential"};
+
+static struct {
+  char workload;
+  int percent[OP_CNT]; // chance of each operation, adding up to 100
+  bool latest;         // reads count back from the last inserted key
+  distribution_t distribution;
+  int64_t records;
+  size_t value_size;
+  int threads;
+  int warmup_seconds;
+  int run_seconds;
+  char *pathname;
+} config = {.workload = 'A',
+            .distribution = DIST_ZIPFIAN,
+            .records = 10000,
+            .value_size = 100,
+            .threads = 1,
+            .warmup_seconds = 2,
+            .run_seconds = 10,
+            .pathname = "ycsb.db"};
+
+// zipfian generator of Gray et al. over config.records items
+static struct {
+  double zeta_n;
+  double alpha;
+  double eta;
+  double second; // 1 + 0.5^theta, where the second item starts
+} zipfian;
+
+static int64_t next_key; // key the next insert takes
+static int64_t sequence; // next key of the sequential generator
+static int phase;        // RUN_WARMUP, RUN_MEASURE or RUN_STOP
+static char value[MAX_VALUE_SIZE];
+
+enum { RUN_WARMUP, RUN_MEASURE, RUN_STOP };
+
+typedef struct {
+  pthread_t thread;
+  uint64_t rng;
+  uint64_t failures[OP_CNT]; // reads that found nothing, failed writes
+  latency_histogram_t latency[OP_CNT];
+} worker_t;
+
+static void usage_ycsb(void) {
+  fprintf(stderr,
+          "usage: ycsb [-w A-F] [-d uniform|zipfian|sequential] [-n records]\n"
+          "            [-v value size] [-t threads] [-W warm-up seconds]\n"
+          "            [-D run seconds] [-f db file]\n");
+  exit(EXIT_FAILURE);
+}
+
+static uint64_t next_random(uint64_t *state) {
+  // xorshift64*
+  uint64_t x = *state;
+  x ^= x >> 12;
+  x ^= x << 25;
+  x ^= x >> 27;
+  *state = x;
+  return x * 2685821657736338717ULL;
+}
+
+static double next_double(uint64_t *state) {
+  return (next_random(state) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static void setup_zipfian(int64_t items) {
+  double zeta_2 = 1.0 + pow(0.5, ZIPFIAN_THETA);
+  zipfian.zeta_n = 0;
+  for (int64_t i = 1; i <= items; i++) {
+    zipfian.zeta_n += 1.0 / pow((double)i, ZIPFIAN_THETA);
+  }
+  zipfian.alpha = 1.0 / (1.0 - ZIPFIAN_THETA);
+  zipfian.eta = (1.0 - pow(2.0 / items, 1.0 - ZIPFIAN_THETA)) /
+                (1.0 - zeta_2 / zipfian.zeta_n);
+  zipfian.second = zeta_2;
+}
+
+/**
+ * @brief rank from 0 to items - 1, 0 the most popular
+ */
+static int64_t next_zipfian(uint64_t *state, int64_t items) {
+  double u = next_double(state);
+  double uz = u * zipfian.zeta_n;
+  if (uz < 1.0) {
+    return 0;
+  }
+  if (uz < zipfian.second) {
+    return 1;
+  }
+  int64_t rank = (int64_t)(items * pow(zipfian.eta * u - zipfian.eta + 1.0,
+                                       zipfian.alpha));
+  return rank < items ? rank : items - 1;
+}
+
+// FNV-1a of the rank, so popular keys spread over the key space
+static uint64_t scramble(uint64_t rank) {
+  uint64_t hash = 14695981039346656037ULL;
+  for (int i = 0; i < 8; i++) {
+    hash ^= rank & 0xff;
+    hash *= 1099511628211ULL;
+    rank >>= 8;
+  }
+  return hash;
+}
+
+/**
+ * @brief an existing key to read or update
+ */
+static int64_t choose_key(worker_t *worker) {
+  int64_t items = __atomic_load_n(&next_key, __ATOMIC_RELAXED);
+  if (config.latest) {
+    int64_t back = next_zipfian(&worker->rng, config.records);
+    return back < items ? items - 1 - back : 0;
+  }
+  switch (config.distribution) {
+  case DIST_UNIFORM:
+    return (int64_t)(next_random(&worker->rng) % (uint64_t)items);
+  case DIST_ZIPFIAN:
+    return (int64_t)(scramble((uint64_t)next_zipfian(&worker->rng,
+                                                     config.records)) %
+                     (uint64_t)items);
+  default:
+    return __atomic_fetch_add(&sequence, 1, __ATOMIC_RELAXED) % items;
+  }
+}
+
+static const char *overwrite(int64_t key, const char *old_value, void *arg) {
+  (void)key;
+  (void)old_value;
+  return (const char *)arg;
+
+}
+
+/**
+ * @brief run one operation, true if it did what it was asked
+ */
+static bool run_op(worker_t *worker, op_t op, char *buffer, int64_t *keys) {
+  size_t size;
+  switch (op) {
+  case OP_READ:
+    return db_find_value(choose_key(worker), buffer, MAX_VALUE_SIZE, &size) ==
+           SUCCESS;
+  case OP_UPDATE:
+    return db_update(choose_key(worker), value) == SUCCESS;
+  case OP_INSERT:
+    return db_insert(__atomic_fetch_add(&next_key, 1, __ATOMIC_RELAXED),
+                     value) == SUCCESS;
+  case OP_SCAN: {
+    int64_t start = choose_key(worker);
+    int64_t length = 1 + next_random(&worker->rng) % MAX_SCAN_LENGTH;
+    return db_find_range(start, start + length - 1, keys) >= 0;
+  }
+  default: {
+    // read-modify-write: the read, then the write of the new value
+    int64_t key = choose_key(worker);
+    if (db_find_value(key, buffer, MAX_VALUE_SIZE, &size) != SUCCESS) {
+      return false;
+    }
+    return db_modify(key, overwrite, value) == SUCCESS;
+  }
+  }
+}
+
+static void *worker_main(void *arg) {
+  worker_t *worker = (worker_t *)arg;
+  char *buffer = malloc(MAX_VALUE_SIZE);
+  int64_t keys[MAX_SCAN_LENGTH];
+  if (buffer == NULL) {
+    perror("Failure to allocate a read buffer");
+    exit(EXIT_FAILURE);
+  }
+
+  int current;
+  while ((current = __atomic_load_n(&phase, __ATOMIC_ACQUIRE)) != RUN_STOP) {
+    int dice = (int)(next_random(&worker->rng) % 100);
+    op_t op = OP_READ;
+    while (dice >= config.percent[op]) {
+      dice -= config.percent[op];
+      op++;
+    }
+
+    uint64_t start = stats_clock();
+    bool done = run_op(worker, op, buffer, keys);
+    uint64_t end = stats_clock();
+    if (current == RUN_MEASURE) {
+      latency_record(&worker->latency[op], end - start);
+      if (!done) {
+        worker->failures[op]++;
+      }
+    }
+  }
+  free(buffer);
+  return NULL;
+}
+
+static void set_workload(char workload) {
+  memset(config.percent, 0, sizeof(config.percent));
+  config.latest = false;
+  switch (workload) {
+  case 'A':
+    config.percent[OP_READ] = 50;
+    config.percent[OP_UPDATE] = 50;
+    break;
+  case 'B':
+    config.percent[OP_READ] = 95;
+    config.percent[OP_UPDATE] = 5;
+    break;
+  case 'C':
+    config.percent[OP_READ] = 100;
+    break;
+  case 'D':
+    config.percent[OP_READ] = 95;
+    config.percent[OP_INSERT] = 5;
+    config.latest = true;
+    break;
+  case 'E':
+    config.percent[OP_SCAN] = 95;
+    config.percent[OP_INSERT] = 5;
+    break;
+  case 'F':
+    config.percent[OP_READ] = 50;
+    config.percent[OP_RMW] = 50;
+    break;
+  default:
+    usage_ycsb();
+  }
+  config.workload = workload;
+}
+
+static void parse_options(int argc, char **argv) {
+  int option;
+  while ((option = getopt(argc, argv, "w:d:n:v:t:W:D:f:")) != -1) {
+    switch (option) {
+    case 'w':
+      set_workload(optarg[0]);
+      break;
+    case 'd':
+      if (strcmp(optarg, "uniform") == 0) {
+        config.distribution = DIST_UNIFORM;
+      } else if (strcmp(optarg, "zipfian") == 0) {
+        config.distribution = DIST_ZIPFIAN;
+      } else if (strcmp(optarg, "sequential") == 0) {
+        config.distribution = DIST_SEQUENTIAL;
+      } else {
+        usage_ycsb();
+      }
+      break;
+    case 'n':
+      config.records = atoll(optarg);
+      break;
+    case 'v':
+      config.value_size = (size_t)atoll(optarg);
+      break;
+    case 't':
+      config.threads = atoi(optarg);
+      break;
+    case 'W':
+      config.warmup_seconds = atoi(optarg);
+      break;
+    case 'D':
+      config.run_seconds = atoi(optarg);
+      break;
+    case 'f':
+      config.pathname = optarg;
+      break;
+    default:
+      usage_ycsb();
+    }
+  }
+  if (config.records < 2 || config.value_size < 1 ||
+      config.value_size >= MAX_VALUE_SIZE || config.threads < 1 ||
+      config.warmup_seconds < 0 || config.run_seconds < 1) {
+    usage_ycsb();
+  }
+}
+
+static double seconds_between(uint64_t start, uint64_t end) {
+  return (end - start) / 1e9;
+}
+
+static void print_result(double load_seconds, double run_seconds,
+                         worker_t *workers, const db_stats_t *before,
+                         const db_stats_t *after) {
+  printf("{\n");
+  printf("  \"workload\": \"%c\",\n", config.workload);
+  printf("  \"distribution\": \"%s\",\n",
+         config.latest ? "latest" : distribution_names[config.distribution]);
+  printf("  \"records\": %" PRId64 ",\n", config.records);
+  printf("  \"value_size\": %zu,\n", config.value_size);
+  printf("  \"threads\": %d,\n", config.threads);
+  printf("  \"warmup_seconds\": %d,\n", config.warmup_seconds);
+  printf("  \"run_seconds\": %.3f,\n", run_seconds);
+  printf("  \"load_ops_per_second\": %.1f,\n", config.records / load_seconds);
+
+  latency_histogram_t merged[OP_CNT];
+  uint64_t failures[OP_CNT];
+  uint64_t total = 0;
+  memset(merged, 0, sizeof(merged));
+  memset(failures, 0, sizeof(failures));
+  for (int i = 0; i < config.threads; i++) {
+    for (int op = 0; op < OP_CNT; op++) {
+      latency_histogram_t *latency = &workers[i].latency[op];
+      merged[op].count += latency->count;
+      if (latency->max_ns > merged[op].max_ns) {
+        merged[op].max_ns = latency->max_ns;
+      }
+      for (int bucket = 0; bucket < LATENCY_BUCKET_CNT; bucket++) {
+        merged[op].buckets[bucket] += latency->buckets[bucket];
+      }
+      failures[op] += workers[i].failures[op];
+    }
+  }
+  for (int op = 0; op < OP_CNT; op++) {
+    total += merged[op].count;
+  }
+  printf("  \"ops_per_second\": %.1f,\n", total / run_seconds);
+
+  printf("  \"operations\": {");
+  const char *separator = "\n";
+  for (int op = 0; op < OP_CNT; op++) {
+    if (merged[op].count == 0) {
+      continue;
+    }
+    printf("%s    \"%s\": {\"count\": %" PRIu64 ", \"failures\": %" PRIu64
+           ", \"p50_us\": %.1f, \"p99_us\": %.1f, \"p999_us\": %.1f, "
+           "\"max_us\": %.1f}",
+           separator, op_names[op], merged[op].count, failures[op],
+           latency_percentile(&merged[op], 50) / 1000.0,
+           latency_percentile(&merged[op], 99) / 1000.0,
+           latency_percentile(&merged[op], 99.9) / 1000.0,
+           merged[op].max_ns / 1000.0);
+    separator = ",\n";
+  }
+  printf("\n  },\n");
+
+  uint64_t reads = stats_total(after, STAT_PAGE_READS) -
+                   stats_total(before, STAT_PAGE_READS);
+  uint64_t writes = stats_total(after, STAT_PAGE_WRITES) -
+                    stats_total(before, STAT_PAGE_WRITES);
+  uint64_t fsyncs =
+      stats_total(after, STAT_FSYNCS) - stats_total(before, STAT_FSYNCS);
+  printf("  \"io\": {\"page_reads\": %" PRIu64 ", \"page_writes\": %" PRIu64
+         ", \"fsyncs\": %" PRIu64 ", \"page_reads_per_op\": %.2f, "
+         "\"page_writes_per_op\": %.2f}\n",
+         reads, writes, fsyncs, total ? (double)reads / total : 0.0,
+         total ? (double)writes / total : 0.0);
+  printf("}\n");
+}
+
+int main(int argc, char **argv) {
+  set_workload(config.workload);
+  parse_options(argc, argv);
+  memset(value, 'v', config.value_size);
+  value[config.value_size] = '\0';
+
+  unlink(config.pathname);
+  if (open_table(config.pathname) == FAILURE) {
+    perror("Failure to open database file");
+    exit(EXIT_FAILURE);
+  }
+  setup_zipfian(config.records);
+
+  uint64_t load_start = stats_clock();
+  for (int64_t key = 0; key < config.records; key++) {
+    if (db_insert(key, value) != SUCCESS) {
+      fprintf(stderr, "Failure to load key %" PRId64 "\n", key);
+      exit(EXIT_FAILURE);
+    }
+  }
+  uint64_t load_end = stats_clock();
+  next_key = config.records;
+
+  worker_t *workers = calloc(config.threads, sizeof(worker_t));
+  if (workers == NULL) {
+    perror("Failure to allocate workers");
+    exit(EXIT_FAILURE);
+  }
+  __atomic_store_n(&phase, RUN_WARMUP, __ATOMIC_RELEASE);
+  for (int i = 0; i < config.threads; i++) {
+    workers[i].rng = 0x9e3779b97f4a7c15ULL * (i + 1);
+    if (pthread_create(&workers[i].thread, NULL, worker_main, &workers[i]) !=
+        0) {
+      perror("Failure to start a worker");
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  sleep(config.warmup_seconds);
+  db_stats_t before, after;
+  db_get_stats(&before);
+  uint64_t run_start = stats_clock();
+  __atomic_store_n(&phase, RUN_MEASURE, __ATOMIC_RELEASE);
+
+  sleep(config.run_seconds);
+  __atomic_store_n(&phase, RUN_STOP, __ATOMIC_RELEASE);
+  uint64_t run_end = stats_clock();
+  for (int i = 0; i < config.threads; i++) {
+    pthread_join(workers[i].thread, NULL);
+  }
+  db_get_stats(&after);
+
+  // close_table notes that it closed on stdout, keep it out of the JSON
+  fflush(stdout);
+  int saved_stdout = dup(STDOUT_FILENO);
+  dup2(STDERR_FILENO, STDOUT_FILENO);
+  close_table();
+  fflush(stdout);
+  dup2(saved_stdout, STDOUT_FILENO);
+  close(saved_stdout);
+  unlink(config.pathname);
+
+  print_result(seconds_between(load_start, load_end),
+               seconds_between(run_start, run_end), workers, &before, &after);
+  free(workers);
+  return 0;
+}
@@ -27,8 +27,16 @@
 #define SUCCESS 0
 #define FAILURE -1
 #define CANNOT_ROOT -2
+#define VALUE_MISMATCH -3    // compare_and_swap found another value
 #define MAX_RANGE_SIZE 10000 // for finding range
 #define MIN_KEYS 1           // for delayed merge
+#define DEFERRED_MERGE_CAPACITY 4096 // leaves waiting for a merge or sweep
+#define DEFERRED_MERGE_BATCH 64      // of them rebalanced per step
+#define MAX_TREE_HEIGHT 32   // deepest path a descent records
+#define SPLIT_FILL_FACTOR 50  // percent of a page a split leaves on the left
+#define DEFAULT_APPEND_FILL_FACTOR 90 // the same when appending to the tree
+#define VLOG_GC_MIN_GARBAGE (1 << 20) // dead value log bytes before a pass
+#define VLOG_GC_STEP_BYTES (1 << 20)  // value log bytes scanned per step
 
 // Constants for printing part or all of the GPL license.
 #define LICENSE_FILE "LICENSE.txt"
@@ -41,6 +49,14 @@
 
 // TYPES.
 
+/* Pages from the root down to the page a descent stopped at. Splits and
+ * merges walk it back up to reach the parents, pages keep no parent pointer.
+ */
+typedef struct {
+  pagenum_t page_nums[MAX_TREE_HEIGHT]; // page_nums[0] is the root
+  int height;                           // number of pages on the path
+} tree_path_t;
+
 // GLOBALS.
 
 /* The queue is used to print the tree in
@@ -54,6 +70,21 @@ typedef struct queue {
   struct queue *next;
 } queue;
 
+/* Gets the current value of a record and returns its new value, or NULL to
+ * keep it. Runs while the table is locked and must not call into the table.
+ */
+typedef const char *(*value_modifier_t)(int64_t key, const char *value,
+                                        void *arg);
+
+// percent of a page an append split leaves in the old page
+extern int append_fill_factor;
+// pages with fewer keys are merged with or refilled from a neighbor
+extern int merge_threshold;
+// deletes leave underfull leaves to rebalance_deferred instead of merging
+extern bool defer_merges;
+// deletes only mark records as tombstones, rebalance_deferred sweeps them
+extern bool lazy_deletes;
+
 // FUNCTION PROTOTYPES.
 
 // Output and utility.
@@ -71,45 +102,71 @@ int find_and_print_range(int64_t key_start, int64_t key_end);
 int find_range(int64_t key_start, int64_t key_end, int64_t returned_keys[],
                pagenum_t returned_pages[], int returned_indices[]);
 pagenum_t find_leaf(int64_t key);
+pagenum_t find_leaf_path(int64_t key, tree_path_t *path, page_t *leaf_buf);
+pagenum_t find_leaf_bounds(int64_t key, tree_path_t *path, page_t *leaf_buf,
+                           int64_t *low_out, int64_t *high_out);
+void bump_smo_epoch(void);
 int find(int64_t key, char *result_buf);
+int find_value(int64_t key, char *result_buf, size_t size, size_t *value_size);
 int cut(int length);
 void copy_value(char *dest, const char *src, size_t size);
 // Insertion.
 
 record_t *make_record(char *value);
-pagenum_t make_node(uint32_t isleaf);
-pagenum_t make_leaf(void);
+pagenum_t make_node(uint32_t isleaf, pagenum_t hint);
+pagenum_t make_leaf(pagenum_t hint);
 int get_index_after_left_child(page_t *parent_buffer, pagenum_t left_num);
 int insert_into_leaf(pagenum_t leaf_num, page_t *leaf_buffer, int64_t key,
                      char *value);
-int insert_into_leaf_after_splitting(pagenum_t leaf, int64_t key, char *value);
+int insert_into_leaf_after_splitting(const tree_path_t *path, int64_t key,
+                                     char *value);
 int insert_into_node(pagenum_t parent, int64_t left_index, int64_t key,
                      pagenum_t right);
-int insert_into_node_after_splitting(pagenum_t parent, int64_t left_index,
-                                     int64_t key, pagenum_t right);
-int insert_into_parent(pagenum_t left, int64_t key, pagenum_t right);
+int insert_into_node_after_splitting(const tree_path_t *path, int level,
+                                     int64_t left_index, int64_t key,
+                                     pagenum_t right, bool append);
+int insert_into_parent(const tree_path_t *path, int level, pagenum_t left,
+                       int64_t key, pagenum_t right, bool append);
 int insert_into_new_root(pagenum_t left, int64_t key, pagenum_t right);
 int start_new_tree(int64_t key, char *value);
+void remember_rightmost_leaf(pagenum_t leaf_num, int64_t max_key);
+void forget_rightmost_leaf(void);
+bool append_to_rightmost_leaf(int64_t key, char *value);
 void init_header_page();
 void link_header_page(pagenum_t root);
 int insert(int64_t key, char *value);
+int upsert(int64_t key, char *value);
+int update(int64_t key, char *value);
+int modify(int64_t key, value_modifier_t modifier, void *arg);
+int compare_and_swap(int64_t key, const char *expected, char *value);
 
 // Deletion.
 
-int get_kprime_index(pagenum_t target_node);
+int get_kprime_index(const internal_page_t *parent_page,
+                     pagenum_t target_node);
 int remove_record_from_node(leaf_page_t *target_page, int64_t key,
                             const char *value);
 int remove_entry_from_node(internal_page_t *target_page, int64_t key);
 pagenum_t adjust_root(pagenum_t root);
-int coalesce_nodes(pagenum_t target_num, pagenum_t neighbor_num,
+int coalesce_nodes(const tree_path_t *path, int level, pagenum_t neighbor_num,
                    int kprime_index_from_get, int64_t k_prime);
-int redistribute_nodes(pagenum_t target_num, pagenum_t neighbor_num,
-                       int kprime_index_from_get, int k_prime_index,
-                       int k_prime);
-int delete_entry(pagenum_t target_node, int64_t key, const char *value);
+int redistribute_nodes(const tree_path_t *path, int level,
+                       pagenum_t neighbor_num, int kprime_index_from_get,
+                       int k_prime_index, int64_t k_prime);
+int delete_entry(const tree_path_t *path, int level, int64_t key,
+                 const char *value);
 int delete (int64_t key);
+int delete_value(int64_t key, char *result_buf, size_t size,
+                 size_t *value_size);
+int64_t delete_range(int64_t start, int64_t end);
+int deferred_merges(void);
+int rebalance_deferred(int max_leaves);
+void forget_deferred_merges(void);
 
-void destroy_tree_nodes(pagenum_t root);
 void destroy_tree(void);
 
+// Defragmentation.
+void reset_defragmentation(void);
+int defragment_leaves(int max_leaves);
+
 #endif /* __BPT_H__*/
@@ -1,53 +1,117 @@
 #ifndef BPT_INTERNAL_H
 #define BPT_INTERNAL_H
 
-#include "file.h"
+#include "bpt.h"
+
+// a leaf record in its stored form: the value bytes, or an overflow_ref_t
+// when code is LEAF_VALUE_OVERFLOW
+typedef struct {
+  int64_t key;
+  uint8_t code; // length byte of the slot
+  uint8_t size; // bytes of payload in use
+  char payload[VALUE_SIZE];
+} leaf_slot_t;
 
 /**
  * Declaration of helper functions used only bpt
  */
-record_t *prepare_records_for_split(leaf_page_t *leaf_page, int64_t key,
-                                    const char *value);
+leaf_slot_t *prepare_records_for_split(leaf_page_t *leaf_page, int64_t key,
+                                       const char *value);
+int leaf_split_point(const leaf_slot_t *temp_records, int num_records,
+                     int fill_factor);
 int64_t distribute_records_to_leaves(leaf_page_t *leaf_page,
                                      leaf_page_t *new_leaf_page,
-                                     record_t *temp_records,
-                                     pagenum_t new_leaf_num);
+                                     leaf_slot_t *temp_records,
+                                     int num_records, pagenum_t new_leaf_num,
+                                     int fill_factor);
 entry_t *prepare_entries_for_split(internal_page_t *old_node_page,
                                    int64_t left_index, int64_t key,
                                    pagenum_t right);
-int64_t distribute_entries_and_update_children(pagenum_t old_node_num,
-                                               internal_page_t *old_node_page,
-                                               pagenum_t new_node_num,
-                                               internal_page_t *new_node_page,
-                                               entry_t *temp_entries);
+int internal_split_point(const entry_t *temp_entries, int num_entries,
+                         int fill_factor);
+int64_t distribute_entries_to_nodes(internal_page_t *old_node_page,
+                                    internal_page_t *new_node_page,
+                                    entry_t *temp_entries, int num_entries,
+                                    int fill_factor);
 void coalesce_internal_nodes(page_t *neighbor_buf, page_t *target_buf,
-                             int neighbor_num, int64_t k_prime);
+                             int64_t k_prime);
 void coalesce_leaf_nodes(page_t *neighbor_buf, page_t *target_buf);
-void redistribute_from_left(pagenum_t target_num, page_t *target_buf,
-                            page_t *neighbor_buf, internal_page_t *parent_page,
-                            int k_prime_index, int k_prime);
-void redistribute_internal_from_left(pagenum_t target_num, page_t *target_buf,
-                                     page_t *neighbor_buf,
-                                     internal_page_t *parent_page,
-                                     int k_prime_index, int k_prime);
-void redistribute_leaf_from_left(page_t *target_buf, page_t *neighbor_buf,
-                                 internal_page_t *parent_page,
-                                 int k_prime_index);
-void redistribute_from_right(pagenum_t target_num, page_t *target_buf,
-                             page_t *neighbor_buf, internal_page_t *parent_page,
-                             int k_prime_index, int k_prime);
-void redistribute_internal_from_right(pagenum_t target_num, page_t *target_buf,
-                                      page_t *neighbor_buf,
-                                      internal_page_t *parent_page,
-                                      int k_prime_index, int k_prime);
-void redistribute_leaf_from_right(page_t *target_buf, page_t *neighbor_buf,
-                                  internal_page_t *parent_page,
-                                  int k_prime_index);
+int64_t redistribute_from_left(page_t *target_buf, page_t *neighbor_buf,
+                               int64_t k_prime);
+int64_t redistribute_internal_from_left(page_t *target_buf,
+                                        page_t *neighbor_buf, int64_t k_prime);
+int64_t redistribute_leaf_from_left(page_t *target_buf, page_t *neighbor_buf);
+int64_t redistribute_from_right(page_t *target_buf, page_t *neighbor_buf,
+                                int64_t k_prime);
+int64_t redistribute_internal_from_right(page_t *target_buf,
+                                         page_t *neighbor_buf,
+                                         int64_t k_prime);
+int64_t redistribute_leaf_from_right(page_t *target_buf, page_t *neighbor_buf);
+bool redistribution_fits(const page_t *target_buf, const page_t *neighbor_buf,
+                         bool from_left, int64_t k_prime);
 int find_neighbor_and_kprime(pagenum_t target_node,
                              internal_page_t *parent_page,
-                             page_header_t *target_header,
                              pagenum_t *neighbor_num_out,
                              int *k_prime_key_index_out);
-int handle_underflow(pagenum_t target_node);
+int handle_underflow(const tree_path_t *path, int level);
+int finish_removal(const tree_path_t *path, int level, page_t *node_buf);
+bool defer_underflow(int64_t key);
+int search_internal_key(const internal_page_t *page, int64_t key);
+int search_internal_child(const internal_page_t *page, pagenum_t child);
+int search_sorted_keys(const int64_t *keys, int n, int64_t key);
+
+int64_t internal_key(const internal_page_t *page, int index);
+pagenum_t internal_child(const internal_page_t *page, int index);
+void internal_read_entries(const internal_page_t *page, entry_t *dest);
+bool internal_entries_fit(const entry_t *entries, int n);
+void internal_write_entries(internal_page_t *page, const entry_t *entries,
+                            int n);
+bool internal_has_room(const internal_page_t *page, int index, int64_t key,
+                       pagenum_t page_num);
+bool internal_can_merge(const internal_page_t *left, int64_t k_prime,
+                        const internal_page_t *right);
+void internal_insert_entry(internal_page_t *page, int index, int64_t key,
+                           pagenum_t page_num);
+void internal_remove_entry(internal_page_t *page, int index);
+bool internal_set_key(internal_page_t *page, int index, int64_t key);
+bool internal_set_child(internal_page_t *page, int index, pagenum_t page_num);
+
+void leaf_upgrade(leaf_page_t *leaf);
+int64_t leaf_key(const leaf_page_t *leaf, int index);
+void leaf_read_slot(const leaf_page_t *leaf, int index, leaf_slot_t *slot);
+void leaf_read_slots(const leaf_page_t *leaf, leaf_slot_t *dest);
+leaf_slot_t *leaf_alloc_slots(int n);
+void leaf_make_slot(int64_t key, const char *value, leaf_slot_t *slot);
+size_t leaf_read_value(const leaf_page_t *leaf, int index, char *dest,
+                       size_t size);
+void leaf_free_value(const leaf_page_t *leaf, int index);
+size_t leaf_stored_size(const char *value);
+size_t leaf_used_size(const leaf_page_t *leaf);
+bool leaf_has_room(const leaf_page_t *leaf, const char *value);
+bool leaf_has_room_for_slot(const leaf_page_t *leaf,
+                            const leaf_slot_t *slot);
+bool leaf_can_merge(const leaf_page_t *left, const leaf_page_t *right);
+int leaf_lower_bound(const leaf_page_t *leaf, int64_t key);
+int leaf_find_key(const leaf_page_t *leaf, int64_t key);
+bool leaf_is_tombstone(const leaf_page_t *leaf, int index);
+int leaf_live_records(const leaf_page_t *leaf);
+void leaf_insert_slot(leaf_page_t *leaf, int index, const leaf_slot_t *slot);
+void leaf_append_slots(leaf_page_t *leaf, const leaf_slot_t *slots, int n);
+void leaf_insert_record(leaf_page_t *leaf, int index, int64_t key,
+                        const char *value);
+void leaf_remove_record(leaf_page_t *leaf, int index);
+void leaf_remove_records(leaf_page_t *leaf, int first, int last);
+bool leaf_replace_value(leaf_page_t *leaf, int index, const char *value);
+void leaf_set_tombstone(leaf_page_t *leaf, int index);
+int leaf_remove_tombstones(leaf_page_t *leaf);
+void leaf_clear_records(leaf_page_t *leaf);
+
+pagenum_t make_overflow_page(pagenum_t hint);
+pagenum_t overflow_write(const char *value, size_t length);
+void overflow_read(pagenum_t first_num, char *dest, size_t size);
+void overflow_free(pagenum_t first_num);
+
+bool value_log_needs_gc(void);
+uint64_t collect_value_log(uint64_t budget);
 
 #endif
\ No newline at end of file
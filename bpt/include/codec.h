@@ -0,0 +1,25 @@
+#ifndef CODEC_H
+#define CODEC_H
+
+#include <stddef.h>
+
+/* Byte-oriented LZ codec for page images. A compressed block is a run of
+ * sequences: a token byte (literal count in the high nibble, match length - 4
+ * in the low nibble, 15 meaning more length bytes follow), the literals, then
+ * a 2-byte little-endian match offset and the extra length bytes. The last
+ * sequence carries only literals.
+ */
+
+#define CODEC_MIN_MATCH 4
+#define CODEC_MAX_OFFSET 65535
+
+// Compress length bytes of src into dest, return the compressed size or 0 if
+// it does not fit in capacity
+size_t codec_compress(const char *src, size_t length, char *dest,
+                      size_t capacity);
+// Decompress length bytes of src into dest, return the decompressed size or
+// -1 if src is not a valid block or does not fit in capacity
+long codec_decompress(const char *src, size_t length, char *dest,
+                      size_t capacity);
+
+#endif
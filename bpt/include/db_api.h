@@ -2,6 +2,7 @@
 #define DB_API_H
 
 #include "bpt.h"
+#include "stats.h"
 #include <fcntl.h>
 #include <sys/stat.h>
 #include <sys/types.h>
@@ -9,14 +10,61 @@
 
 extern int global_table_id; // for future extension
 
+typedef struct {
+  // keep values in an append-only value log (‘pathname’.vlog) and only
+  // references to them in the leaves, dead values are collected in the
+  // background
+  bool value_log;
+  // store pages compressed in sector-sized extents, only when the table is
+  // created
+  bool compress_pages;
+  // bytes per page, a power of two from MIN_PAGE_SIZE to MAX_PAGE_SIZE, only
+  // when the table is created. 0 means DEFAULT_PAGE_SIZE
+  uint32_t page_size;
+  // percent of a page kept in the old page when an append past the last key
+  // splits it, from SPLIT_FILL_FACTOR to 100. 100 leaves the old page full
+  // for append-only tables. 0 means DEFAULT_APPEND_FILL_FACTOR
+  uint32_t append_fill_factor;
+  // pages with fewer keys are merged with or refilled from a neighbor, a
+  // larger threshold keeps pages fuller for more merges. 0 means MIN_KEYS,
+  // at most half the records of a leaf and the entries of an internal page
+  uint32_t merge_threshold;
+  // deletes only note the leaves they leave underfull and the maintenance
+  // thread merges them in batches, so a delete never waits for a merge
+  bool defer_merges;
+  // deletes only mark the record as a tombstone in its leaf, one page write
+  // with no merge, and the maintenance thread sweeps them out in batches
+  bool lazy_deletes;
+  // leaves per second the maintenance thread visits to move them into key
+  // order in the file, so scans read it in order. Moved leaves go past the
+  // end of the file. 0 means off; compressed tables place pages through
+  // their page map and are left alone
+  uint32_t defrag_rate;
+} table_options_t;
+
 int open_table(char *pathname);
+int open_table_with_options(char *pathname, const table_options_t *options);
 int db_insert(int64_t key, char *value);
+int db_upsert(int64_t key, char *value);
+int db_update(int64_t key, char *value);
+int db_compare_and_swap(int64_t key, const char *expected, char *value);
+int db_modify(int64_t key, value_modifier_t modifier, void *arg);
 int db_find(int64_t key, char *ret_val);
+int db_find_value(int64_t key, char *ret_val, size_t size, size_t *value_size);
+int db_find_range(int64_t key_start, int64_t key_end, int64_t keys[]);
 int db_delete(int64_t key);
+int db_delete_value(int64_t key, char *ret_val, size_t size,
+                    size_t *value_size);
+int64_t db_delete_range(int64_t start, int64_t end);
+int db_truncate(void);
+int db_get_stats(db_stats_t *stats);
+int db_get_latency(stat_op_t op, int phase, latency_histogram_t *histogram);
+void db_reset_latency(void);
 
 int close_table(void);
 void db_print_tree(void);
 void db_print_leaves(void);
+void db_print_latency(void);
 int db_find_and_print_range(int64_t key_start, int64_t key_end);
 
 #endif
\ No newline at end of file
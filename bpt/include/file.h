@@ -2,14 +2,26 @@
 #define FILE_H
 
 #include "page.h"
+#include <stddef.h>
 
-// Allocate an on-disk page from the free page list
-pagenum_t file_alloc_page();
+// Allocate an on-disk page from the free page list, close to hint unless it
+// is PAGE_NULL
+pagenum_t file_alloc_page(pagenum_t hint);
+// Allocate a page past the end of the file, the free page list is kept
+pagenum_t file_alloc_page_at_end(void);
 // Free an on-disk page to the free page list
 void file_free_page(pagenum_t pagenum);
+// Free count on-disk pages with a single update of the header page
+void file_free_pages(const pagenum_t *pagenums, size_t count);
+// Drop every page but the header page, leaving an empty tree
+void file_truncate(void);
 // Read an on-disk page into the in-memory page structure(dest)
 void file_read_page(pagenum_t pagenum, page_t *dest);
 // Write an in-memory page(src) to the on-disk page
 void file_write_page(pagenum_t pagenum, const page_t *src);
+// Store pages compressed, their locations are kept in the page map file
+int file_enable_compression(const char *map_pathname);
+// Stop storing pages compressed and close the page map
+void file_disable_compression(void);
 
 #endif
\ No newline at end of file
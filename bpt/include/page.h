@@ -2,32 +2,106 @@
 #define PAGE_H
 
 #include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
 
 typedef uint64_t pagenum_t;
 typedef uint64_t magicnum_t;
 
-#define PAGE_SIZE 4096
-#define HEADER_PAGE_RESERVED 4072
+// page size is chosen when a table is created and kept in its header page
+#define MIN_PAGE_SIZE 4096
+#define MAX_PAGE_SIZE 65536
+#define DEFAULT_PAGE_SIZE MIN_PAGE_SIZE
+// pages of format version 0 to 6 are all this size
+#define LEGACY_PAGE_SIZE 4096
+#define HEADER_PAGE_RESERVED (MAX_PAGE_SIZE - 40)
 #ifndef NON_HEADER_PAGE_RESERVED
 #define NON_HEADER_PAGE_RESERVED 104
 #endif
 #define VALUE_SIZE 120
-#ifndef RECORD_CNT
-#define RECORD_CNT 31
-#endif
-#ifndef ENTRY_CNT
-#define ENTRY_CNT 248
-#endif
-#define UNUSED_SIZE 4088
+#define UNUSED_SIZE (MAX_PAGE_SIZE - 8)
 #define LEAF 1
 #define INTERNAL 0
 #define PAGE_NULL 0
 #define HEADER_PAGE_POS 0
 
+// bytes per page of the open table, the capacities below follow it
+extern uint32_t page_size;
+
+// leaf layout
+#define LEAF_HEADER_SIZE                                                       \
+  (2 * sizeof(pagenum_t) + 2 * sizeof(uint32_t) + NON_HEADER_PAGE_RESERVED)
+#define LEAF_BODY_SIZE (page_size - LEAF_HEADER_SIZE)
+#define MAX_LEAF_BODY_SIZE (MAX_PAGE_SIZE - LEAF_HEADER_SIZE)
+// directory bytes per record of a slotted leaf: key + value length
+#define LEAF_SLOT_SIZE (sizeof(int64_t) + sizeof(uint8_t))
+// records of the fixed-size layouts (format 0 and 1)
+#define LEGACY_RECORD_CNT                                                      \
+  ((LEGACY_PAGE_SIZE - LEAF_HEADER_SIZE) / (sizeof(int64_t) + VALUE_SIZE))
+// upper bound on the records of one leaf, reached with empty values
+#ifndef RECORD_CNT
+#define RECORD_CNT (LEAF_BODY_SIZE / LEAF_SLOT_SIZE)
+#endif
+// longer values are moved to a chain of overflow pages
+#ifndef LEAF_INLINE_MAX
+#define LEAF_INLINE_MAX (VALUE_SIZE - 1)
+#endif
+// length byte of a slot whose value lives in overflow pages
+#define LEAF_VALUE_OVERFLOW 0xFF
+// length byte of a slot whose value lives in the value log
+#define LEAF_VALUE_VLOG 0xFE
+// length byte of a deleted record kept until it is swept, it has no value
+#define LEAF_VALUE_TOMBSTONE 0xFD
+
+// internal layout
+#define INTERNAL_HEADER_SIZE                                                   \
+  (2 * sizeof(pagenum_t) + 2 * sizeof(int32_t) + NON_HEADER_PAGE_RESERVED)
+#define INTERNAL_BODY_SIZE (page_size - INTERNAL_HEADER_SIZE)
+#define MAX_INTERNAL_BODY_SIZE (MAX_PAGE_SIZE - INTERNAL_HEADER_SIZE)
+// smallest entry of a delta-encoded page: 16-bit key delta + 1-byte page num
+#define INTERNAL_MIN_ENTRY_SIZE (sizeof(uint16_t) + sizeof(uint8_t))
+// entries of the fixed-size layout (format 0 to 4)
+#define LEGACY_ENTRY_CNT                                                       \
+  ((LEGACY_PAGE_SIZE - INTERNAL_HEADER_SIZE) / (2 * sizeof(int64_t)))
+// upper bound on the entries of one internal page, reached with the
+// narrowest widths
+#ifndef ENTRY_CNT
+#define ENTRY_CNT (INTERNAL_BODY_SIZE / INTERNAL_MIN_ENTRY_SIZE)
+#endif
+
+// on-disk format version kept in the header page
+// 0: leaves hold record_t arrays
+// 1: leaves keep their keys in front of the values (LEAF_FORMAT_SPLIT)
+// 2: slotted leaves with variable-length values (LEAF_FORMAT_SLOTTED)
+// 3: values longer than LEAF_INLINE_MAX are kept in overflow pages
+// 4: leaves may reference values in a value log (HEADER_FLAG_VALUE_LOG)
+// 5: internal pages are delta encoded (INTERNAL_FORMAT_DELTA)
+// 6: pages may be stored compressed (HEADER_FLAG_COMPRESSED)
+// 7: page size is kept in the header page, 0 means LEGACY_PAGE_SIZE
+// 8: leaf slots may be tombstones of deleted records (LEAF_VALUE_TOMBSTONE)
+#define FORMAT_VERSION 8
+
+// header page flags
+#define HEADER_FLAG_VALUE_LOG 0x1 // values are kept in <pathname>.vlog
+#define HEADER_FLAG_COMPRESSED 0x2 // pages are mapped by <pathname>.pagemap
+
+// per-page leaf layout, pages are upgraded when they are rewritten
+#define LEAF_FORMAT_RECORDS 0
+#define LEAF_FORMAT_SPLIT 1
+#define LEAF_FORMAT_SLOTTED 2
+
+// per-page internal layout, pages are upgraded when they are rewritten
+#define INTERNAL_FORMAT_ENTRIES 0
+#define INTERNAL_FORMAT_DELTA 1
+
 typedef struct {
   pagenum_t free_page_num;
   pagenum_t root_page_num;
   pagenum_t num_of_pages;
+  uint32_t version; // FORMAT_VERSION of the file
+  uint32_t flags;   // HEADER_FLAG_*
+  uint32_t page_size; // bytes per page, set when the file is created
+  uint32_t padding;
   char reserved[HEADER_PAGE_RESERVED]; // not used
 } header_page_t;
 
@@ -43,6 +117,26 @@ typedef struct {
   char value[VALUE_SIZE];
 } record_t;
 
+// reference kept in a leaf slot for a value stored in overflow pages
+typedef struct {
+  pagenum_t first_page_num;
+  uint64_t length;
+} overflow_ref_t;
+
+// reference kept in a leaf slot for a value stored in the value log
+typedef struct {
+  uint64_t offset; // offset of the vlog record
+  uint64_t length; // bytes of the value
+} vlog_ref_t;
+
+// overflow page, a chain of them holds one large value
+typedef struct {
+  pagenum_t next_page_num; // 0 if last
+  uint32_t length;         // bytes of the value in this page
+  uint32_t padding;
+  char data[MAX_PAGE_SIZE - 2 * sizeof(uint64_t)]; // page_size - 16 used
+} overflow_page_t;
+
 // key-pagenum entry
 typedef struct {
   int64_t key;
@@ -50,18 +144,80 @@ typedef struct {
 } entry_t;
 
 // leaf page
+// body = keys[n] | lengths[n] (uint8_t) | values packed in key order
+// values are stored without the terminating NUL, removing a record compacts
+// the page so the free space always sits at the end of the body
 typedef struct {
   // header
-  pagenum_t parent_page_num;
+  pagenum_t parent_page_num; // unused, parents come from tree_path_t
   uint32_t is_leaf; // 1
   uint32_t num_of_keys;
-  char reserved[NON_HEADER_PAGE_RESERVED]; // not used
-  pagenum_t right_sibling_page_num;        // if rihgtmost, 0
+  uint32_t format;       // LEAF_FORMAT_SLOTTED
+  uint32_t payload_size; // bytes taken by the values
+  char reserved[NON_HEADER_PAGE_RESERVED - 2 * sizeof(uint32_t)]; // not used
+  pagenum_t right_sibling_page_num; // if rihgtmost, 0
 
-  record_t records[RECORD_CNT];
+  union {
+    int64_t keys[MAX_LEAF_BODY_SIZE / sizeof(int64_t)];
+    char body[MAX_LEAF_BODY_SIZE]; // LEAF_BODY_SIZE used
+  };
 } leaf_page_t;
 
+// leaf page of format version 1 (LEAF_FORMAT_SPLIT), read only
+typedef struct {
+  // header
+  pagenum_t parent_page_num;
+  uint32_t is_leaf; // 1
+  uint32_t num_of_keys;
+  uint32_t format; // LEAF_FORMAT_SPLIT
+  char reserved[NON_HEADER_PAGE_RESERVED - sizeof(uint32_t)]; // not used
+  pagenum_t right_sibling_page_num; // if rihgtmost, 0
+
+  int64_t keys[LEGACY_RECORD_CNT];
+  char values[LEGACY_RECORD_CNT][VALUE_SIZE];
+} split_leaf_page_t;
+
+// leaf page of format version 0 (LEAF_FORMAT_RECORDS), read only
+typedef struct {
+  // header
+  pagenum_t parent_page_num;
+  uint32_t is_leaf; // 1
+  uint32_t num_of_keys;
+  uint32_t format; // LEAF_FORMAT_RECORDS
+  char reserved[NON_HEADER_PAGE_RESERVED - sizeof(uint32_t)]; // not used
+  pagenum_t right_sibling_page_num; // if rihgtmost, 0
+
+  record_t records[LEGACY_RECORD_CNT];
+} legacy_leaf_page_t;
+
 // internal page
+// body = key deltas[n] (key - base_key, key_width bytes each) | page
+// numbers[n] (page_num_width bytes each, little endian). Both widths are the
+// smallest that hold every entry of the page, so clustered keys and a small
+// file pack several hundred children into one page
+typedef struct {
+  // header
+  pagenum_t parent_page_num; // unused, parents come from tree_path_t
+  int32_t is_leaf; // 0
+  int32_t num_of_keys;
+  uint32_t format;        // INTERNAL_FORMAT_DELTA
+  uint8_t key_width;      // 2, 4 or 8
+  uint8_t page_num_width; // 1 to 8
+  uint16_t padding;
+  int64_t base_key; // first key of the page
+  char reserved[NON_HEADER_PAGE_RESERVED - 2 * sizeof(uint32_t) -
+                sizeof(int64_t)]; // not used
+  pagenum_t one_more_page_num; // leftmost page num to know key ranges
+
+  union {
+    uint16_t deltas16[MAX_INTERNAL_BODY_SIZE / sizeof(uint16_t)];
+    uint32_t deltas32[MAX_INTERNAL_BODY_SIZE / sizeof(uint32_t)];
+    uint64_t deltas64[MAX_INTERNAL_BODY_SIZE / sizeof(uint64_t)];
+    char body[MAX_INTERNAL_BODY_SIZE]; // INTERNAL_BODY_SIZE used
+  };
+} internal_page_t;
+
+// internal page of format version 0 to 4 (INTERNAL_FORMAT_ENTRIES), read only
 typedef struct {
   // header
   pagenum_t parent_page_num;
@@ -70,8 +226,8 @@ typedef struct {
   char reserved[NON_HEADER_PAGE_RESERVED]; // not used
   pagenum_t one_more_page_num; // leftmost page num to know key ranges
 
-  entry_t entries[ENTRY_CNT];
-} internal_page_t;
+  entry_t entries[LEGACY_ENTRY_CNT];
+} legacy_internal_page_t;
 
 // page header - for referencing header
 typedef struct {
@@ -81,9 +237,26 @@ typedef struct {
   char reserved[NON_HEADER_PAGE_RESERVED];
 } page_header_t;
 
-// raw page for type casting
+// raw page for type casting, only the first page_size bytes are read and
+// written
 typedef struct {
-  char data[PAGE_SIZE];
+  char data[MAX_PAGE_SIZE];
 } page_t;
 
+/* A page_t is as large as the largest page, too large to keep on the stack
+ * of a thread while splits and merges nest. Page buffers are taken from the
+ * heap at the page size of the open table instead and are only ever used
+ * through pointers.
+ */
+static inline page_t *alloc_page_buf(void) {
+  page_t *buf = (page_t *)malloc(page_size);
+  if (buf == NULL) {
+    perror("Memory allocation for a page buffer failed.");
+    exit(EXIT_FAILURE);
+  }
+  return buf;
+}
+
+static inline void free_page_buf(page_t *buf) { free(buf); }
+
 #endif
\ No newline at end of file
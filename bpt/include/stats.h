@@ -0,0 +1,111 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdint.h>
+
+/* Counters of what the engine does, kept per kind of API call. Every API
+ * call and every maintenance step runs under the table lock, so the counters
+ * are plain integers bumped by whoever holds it and cost an add each; they
+ * start from zero whenever a table is opened.
+ *
+ * The latency of each call goes to a log-bucketed histogram of its kind,
+ * together with the time the call spent in each phase. The phase a call is
+ * in switches as it goes, so the phases of a call add up to its latency.
+ */
+
+typedef enum {
+  STAT_PAGE_READS,
+  STAT_PAGE_WRITES,
+  STAT_FSYNCS,
+  STAT_CACHE_HITS,   // compressed pages read from the page cache
+  STAT_CACHE_MISSES, // compressed pages read from the file
+  STAT_SPLITS,
+  STAT_MERGES,
+  STAT_REDISTRIBUTIONS,
+  STAT_PAGE_ALLOCS,
+  STAT_PAGE_FREES,
+  STAT_COUNTER_CNT
+} stat_counter_t;
+
+typedef enum {
+  STAT_OP_OTHER, // open, close and truncate
+  STAT_OP_INSERT,
+  STAT_OP_UPDATE,
+  STAT_OP_FIND,
+  STAT_OP_RANGE,
+  STAT_OP_DELETE,
+  STAT_OP_MAINTENANCE,
+  STAT_OP_CNT
+} stat_op_t;
+
+typedef struct {
+  uint64_t calls[STAT_OP_CNT];
+  uint64_t counters[STAT_OP_CNT][STAT_COUNTER_CNT];
+} db_stats_t;
+
+typedef enum {
+  STAT_PHASE_LOCK,        // waiting for the table lock
+  STAT_PHASE_TRAVERSAL,   // finding the leaf
+  STAT_PHASE_LEAF,        // reading and changing the leaf, the default
+  STAT_PHASE_PROPAGATION, // splits, merges and redistributions
+  STAT_PHASE_SYNC,        // fsync
+  STAT_PHASE_CNT
+} stat_phase_t;
+
+// histogram of whole calls, next to the histograms of their phases
+#define STAT_PHASE_TOTAL STAT_PHASE_CNT
+
+/* A value v below 2^LATENCY_SUB_BUCKET_BITS has a bucket of its own, any
+ * other one shares its bucket with the values that agree with it in the
+ * leading LATENCY_SUB_BUCKET_BITS + 1 bits, so a bucket is within 1/8 of its
+ * values. Latencies are in nanoseconds, capped at 2^LATENCY_MAX_BITS - 1.
+ */
+#define LATENCY_SUB_BUCKET_BITS 3
+#define LATENCY_MAX_BITS 40
+#define LATENCY_BUCKET_CNT                                                     \
+  ((LATENCY_MAX_BITS - LATENCY_SUB_BUCKET_BITS + 1) << LATENCY_SUB_BUCKET_BITS)
+
+typedef struct {
+  uint64_t count;
+  uint64_t max_ns;
+  uint64_t buckets[LATENCY_BUCKET_CNT];
+} latency_histogram_t;
+
+// Count what follows against op, and one call of it unless op is
+// STAT_OP_MAINTENANCE or STAT_OP_OTHER, and start timing the call
+void stats_begin(stat_op_t op);
+// Let the call being timed start at since, the time until now is spent
+// waiting for the table lock
+void stats_waited(uint64_t since);
+// Stop timing the call and add it to the histograms of its op
+void stats_end(void);
+// Switch the call to phase, return the phase it was in
+stat_phase_t stats_enter(stat_phase_t phase);
+// fsync counted and timed as STAT_PHASE_SYNC
+int stats_fsync(int fd);
+// Nanoseconds of a monotonic clock
+uint64_t stats_clock(void);
+// Add n to counter of the current op
+void stats_add(stat_counter_t counter, uint64_t n);
+// Zero every counter and histogram
+void stats_reset(void);
+// Zero every histogram
+void latency_reset(void);
+// Add a value of ns nanoseconds to histogram
+void latency_record(latency_histogram_t *histogram, uint64_t ns);
+// Copy the histogram of phase (or STAT_PHASE_TOTAL) of op to dest
+void latency_snapshot(stat_op_t op, int phase, latency_histogram_t *dest);
+// Latency that percentile (0 to 100) of the values do not exceed, the top of
+// its bucket, 0 if there are none
+uint64_t latency_percentile(const latency_histogram_t *histogram,
+                            double percentile);
+// Copy the counters to dest
+void stats_snapshot(db_stats_t *dest);
+// Sum of counter over every op
+uint64_t stats_total(const db_stats_t *stats, stat_counter_t counter);
+// Print the counters by op, leaving out ops with nothing counted
+void print_stats(const db_stats_t *stats);
+// Print p50, p99 and p999 of every timed op and its phases
+void print_latency(void);
+
+#endif
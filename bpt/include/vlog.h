@@ -0,0 +1,50 @@
+#ifndef VLOG_H
+#define VLOG_H
+
+#include "page.h"
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Append-only value log used for key-value separation. The file starts with
+ * a vlog_header_t block, records are appended behind it and the space below
+ * the tail is handed back to the file system by the garbage collector.
+ */
+
+#define VLOG_MAGIC 0x474f4c5654504244ULL // "DBPTVLOG"
+#define VLOG_HEADER_SIZE 4096
+
+typedef struct {
+  uint64_t magic;
+  uint64_t tail;    // offset of the oldest record that may be live
+  uint64_t garbage; // bytes of dead records between tail and head
+} vlog_header_t;
+
+// header of a record, the value bytes follow
+typedef struct {
+  int64_t key;
+  uint64_t length;
+} vlog_record_t;
+
+// Open or create the value log at pathname
+int vlog_open(const char *pathname);
+// Persist the header and close the value log
+int vlog_close(void);
+bool vlog_is_open(void);
+// Append a record and return its offset
+uint64_t vlog_append(int64_t key, const char *value, size_t length);
+// Read the header of the record at offset
+void vlog_read_record(uint64_t offset, vlog_record_t *record);
+// Read length bytes of the value of the record at offset
+void vlog_read_value(uint64_t offset, char *dest, size_t length);
+// Account for a record of length value bytes that is no longer referenced
+void vlog_discard(uint64_t length);
+// Bytes of the log kept on disk (head - tail) and the dead part of them
+uint64_t vlog_head(void);
+uint64_t vlog_tail(void);
+uint64_t vlog_garbage(void);
+// Release the records below tail, garbage is the dead bytes among them
+void vlog_advance_tail(uint64_t tail, uint64_t garbage);
+// Drop every record, the log starts over behind its header
+void vlog_truncate(void);
+
+#endif
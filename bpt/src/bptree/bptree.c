@@ -2,32 +2,57 @@
 #include "bpt_internal.h"
 
 /* Finds and returns success(0) or fail(1)
+ * The value is copied to result_buf (VALUE_SIZE bytes) unless it is NULL.
  */
 int find(int64_t key, char *result_buf) {
-  pagenum_t leaf_num = find_leaf(key);
+  return find_value(key, result_buf, VALUE_SIZE, NULL);
+}
+
+/**
+ * helper function for find_value and delete_value
+ * Copies at most size - 1 bytes of the value at index to result_buf (if not
+ * NULL) and its full length to value_size (if not NULL).
+ */
+static void copy_record_value(const leaf_page_t *leaf_page, int index,
+                              char *result_buf, size_t size,
+                              size_t *value_size) {
+  if (result_buf != NULL) {
+    size_t length = leaf_read_value(leaf_page, index, result_buf, size);
+    if (value_size != NULL) {
+      *value_size = length;
+    }
+  } else if (value_size != NULL) {
+    char probe[1];
+    *value_size = leaf_read_value(leaf_page, index, probe, sizeof(probe));
+  }
+}
+
+/* Finds the value of key, copying at most size - 1 bytes of it to
+ * result_buf (if not NULL) and its full length to value_size (if not NULL).
+ */
+int find_value(int64_t key, char *result_buf, size_t size,
+               size_t *value_size) {
+  page_t *tmp_page = alloc_page_buf();
+  pagenum_t leaf_num = find_leaf_path(key, NULL, tmp_page);
   if (leaf_num == PAGE_NULL) {
+    free_page_buf(tmp_page);
     return FAILURE;
   }
 
   // leaf_page 에서 키에 해당하는 값 찾기
-  page_t tmp_page;
-  file_read_page(leaf_num, &tmp_page);
-  leaf_page_t *leaf_page = (leaf_page_t *)&tmp_page;
+  leaf_page_t *leaf_page = (leaf_page_t *)tmp_page;
 
-  int index = 0;
+  int index = leaf_find_key(leaf_page, key);
 
-  for (index = 0; index < leaf_page->num_of_keys; index++) {
-    if (leaf_page->records[index].key == key) {
-      break;
-    }
-  }
   // 해당하는 키를 찾았으면
-  if (index != leaf_page->num_of_keys) {
-    copy_value(result_buf, leaf_page->records[index].value, VALUE_SIZE);
-    return SUCCESS;
+  int result = FAILURE;
+  if (index >= 0) {
+    copy_record_value(leaf_page, index, result_buf, size, value_size);
+    result = SUCCESS;
   }
 
-  return FAILURE;
+  free_page_buf(tmp_page);
+  return result;
 }
 
 /**
@@ -35,69 +60,239 @@ int find(int64_t key, char *result_buf) {
  * must be used before insert
  */
 void init_header_page() {
-  page_t header_buf;
-  memset(&header_buf, 0, PAGE_SIZE);
-  header_page_t *header_page = (header_page_t *)&header_buf;
+  forget_rightmost_leaf();
+  bump_smo_epoch();
+  page_t *header_buf = alloc_page_buf();
+  memset(header_buf, 0, page_size);
+  header_page_t *header_page = (header_page_t *)header_buf;
   header_page->num_of_pages = HEADER_PAGE_POS + 1;
+  header_page->version = FORMAT_VERSION;
+  header_page->page_size = page_size;
 
   file_write_page(HEADER_PAGE_POS, (page_t *)header_page);
+  free_page_buf(header_buf);
+}
+
+/**
+ * helper function for upsert, update and modify
+ * Replaces the value of the record at index in the leaf a descent has read.
+ * Only the leaf is written, unless the new value does not fit: then the
+ * record is inserted again and the leaf is split
+ */
+static int replace_value(const tree_path_t *path, pagenum_t leaf,
+                         page_t *leaf_buf, int index, int64_t key,
+                         char *value) {
+  leaf_page_t *leaf_page = (leaf_page_t *)leaf_buf;
+  if (leaf_replace_value(leaf_page, index, value)) {
+    file_write_page(leaf, leaf_buf);
+    return SUCCESS;
+  }
+
+  // The split reads the leaf again, so the old record has to be gone from it
+  leaf_free_value(leaf_page, index);
+  leaf_remove_record(leaf_page, index);
+  file_write_page(leaf, leaf_buf);
+  return insert_into_leaf_after_splitting(path, key, value);
+}
+
+/**
+ * helper function for insert and upsert
+ * One descent finds the leaf and tells whether the key is already there.
+ * An existing record fails the insertion unless overwrite is set, then its
+ * value is replaced
+ */
+static int insert_record(int64_t key, char *value, bool overwrite) {
+  tree_path_t path;
+
+  // Case: key above every key, appended to the last leaf.
+  if (append_to_rightmost_leaf(key, value)) {
+    return SUCCESS;
+  }
+
+  // Case: the tree does not exist yet. Start a new tree.
+  page_t *leaf_buf = alloc_page_buf();
+  pagenum_t leaf = find_leaf_path(key, &path, leaf_buf);
+  if (leaf == PAGE_NULL) {
+    free_page_buf(leaf_buf);
+    return start_new_tree(key, value);
+  }
+
+  leaf_page_t *leaf_page = (leaf_page_t *)leaf_buf;
+  int index = leaf_lower_bound(leaf_page, key);
+  if (index < leaf_page->num_of_keys && leaf_key(leaf_page, index) == key) {
+    // a tombstone of the key takes the value again
+    int result = FAILURE;
+    if (overwrite || leaf_is_tombstone(leaf_page, index)) {
+      result = replace_value(&path, leaf, leaf_buf, index, key, value);
+    }
+    free_page_buf(leaf_buf);
+    return result;
+  }
+
+  // Case: leaf has room for key and pointer.
+  if (leaf_has_room(leaf_page, value)) {
+    insert_into_leaf(leaf, leaf_buf, key, value);
+    if (leaf_page->right_sibling_page_num == PAGE_NULL) {
+      remember_rightmost_leaf(
+          leaf, leaf_key(leaf_page, leaf_page->num_of_keys - 1));
+    }
+    free_page_buf(leaf_buf);
+    return SUCCESS;
+  }
+
+  // Case:  leaf must be split.
+  free_page_buf(leaf_buf);
+  return insert_into_leaf_after_splitting(&path, key, value);
 }
 
 /* Master insertion function.
  * Inserts a key and an associated value into
  * the B+ tree, causing the tree to be adjusted
  * however necessary to maintain the B+ tree
- * properties.
+ * properties. Fails if the key exists.
  */
 int insert(int64_t key, char *value) {
-  pagenum_t leaf;
+  return insert_record(key, value, false);
+}
+
+/* Inserts a key and an associated value, or replaces the value of the key
+ * if it exists.
+ */
+int upsert(int64_t key, char *value) {
+  return insert_record(key, value, true);
+}
+
+/* Replaces the value of an existing key. Fails if the key does not exist.
+ */
+int update(int64_t key, char *value) {
+  tree_path_t path;
+  page_t *leaf_buf = alloc_page_buf();
+
+  pagenum_t leaf = find_leaf_path(key, &path, leaf_buf);
+  int index =
+      leaf == PAGE_NULL ? -1 : leaf_find_key((leaf_page_t *)leaf_buf, key);
+
+  int result = FAILURE;
+  if (index >= 0) {
+    result = replace_value(&path, leaf, leaf_buf, index, key, value);
+  }
+  free_page_buf(leaf_buf);
+  return result;
+}
+
+/* Read-modify-write of the value of key in one descent. modifier gets the
+ * current value and returns the new one, or NULL to keep it. Fails if the
+ * key does not exist.
+ */
+int modify(int64_t key, value_modifier_t modifier, void *arg) {
+  tree_path_t path;
+  page_t *leaf_buf = alloc_page_buf();
 
-  char result_buf[VALUE_SIZE];
-  if (find(key, result_buf) == SUCCESS) {
+  pagenum_t leaf = find_leaf_path(key, &path, leaf_buf);
+  leaf_page_t *leaf_page = (leaf_page_t *)leaf_buf;
+  int index = leaf == PAGE_NULL ? -1 : leaf_find_key(leaf_page, key);
+  if (index < 0) {
+    free_page_buf(leaf_buf);
     return FAILURE;
   }
 
-  // Case: the tree does not exist yet. Start a new tree.
-  page_t header_page_buf;
-  file_read_page(HEADER_PAGE_POS, &header_page_buf);
-  header_page_t *h_page = (header_page_t *)&header_page_buf;
+  // the whole value, overflow and value log values may be longer
+  char short_value[VALUE_SIZE];
+  char *old_value = short_value;
+  size_t length =
+      leaf_read_value(leaf_page, index, short_value, sizeof(short_value));
+  if (length >= sizeof(short_value)) {
+    old_value = (char *)malloc(length + 1);
+    if (old_value == NULL) {
+      perror("modify");
+      exit(EXIT_FAILURE);
+    }
+    leaf_read_value(leaf_page, index, old_value, length + 1);
+  }
 
-  pagenum_t root_num = h_page->root_page_num;
-  if (root_num == PAGE_NULL) {
-    return start_new_tree(key, value);
+  int result = SUCCESS;
+  const char *new_value = modifier(key, old_value, arg);
+  if (new_value != NULL) {
+    result = replace_value(&path, leaf, leaf_buf, index, key,
+                           (char *)new_value);
   }
 
-  // Case: the tree already exists.(Rest of function body.)
-  leaf = find_leaf(key);
+  if (old_value != short_value) {
+    free(old_value);
+  }
+  free_page_buf(leaf_buf);
+  return result;
+}
 
-  // Case: leaf has room for key and pointer.
-  page_t tmp_leaf_page;
-  file_read_page(leaf, &tmp_leaf_page);
-  leaf_page_t *leaf_page = (leaf_page_t *)&tmp_leaf_page;
+typedef struct {
+  const char *expected;
+  const char *value;
+  bool swapped;
+} swap_args_t;
 
-  if (leaf_page->num_of_keys < RECORD_CNT) {
-    return insert_into_leaf(leaf, &tmp_leaf_page, key, value);
+static const char *swap_if_expected(int64_t key, const char *value,
+                                    void *arg) {
+  swap_args_t *args = (swap_args_t *)arg;
+  if (strcmp(value, args->expected) != 0) {
+    return NULL;
   }
+  args->swapped = true;
+  return args->value;
+}
 
-  // Case:  leaf must be split.
-  return insert_into_leaf_after_splitting(leaf, key, value);
+/* Replaces the value of key only if it equals expected. Returns
+ * VALUE_MISMATCH if it does not and FAILURE if the key does not exist.
+ */
+int compare_and_swap(int64_t key, const char *expected, char *value) {
+  swap_args_t args = {expected, value, false};
+  int result = modify(key, swap_if_expected, &args);
+  if (result == SUCCESS && !args.swapped) {
+    return VALUE_MISMATCH;
+  }
+  return result;
 }
 
 /* Master deletion function.
  */
-int delete (int64_t key) {
-  pagenum_t leaf;
+int delete (int64_t key) { return delete_value(key, NULL, 0, NULL); }
+
+/* Deletes key in one descent. The leaf found on the way is changed in memory
+ * and the path to it is used to rebalance. The deleted value is copied as by
+ * find_value.
+ */
+int delete_value(int64_t key, char *result_buf, size_t size,
+                 size_t *value_size) {
+  tree_path_t path;
+  page_t *leaf_buf = alloc_page_buf();
 
-  char value_buf[VALUE_SIZE];
-  // if not exists fail
-  if (find(key, value_buf) != SUCCESS) {
+  pagenum_t leaf = find_leaf_path(key, &path, leaf_buf);
+  leaf_page_t *leaf_page = (leaf_page_t *)leaf_buf;
+  int index = leaf == PAGE_NULL ? -1 : leaf_find_key(leaf_page, key);
+  if (index < 0) {
+    free_page_buf(leaf_buf);
     return FAILURE;
   }
 
-  leaf = find_leaf(key);
+  copy_record_value(leaf_page, index, result_buf, size, value_size);
+  leaf_free_value(leaf_page, index);
+
+  int result = SUCCESS;
+  if (lazy_deletes && defer_underflow(key)) {
+    // a lazy delete leaves a tombstone for rebalance_deferred to sweep
+    leaf_set_tombstone(leaf_page, index);
+    file_write_page(leaf, leaf_buf);
+  } else {
+    leaf_remove_record(leaf_page, index);
 
-  if (leaf != PAGE_NULL) {
-    return delete_entry(leaf, key, value_buf);
+    // an underfull leaf below the root waits for rebalance_deferred
+    if (defer_merges && path.height > 1 &&
+        leaf_page->num_of_keys < merge_threshold && defer_underflow(key)) {
+      file_write_page(leaf, leaf_buf);
+    } else {
+      result = finish_removal(&path, path.height - 1, leaf_buf);
+    }
   }
-  return FAILURE;
+  free_page_buf(leaf_buf);
+  return result;
 }
+
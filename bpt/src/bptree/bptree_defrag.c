@@ -0,0 +1,147 @@
+#include "bpt.h"
+#include "bpt_internal.h"
+
+// LEAF DEFRAGMENTATION
+
+/* Leaves get whatever page the free page list holds, so leaves that follow
+ * each other in key order end up scattered over the file and a scan along
+ * the leaf chain reads it at random. The defragmenter visits the leaves in
+ * key order, a few per step, and moves each leaf that is not on the page
+ * right after its left sibling to a page past the end of the file. Leaves
+ * moved one after another get contiguous pages, so a pass leaves the leaf
+ * chain in file order; the old pages go to the free page list. The first
+ * leaf is moved along when the second is not right after it, otherwise every
+ * pass would move the leaves behind it again.
+ *
+ * Each move grows the file by a page until the free page list hands the old
+ * page out again, and one leaf split out of order makes a pass move every leaf
+ * behind it. So a pass only counts the leaves out of order, and the next pass
+ * moves them only if more than 1 / DEFRAG_MIN_SCATTER of the leaves were.
+ */
+
+#define DEFRAG_MIN_SCATTER 8
+
+static struct {
+  bool running;      // a pass is under way
+  bool moving;       // the pass moves leaves instead of counting them
+  int64_t next_key;  // smallest key routed to the next leaf to visit
+  int64_t leaves;    // leaves visited in the pass
+  int64_t scattered; // of those, leaves out of file order
+} defrag;
+
+/**
+ * @brief start the next defragmentation step from the first leaf
+ */
+void reset_defragmentation(void) {
+  defrag.running = false;
+  defrag.moving = false;
+}
+
+/**
+ * @brief move the leaf a descent left in path and leaf_buf to a page past the
+ * end of the file, pointing its parent and its left sibling (if not
+ * PAGE_NULL) at the new page. Returns the new page, or PAGE_NULL with nothing
+ * changed if the parent cannot hold the wider page number
+ */
+static pagenum_t move_leaf(const tree_path_t *path, const page_t *leaf_buf,
+                           pagenum_t left_num) {
+  pagenum_t leaf_num = path->page_nums[path->height - 1];
+  pagenum_t parent_num = path->page_nums[path->height - 2];
+  page_t *page_buf = alloc_page_buf();
+  file_read_page(parent_num, page_buf);
+  internal_page_t *parent_page = (internal_page_t *)page_buf;
+
+  pagenum_t new_num = file_alloc_page_at_end();
+  int index = search_internal_child(parent_page, leaf_num);
+  if (index == -1) {
+    parent_page->one_more_page_num = new_num;
+  } else if (!internal_set_child(parent_page, index, new_num)) {
+    file_free_page(new_num);
+    free_page_buf(page_buf);
+    return PAGE_NULL;
+  }
+
+  // the copy is in place before anything points at it
+
+  file_write_page(new_num, leaf_buf);
+  file_write_page(parent_num, page_buf);
+  if (left_num != PAGE_NULL) {
+    file_read_page(left_num, page_buf);
+    ((leaf_page_t *)page_buf)->right_sibling_page_num = new_num;
+    file_write_page(left_num, page_buf);
+  }
+  free_page_buf(page_buf);
+  file_free_page(leaf_num);
+
+  forget_rightmost_leaf();
+  bump_smo_epoch();
+  return new_num;
+}
+
+/**
+ * @brief end the pass under way, the next one moves leaves if this one counted
+ * enough of them out of order
+ */
+static void finish_pass(void) {
+  defrag.moving = !defrag.moving &&
+                  defrag.scattered * DEFRAG_MIN_SCATTER > defrag.leaves;
+  defrag.running = false;
+}
+
+/* Visits up to max_leaves leaves from where the last step stopped, counting or
+ * moving those that are out of file order. A pass that reached the last leaf
+ * starts again from the first one. Returns the number of leaves moved.
+ */
+int defragment_leaves(int max_leaves) {
+  int moved = 0;
+  pagenum_t left_num = PAGE_NULL; // the leaf visited last, if in this step
+  page_t *leaf_buf = alloc_page_buf();
+
+  for (int visited = 0; visited < max_leaves; visited++) {
+    if (!defrag.running) {
+      defrag.running = true;
+      defrag.next_key = INT64_MIN;
+      defrag.leaves = 0;
+      defrag.scattered = 0;
+    }
+
+    tree_path_t path;
+    int64_t low, high;
+    pagenum_t leaf_num =
+        find_leaf_bounds(defrag.next_key, &path, leaf_buf, &low, &high);
+    if (leaf_num == PAGE_NULL || path.height < 2) {
+      reset_defragmentation();
+      break;
+    }
+
+    // the left sibling holds the keys right below the fence
+    if (left_num == PAGE_NULL && low != INT64_MIN) {
+      left_num = find_leaf(low - 1);
+    }
+    pagenum_t right_num = ((leaf_page_t *)leaf_buf)->right_sibling_page_num;
+    bool out_of_order = low == INT64_MIN
+                            ? right_num != PAGE_NULL && right_num != leaf_num + 1
+                            : leaf_num != left_num + 1;
+    defrag.leaves++;
+    if (out_of_order && !defrag.moving) {
+      defrag.scattered++;
+    } else if (out_of_order) {
+      pagenum_t new_num = move_leaf(&path, leaf_buf,
+                                    low == INT64_MIN ? PAGE_NULL : left_num);
+
+      if (new_num != PAGE_NULL) {
+        leaf_num = new_num;
+        moved++;
+      }
+    }
+    left_num = leaf_num;
+
+    if (high == INT64_MAX) {
+      finish_pass();
+      break;
+    }
+    defrag.next_key = high + 1;
+  }
+  free_page_buf(leaf_buf);
+  return moved;
+}
@@ -1,36 +1,35 @@
 #include "bpt.h"
 #include "bpt_internal.h"
+#include "stats.h"
+#include "vlog.h"
 
 // DELETION.
 
+int merge_threshold = MIN_KEYS;
+bool defer_merges = false;
+bool lazy_deletes = false;
+
+/* Leaves deletes left underfull while merges are deferred, or with a
+ * tombstone while deletes are lazy, each by a key that was deleted from it.
+ * The key still routes to the leaf, or to the page that took its keys,
+ * whatever changed in the tree since.
+ */
+static struct {
+  int64_t keys[DEFERRED_MERGE_CAPACITY];
+  int count;
+} deferred;
+
 /* Return the index of the key to the left
  * of the pointer in the parent pointing
  * to n. If not (the node is the leftmost child),
  * returns -1 to signify this special case.
- * If target_node has no parent, return -2 (CANNOT_ROOT)
  */
-int get_kprime_index(pagenum_t target_node) {
-  page_t target_buf, parent_buf;
-  file_read_page(target_node, &target_buf);
-  page_header_t *target_header = (page_header_t *)&target_buf;
-
-  pagenum_t parent_num = target_header->parent_page_num;
-  if (parent_num == PAGE_NULL) {
-    return CANNOT_ROOT;
-  }
-
-  file_read_page(parent_num, &parent_buf);
-  internal_page_t *parent_page = (internal_page_t *)&parent_buf;
-
-  // 왼쪽 형제가 없는 경우
-  if (parent_page->one_more_page_num == target_node) {
-    return -1;
-  }
-
-  for (int index = 0; index < parent_page->num_of_keys; index++) {
-    if (parent_page->entries[index].page_num == target_node) {
-      return index;
-    }
+int get_kprime_index(const internal_page_t *parent_page,
+                     pagenum_t target_node) {
+  // 왼쪽 형제가 없는 경우 -1
+  int index = search_internal_child(parent_page, target_node);
+  if (index >= -1) {
+    return index;
   }
 
   // Error state.
@@ -40,9 +39,9 @@ int get_kprime_index(pagenum_t target_node) {
 }
 
 pagenum_t adjust_root(pagenum_t root) {
-  page_t root_buf;
-  file_read_page(root, &root_buf);
-  page_header_t *root_header = (page_header_t *)&root_buf;
+  page_t *root_buf = alloc_page_buf();
+  file_read_page(root, root_buf);
+  page_header_t *root_header = (page_header_t *)root_buf;
 
   /* Case: nonempty root.
    * Key and pointer have already been deleted,
@@ -50,40 +49,37 @@ pagenum_t adjust_root(pagenum_t root) {
    */
 
   if (root_header->num_of_keys > 0) {
+    free_page_buf(root_buf);
     return SUCCESS;
   }
 
   /* Case: empty root.
    */
 
+  forget_rightmost_leaf();
+  bump_smo_epoch();
+
   // If it has a child, promote
   // the first (only) child
   // as the new root.
   pagenum_t new_root;
-  internal_page_t *root_internal = (internal_page_t *)&root_buf;
+  internal_page_t *root_internal = (internal_page_t *)root_buf;
   if (root_header->is_leaf == INTERNAL) {
     new_root = root_internal->one_more_page_num;
-
-    if (new_root != PAGE_NULL) {
-      page_t new_root_buf;
-      file_read_page(new_root, &new_root_buf);
-      page_header_t *new_root_header = (page_header_t *)&new_root_buf;
-
-      new_root_header->parent_page_num = PAGE_NULL;
-      file_write_page(new_root, &new_root_buf);
-    }
   } else {
     new_root = PAGE_NULL;
   }
 
   file_free_page(root);
+  free_page_buf(root_buf);
 
   // update header
-  page_t header_buf;
-  file_read_page(HEADER_PAGE_POS, &header_buf);
-  header_page_t *header_page = (header_page_t *)&header_buf;
+  page_t *header_buf = alloc_page_buf();
+  file_read_page(HEADER_PAGE_POS, header_buf);
+  header_page_t *header_page = (header_page_t *)header_buf;
   header_page->root_page_num = new_root;
-  file_write_page(HEADER_PAGE_POS, &header_buf);
+  file_write_page(HEADER_PAGE_POS, header_buf);
+  free_page_buf(header_buf);
 
   return SUCCESS;
 }
@@ -91,50 +87,34 @@ pagenum_t adjust_root(pagenum_t root) {
 /**
  * helper function for coalesce nodes
  * @brief Handles the merging logic of internal nodes
- * Insert k_prime, copy target's entry, and update the child's parent pointer
+ * Insert k_prime and copy target's entry
  */
 void coalesce_internal_nodes(page_t *neighbor_buf, page_t *target_buf,
-                             int neighbor_num, int64_t k_prime) {
-  page_header_t *neighbor_header = (page_header_t *)neighbor_buf;
+                             int64_t k_prime) {
   internal_page_t *neighbor_internal = (internal_page_t *)neighbor_buf;
   internal_page_t *target_internal = (internal_page_t *)target_buf;
 
-  int neighbor_insertion_index = neighbor_header->num_of_keys;
+  int neighbor_insertion_index = neighbor_internal->num_of_keys;
+  int num_entries = neighbor_insertion_index + 1 + target_internal->num_of_keys;
+  entry_t *entries = (entry_t *)malloc(num_entries * sizeof(entry_t));
+  if (entries == NULL) {
+    perror("Temporary entries array.");
+    exit(EXIT_FAILURE);
+  }
 
-  // Append k_prime and the target's one_more_page_num pointer
-  neighbor_internal->entries[neighbor_insertion_index].key = k_prime;
-  neighbor_internal->entries[neighbor_insertion_index].page_num =
+  // Append k_prime and the target's one_more_page_num pointer, then all
+  // pointers and keys from target
+  internal_read_entries(neighbor_internal, entries);
+  entries[neighbor_insertion_index].key = k_prime;
+  entries[neighbor_insertion_index].page_num =
       target_internal->one_more_page_num;
-  neighbor_header->num_of_keys++;
+  internal_read_entries(target_internal,
+                        entries + neighbor_insertion_index + 1);
 
-  // Append all pointers and keys from target (excluding target's
-  // one_more_page_num
-  for (int i = neighbor_insertion_index + 1, j = 0;
-       j < target_internal->num_of_keys; i++, j++) {
-    neighbor_internal->entries[i] = target_internal->entries[j];
-    neighbor_header->num_of_keys++;
-  }
+  internal_write_entries(neighbor_internal, entries, num_entries);
   target_internal->num_of_keys = 0;
 
-  // Update parent pointers for all children copied from target
-  pagenum_t child_num =
-      neighbor_internal->entries[neighbor_insertion_index].page_num;
-  if (child_num != PAGE_NULL) {
-    page_t child_buf;
-    file_read_page(child_num, &child_buf);
-    ((page_header_t *)&child_buf)->parent_page_num = neighbor_num;
-    file_write_page(child_num, &child_buf);
-  }
-  for (int i = neighbor_insertion_index + 1; i < neighbor_header->num_of_keys;
-       i++) {
-    child_num = neighbor_internal->entries[i].page_num;
-    if (child_num != PAGE_NULL) {
-      page_t child_buf;
-      file_read_page(child_num, &child_buf);
-      ((page_header_t *)&child_buf)->parent_page_num = neighbor_num;
-      file_write_page(child_num, &child_buf);
-    }
-  }
+  free(entries);
 }
 
 /**
@@ -143,18 +123,14 @@ void coalesce_internal_nodes(page_t *neighbor_buf, page_t *target_buf,
  * Copy records from target and update right_sibling_page_num
  */
 void coalesce_leaf_nodes(page_t *neighbor_buf, page_t *target_buf) {
-  page_header_t *neighbor_header = (page_header_t *)neighbor_buf;
   leaf_page_t *neighbor_leaf = (leaf_page_t *)neighbor_buf;
   leaf_page_t *target_leaf = (leaf_page_t *)target_buf;
 
-  int neighbor_insertion_index = neighbor_header->num_of_keys;
-
   // Append all records from target to neighbor
-  for (int i = neighbor_insertion_index, j = 0; j < target_leaf->num_of_keys;
-       i++, j++) {
-    neighbor_leaf->records[i] = target_leaf->records[j];
-    neighbor_header->num_of_keys++;
-  }
+  leaf_slot_t *slots = leaf_alloc_slots(target_leaf->num_of_keys);
+  leaf_read_slots(target_leaf, slots);
+  leaf_append_slots(neighbor_leaf, slots, target_leaf->num_of_keys);
+  free(slots);
 
   // Update neighbor's right sibling pointer
   neighbor_leaf->right_sibling_page_num = target_leaf->right_sibling_page_num;
@@ -165,9 +141,15 @@ void coalesce_leaf_nodes(page_t *neighbor_buf, page_t *target_buf) {
  * with a neighboring node that
  * can accept the additional entries
  * without exceeding the maximum.
+ * The node is at level of path.
  */
-int coalesce_nodes(pagenum_t target_num, pagenum_t neighbor_num,
+int coalesce_nodes(const tree_path_t *path, int level, pagenum_t neighbor_num,
                    int kprime_index_from_get, int64_t k_prime) {
+  pagenum_t target_num = path->page_nums[level];
+  forget_rightmost_leaf();
+  bump_smo_epoch();
+  stats_add(STAT_MERGES, 1);
+
   // Swap neighbor with target if target is on the extreme left
   if (kprime_index_from_get == -1) {
     pagenum_t tmp_num = target_num;
@@ -175,44 +157,42 @@ int coalesce_nodes(pagenum_t target_num, pagenum_t neighbor_num,
     neighbor_num = tmp_num;
   }
 
-  page_t neighbor_buf, target_buf;
-  file_read_page(neighbor_num, &neighbor_buf);
-  file_read_page(target_num, &target_buf);
-
-  page_header_t *neighbor_header = (page_header_t *)&neighbor_buf;
-  page_header_t *target_header = (page_header_t *)&target_buf;
+  page_t *neighbor_buf = alloc_page_buf();
+  page_t *target_buf = alloc_page_buf();
+  file_read_page(neighbor_num, neighbor_buf);
+  file_read_page(target_num, target_buf);
 
-  pagenum_t parent_num = target_header->parent_page_num;
+  page_header_t *target_header = (page_header_t *)target_buf;
 
   if (target_header->is_leaf == INTERNAL) {
-    coalesce_internal_nodes(&neighbor_buf, &target_buf, neighbor_num, k_prime);
+    coalesce_internal_nodes(neighbor_buf, target_buf, k_prime);
   } else {
-    coalesce_leaf_nodes(&neighbor_buf, &target_buf);
+    coalesce_leaf_nodes(neighbor_buf, target_buf);
   }
 
-  file_write_page(neighbor_num, (page_t *)&neighbor_buf);
+  file_write_page(neighbor_num, neighbor_buf);
   file_free_page(target_num);
+  free_page_buf(neighbor_buf);
+  free_page_buf(target_buf);
 
   // Remove the separator key from the parent
-  return delete_entry(parent_num, k_prime, NULL);
+
+  return delete_entry(path, level - 1, k_prime, NULL);
 }
 
 /**
  * helper function for redistribute nodes
  * @brief Redistributes entries from the left neighbor node to the target node
+ * and returns the new separator key for the parent
  */
-void redistribute_from_left(pagenum_t target_num, page_t *target_buf,
-                            page_t *neighbor_buf, internal_page_t *parent_page,
-                            int k_prime_index, int k_prime) {
+int64_t redistribute_from_left(page_t *target_buf, page_t *neighbor_buf,
+                               int64_t k_prime) {
   page_header_t *target_header = (page_header_t *)target_buf;
 
   if (target_header->is_leaf == INTERNAL) {
-    redistribute_internal_from_left(target_num, target_buf, neighbor_buf,
-                                    parent_page, k_prime_index, k_prime);
-  } else {
-    redistribute_leaf_from_left(target_buf, neighbor_buf, parent_page,
-                                k_prime_index);
+    return redistribute_internal_from_left(target_buf, neighbor_buf, k_prime);
   }
+  return redistribute_leaf_from_left(target_buf, neighbor_buf);
 }
 
 /**
@@ -220,38 +200,22 @@ void redistribute_from_left(pagenum_t target_num, page_t *target_buf,
  * @brief Move the last entry of the left neighbor node from the internal node
  * to the first * position of the target node
  */
-void redistribute_internal_from_left(pagenum_t target_num, page_t *target_buf,
-                                     page_t *neighbor_buf,
-                                     internal_page_t *parent_page,
-                                     int k_prime_index, int k_prime) {
-  page_header_t *target_header = (page_header_t *)target_buf;
+int64_t redistribute_internal_from_left(page_t *target_buf,
+                                        page_t *neighbor_buf,
+                                        int64_t k_prime) {
   internal_page_t *target_internal = (internal_page_t *)target_buf;
   internal_page_t *neighbor_internal = (internal_page_t *)neighbor_buf;
-  page_header_t *neighbor_header = (page_header_t *)neighbor_buf;
+  int last_index = neighbor_internal->num_of_keys - 1;
 
-  for (int index = target_header->num_of_keys; index > 0; index--) {
-    target_internal->entries[index] = target_internal->entries[index - 1];
-  }
-  target_internal->entries[0].page_num = target_internal->one_more_page_num;
+  internal_insert_entry(target_internal, 0, k_prime,
+                        target_internal->one_more_page_num);
 
-  target_internal->entries[0].key = k_prime;
-
-  pagenum_t last_num_neighbor =
-      neighbor_internal->entries[neighbor_header->num_of_keys - 1].page_num;
+  pagenum_t last_num_neighbor = internal_child(neighbor_internal, last_index);
   target_internal->one_more_page_num = last_num_neighbor;
 
-  if (last_num_neighbor != PAGE_NULL) {
-    page_t child_buf;
-    file_read_page(last_num_neighbor, &child_buf);
-    ((page_header_t *)&child_buf)->parent_page_num = target_num;
-    file_write_page(last_num_neighbor, &child_buf);
-  }
-
-  parent_page->entries[k_prime_index].key =
-      neighbor_internal->entries[neighbor_header->num_of_keys - 1].key;
-
-  memset(&neighbor_internal->entries[neighbor_header->num_of_keys - 1], 0,
-         sizeof(entry_t));
+  int64_t new_k_prime = internal_key(neighbor_internal, last_index);
+  internal_remove_entry(neighbor_internal, last_index);
+  return new_k_prime;
 }
 
 /**
@@ -259,43 +223,32 @@ void redistribute_internal_from_left(pagenum_t target_num, page_t *target_buf,
  * @brief Move the last record of the left neighboring node from the leaf node
  * to the first position of the target node
  */
-void redistribute_leaf_from_left(page_t *target_buf, page_t *neighbor_buf,
-                                 internal_page_t *parent_page,
-                                 int k_prime_index) {
-  page_header_t *target_header = (page_header_t *)target_buf;
+int64_t redistribute_leaf_from_left(page_t *target_buf, page_t *neighbor_buf) {
   leaf_page_t *target_leaf = (leaf_page_t *)target_buf;
   leaf_page_t *neighbor_leaf = (leaf_page_t *)neighbor_buf;
-  page_header_t *neighbor_header = (page_header_t *)neighbor_buf;
-
-  for (int i = target_header->num_of_keys; i > 0; i--) {
-    target_leaf->records[i] = target_leaf->records[i - 1];
-  }
-
-  target_leaf->records[0] =
-      neighbor_leaf->records[neighbor_header->num_of_keys - 1];
+  int last_index = neighbor_leaf->num_of_keys - 1;
 
-  parent_page->entries[k_prime_index].key = target_leaf->records[0].key;
+  leaf_slot_t slot;
+  leaf_read_slot(neighbor_leaf, last_index, &slot);
+  leaf_insert_slot(target_leaf, 0, &slot);
+  leaf_remove_record(neighbor_leaf, last_index);
 
-  memset(&neighbor_leaf->records[neighbor_header->num_of_keys - 1], 0,
-         sizeof(record_t));
+  return leaf_key(target_leaf, 0);
 }
 
 /**
  * helper function for redistribute nodes
  * @brief Redistributes entries from the right neighbor node to the target node
+ * and returns the new separator key for the parent
  */
-void redistribute_from_right(pagenum_t target_num, page_t *target_buf,
-                             page_t *neighbor_buf, internal_page_t *parent_page,
-                             int k_prime_index, int k_prime) {
+int64_t redistribute_from_right(page_t *target_buf, page_t *neighbor_buf,
+                                int64_t k_prime) {
   page_header_t *target_header = (page_header_t *)target_buf;
 
   if (target_header->is_leaf == INTERNAL) {
-    redistribute_internal_from_right(target_num, target_buf, neighbor_buf,
-                                     parent_page, k_prime_index, k_prime);
-  } else {
-    redistribute_leaf_from_right(target_buf, neighbor_buf, parent_page,
-                                 k_prime_index);
+    return redistribute_internal_from_right(target_buf, neighbor_buf, k_prime);
   }
+  return redistribute_leaf_from_right(target_buf, neighbor_buf);
 }
 
 /**
@@ -303,37 +256,20 @@ void redistribute_from_right(pagenum_t target_num, page_t *target_buf,
  * @brief Move the first entry of the right neighbor node from the internal node
  * to the last position of the target node
  */
-void redistribute_internal_from_right(pagenum_t target_num, page_t *target_buf,
-                                      page_t *neighbor_buf,
-                                      internal_page_t *parent_page,
-                                      int k_prime_index, int k_prime) {
-  page_header_t *target_header = (page_header_t *)target_buf;
+int64_t redistribute_internal_from_right(page_t *target_buf,
+                                         page_t *neighbor_buf,
+                                         int64_t k_prime) {
   internal_page_t *target_internal = (internal_page_t *)target_buf;
   internal_page_t *neighbor_internal = (internal_page_t *)neighbor_buf;
-  page_header_t *neighbor_header = (page_header_t *)neighbor_buf;
-
-  target_internal->entries[target_header->num_of_keys].key = k_prime;
 
   pagenum_t num_from_neighbor = neighbor_internal->one_more_page_num;
-  target_internal->entries[target_header->num_of_keys].page_num =
-      num_from_neighbor;
-
-  if (num_from_neighbor != PAGE_NULL) {
-    page_t child_buf;
-    file_read_page(num_from_neighbor, &child_buf);
-    ((page_header_t *)&child_buf)->parent_page_num = target_num;
-    file_write_page(num_from_neighbor, &child_buf);
-  }
-
-  parent_page->entries[k_prime_index].key = neighbor_internal->entries[0].key;
-
-  neighbor_internal->one_more_page_num = neighbor_internal->entries[0].page_num;
-  for (int i = 0; i < neighbor_header->num_of_keys - 1; i++) {
-    neighbor_internal->entries[i] = neighbor_internal->entries[i + 1];
-  }
+  internal_insert_entry(target_internal, target_internal->num_of_keys, k_prime,
+                        num_from_neighbor);
 
-  memset(&neighbor_internal->entries[neighbor_header->num_of_keys - 1], 0,
-         sizeof(entry_t));
+  int64_t new_k_prime = internal_key(neighbor_internal, 0);
+  neighbor_internal->one_more_page_num = internal_child(neighbor_internal, 0);
+  internal_remove_entry(neighbor_internal, 0);
+  return new_k_prime;
 }
 
 /**
@@ -341,66 +277,103 @@ void redistribute_internal_from_right(pagenum_t target_num, page_t *target_buf,
  * @brief Move the first record of the right neighboring node from the leaf node
  * to the last position of the target node
  */
-void redistribute_leaf_from_right(page_t *target_buf, page_t *neighbor_buf,
-                                  internal_page_t *parent_page,
-                                  int k_prime_index) {
-  page_header_t *target_header = (page_header_t *)target_buf;
+int64_t redistribute_leaf_from_right(page_t *target_buf,
+                                     page_t *neighbor_buf) {
   leaf_page_t *target_leaf = (leaf_page_t *)target_buf;
   leaf_page_t *neighbor_leaf = (leaf_page_t *)neighbor_buf;
-  page_header_t *neighbor_header = (page_header_t *)neighbor_buf;
 
-  target_leaf->records[target_header->num_of_keys] = neighbor_leaf->records[0];
+  leaf_slot_t slot;
+  leaf_read_slot(neighbor_leaf, 0, &slot);
+  leaf_insert_slot(target_leaf, target_leaf->num_of_keys, &slot);
+  leaf_remove_record(neighbor_leaf, 0);
 
-  parent_page->entries[k_prime_index].key = neighbor_leaf->records[1].key;
+  return leaf_key(neighbor_leaf, 0);
+}
 
-  for (int i = 0; i < neighbor_header->num_of_keys - 1; i++) {
-    neighbor_leaf->records[i] = neighbor_leaf->records[i + 1];
+/**
+ * helper function for handle underflow
+ * @brief Returns true if the record or entry redistribute_nodes would move
+ * from the neighbor fits in the target page, by count and by bytes
+ */
+bool redistribution_fits(const page_t *target_buf, const page_t *neighbor_buf,
+                         bool from_left, int64_t k_prime) {
+  if (((const page_header_t *)target_buf)->is_leaf == INTERNAL) {
+    const internal_page_t *target_internal =
+        (const internal_page_t *)target_buf;
+    if (from_left) {
+      return internal_has_room(target_internal, 0, k_prime,
+                               target_internal->one_more_page_num);
+    }
+    pagenum_t num_from_neighbor =
+        ((const internal_page_t *)neighbor_buf)->one_more_page_num;
+    return internal_has_room(target_internal, target_internal->num_of_keys,
+                             k_prime, num_from_neighbor);
   }
 
-  memset(&neighbor_leaf->records[neighbor_header->num_of_keys - 1], 0,
-         sizeof(record_t));
+  const leaf_page_t *neighbor_leaf = (const leaf_page_t *)neighbor_buf;
+  leaf_slot_t slot;
+  leaf_read_slot(neighbor_leaf, from_left ? neighbor_leaf->num_of_keys - 1 : 0,
+                 &slot);
+  return leaf_has_room_for_slot((const leaf_page_t *)target_buf, &slot);
 }
 
 /* Redistributes entries between two nodes when
  * one has become too small after deletion
  * but its neighbor is too big to append the
  * small node's entries without exceeding the
- * maximum
+ * maximum. The node is at level of path.
  */
-int redistribute_nodes(pagenum_t target_num, pagenum_t neighbor_num,
-                       int kprime_index_from_get, int k_prime_index,
-                       int k_prime) {
-  page_t target_buf, neighbor_buf, parent_buf;
-  file_read_page(target_num, &target_buf);
-  file_read_page(neighbor_num, &neighbor_buf);
-
-  page_header_t *target_header = (page_header_t *)&target_buf;
-  page_header_t *neighbor_header = (page_header_t *)&neighbor_buf;
-  pagenum_t parent_num = target_header->parent_page_num;
-
-  file_read_page(parent_num, &parent_buf);
-  internal_page_t *parent_page = (internal_page_t *)&parent_buf;
-
+int redistribute_nodes(const tree_path_t *path, int level,
+                       pagenum_t neighbor_num, int kprime_index_from_get,
+                       int k_prime_index, int64_t k_prime) {
+  pagenum_t target_num = path->page_nums[level];
+  pagenum_t parent_num = path->page_nums[level - 1];
+  bump_smo_epoch();
+  stats_add(STAT_REDISTRIBUTIONS, 1);
+  page_t *target_buf = alloc_page_buf();
+  page_t *neighbor_buf = alloc_page_buf();
+  page_t *parent_buf = alloc_page_buf();
+  file_read_page(target_num, target_buf);
+  file_read_page(neighbor_num, neighbor_buf);
+
+  file_read_page(parent_num, parent_buf);
+  internal_page_t *parent_page = (internal_page_t *)parent_buf;
+
+  int64_t new_k_prime;
   /// target is not leftmost, so neighbor is to the left
   if (kprime_index_from_get != -1) {
-    redistribute_from_left(target_num, &target_buf, &neighbor_buf, parent_page,
-                           k_prime_index, k_prime);
+    new_k_prime = redistribute_from_left(target_buf, neighbor_buf, k_prime);
   }
   // target is leftmost, so neighbor is to the right
   else {
-    redistribute_from_right(target_num, &target_buf, &neighbor_buf, parent_page,
-                            k_prime_index, k_prime);
+    new_k_prime = redistribute_from_right(target_buf, neighbor_buf, k_prime);
   }
 
-  // Update key counts and write back pages
-  target_header->num_of_keys++;
-  neighbor_header->num_of_keys--;
+  // Write back pages (the helpers have updated the key counts)
+  file_write_page(target_num, target_buf);
+  file_write_page(neighbor_num, neighbor_buf);
+  free_page_buf(target_buf);
+  free_page_buf(neighbor_buf);
+
+  if (internal_set_key(parent_page, k_prime_index, new_k_prime)) {
+    file_write_page(parent_num, parent_buf);
+    free_page_buf(parent_buf);
+    return SUCCESS;
+  }
 
-  file_write_page(target_num, &target_buf);
-  file_write_page(neighbor_num, &neighbor_buf);
-  file_write_page(parent_num, &parent_buf);
+  // The new separator widens the parent's deltas past its page: take the
+  // entry out and insert it again, which splits the parent
+  pagenum_t right_num = internal_child(parent_page, k_prime_index);
+  pagenum_t left_num = k_prime_index == 0
+                           ? parent_page->one_more_page_num
+                           : internal_child(parent_page, k_prime_index - 1);
+  internal_remove_entry(parent_page, k_prime_index);
+  file_write_page(parent_num, parent_buf);
+  free_page_buf(parent_buf);
 
-  return SUCCESS;
+  return insert_into_parent(
+path, level, left_num, new_k_prime, right_num,
+                            false);
 }
 
 /**
@@ -410,21 +383,12 @@ int redistribute_nodes(pagenum_t target_num, pagenum_t neighbor_num,
 int remove_record_from_node(leaf_page_t *target_page, int64_t key,
                             const char *value) {
   // Remove the record and shift other records accordingly.
-  int index = 0;
-  while (target_page->records[index].key != key) {
-    index++;
-  }
-  if (index == target_page->num_of_keys) {
+  int index = leaf_find_key(target_page, key);
+  if (index < 0) {
     return FAILURE;
   }
-
-  for (++index; index < target_page->num_of_keys; index++) {
-    target_page->records[index - 1] = target_page->records[index];
-  }
-  // One key fewer.
-  target_page->num_of_keys--;
-
-  memset(&target_page->records[target_page->num_of_keys], 0, sizeof(record_t));
+  leaf_free_value(target_page, index);
+  leaf_remove_record(target_page, index);
 
   return SUCCESS;
 }
@@ -435,21 +399,12 @@ int remove_record_from_node(leaf_page_t *target_page, int64_t key,
  */
 int remove_entry_from_node(internal_page_t *target_page, int64_t key) {
   // Remove the key and shift other keys accordingly.
-  int index = 0;
-  while (target_page->entries[index].key != key) {
-    index++;
-  }
-  if (index == target_page->num_of_keys) {
+  int index = search_internal_key(target_page, key) - 1;
+  if (index < 0 || internal_key(target_page, index) != key) {
     return FAILURE;
   }
 
-  for (++index; index < target_page->num_of_keys; index++) {
-    target_page->entries[index - 1] = target_page->entries[index];
-  }
-  // One key fewer.
-  target_page->num_of_keys--;
-
-  memset(&target_page->entries[target_page->num_of_keys], 0, sizeof(entry_t));
+  internal_remove_entry(target_page, index);
 
   return SUCCESS;
 }
@@ -461,15 +416,14 @@ int remove_entry_from_node(internal_page_t *target_page, int64_t key) {
  */
 int find_neighbor_and_kprime(pagenum_t target_node,
                              internal_page_t *parent_page,
-                             page_header_t *target_header,
                              pagenum_t *neighbor_num_out,
                              int *k_prime_key_index_out) {
 
-  int kprime_index_from_get = get_kprime_index(target_node);
+  int kprime_index_from_get = get_kprime_index(parent_page, target_node);
 
   if (kprime_index_from_get == -1) {
     // target is P0 neighbor P1
-    *neighbor_num_out = parent_page->entries[0].page_num;
+    *neighbor_num_out = internal_child(parent_page, 0);
     *k_prime_key_index_out = 0;
   } else {
     // target is Pi neighbor Pi-1.
@@ -479,134 +433,457 @@ int find_neighbor_and_kprime(pagenum_t target_node,
     *k_prime_key_index_out = target_pointer_index;
 
     if (target_pointer_index == 0) {
-      // target is P1 (entries[0].page_num) neighbor P0
+      // target is P1 (child of entry 0) neighbor P0
       *neighbor_num_out = parent_page->one_more_page_num;
     } else {
-      // target is Pi+1 (entries[i].page_num, i > 0) neighbor is Pi
+      // target is Pi+1 (child of entry i, i > 0) neighbor is Pi
       *neighbor_num_out =
-          parent_page->entries[target_pointer_index - 1].page_num;
+          internal_child(parent_page, target_pointer_index - 1);
     }
   }
   return kprime_index_from_get;
 }
 
 /**
- * helper function for delete entry
- * @brief Handles node underflow.
- * Finds neighboring nodes and decides whether to merge or redistribute them and
- * call
+ * helper function for handle underflow and rebalance path
+ * @brief Merges the node at level of path with its neighbor or refills it
+ * from the neighbor, and sets changed to whether it did either
  */
-int handle_underflow(pagenum_t target_node) {
-  page_t node_buf, parent_buf;
-  file_read_page(target_node, &node_buf);
-  page_header_t *node_header = (page_header_t *)&node_buf;
-  pagenum_t parent_num = node_header->parent_page_num;
-
-  file_read_page(parent_num, &parent_buf);
-  internal_page_t *parent_page = (internal_page_t *)&parent_buf;
+static int rebalance_node(const tree_path_t *path, int level, bool *changed) {
+  stat_phase_t phase = stats_enter(STAT_PHASE_PROPAGATION);
+  pagenum_t target_node = path->page_nums[level];
+  pagenum_t parent_num = path->page_nums[level - 1];
+  page_t *node_buf = alloc_page_buf();
+  page_t *parent_buf = alloc_page_buf();
+  file_read_page(target_node, node_buf);
+  page_header_t *node_header = (page_header_t *)node_buf;
+
+  file_read_page(parent_num, parent_buf);
+  internal_page_t *parent_page = (internal_page_t *)parent_buf;
 
   pagenum_t neighbor_num;
   int k_prime_key_index;
 
   int kprime_index_from_get = find_neighbor_and_kprime(
-      target_node, parent_page, node_header, &neighbor_num, &k_prime_key_index);
+      target_node, parent_page, &neighbor_num, &k_prime_key_index);
 
-  int64_t k_prime = parent_page->entries[k_prime_key_index].key;
+  int64_t k_prime = internal_key(parent_page, k_prime_key_index);
 
-  page_t neighbor_buf;
-  file_read_page(neighbor_num, &neighbor_buf);
-  page_header_t *neighbor_header = (page_header_t *)&neighbor_buf;
+  page_t *neighbor_buf = alloc_page_buf();
+  file_read_page(neighbor_num, neighbor_buf);
+  page_header_t *neighbor_header = (page_header_t *)neighbor_buf;
 
   int capacity = node_header->is_leaf ? RECORD_CNT : ENTRY_CNT - 1;
+  bool fits =
+      neighbor_header->num_of_keys + node_header->num_of_keys < capacity;
+
+  // both kinds of pages also have to fit by bytes
+  if (fits && node_header->is_leaf) {
+    fits = leaf_can_merge((leaf_page_t *)neighbor_buf,
+                          (leaf_page_t *)node_buf);
+  } else if (fits) {
+    // the neighbor is on the right when the target is leftmost
+    page_t *left_buf = kprime_index_from_get == -1 ? node_buf : neighbor_buf;
+    page_t *right_buf = kprime_index_from_get == -1 ? neighbor_buf : node_buf;
+    fits = internal_can_merge((internal_page_t *)left_buf, k_prime,
+                              (internal_page_t *)right_buf);
+  }
+
+  // merge when both fit, else refill from the neighbor; a page that still has
+  // keys is only refilled from a neighbor above the threshold, and no page
+  // is refilled past its bytes. Pages are left as they are otherwise
+  bool refill = !fits &&
+                (node_header->num_of_keys < MIN_KEYS ||
+                 neighbor_header->num_of_keys > merge_threshold) &&
+                redistribution_fits(node_buf, neighbor_buf,
+                                    kprime_index_from_get != -1, k_prime);
+  free_page_buf(node_buf);
+  free_page_buf(parent_buf);
+  free_page_buf(neighbor_buf);
+
+  int result = SUCCESS;
+  *changed = false;
+  if (fits) {
+    result = coalesce_nodes(path, level, neighbor_num, kprime_index_from_get,
+                            k_prime);
+    *changed = true;
+  } else if (refill) {
+    result = redistribute_nodes(path, level, neighbor_num,
+                                kprime_index_from_get, k_prime_key_index,
+                                k_prime);
+    *changed = true;
+  }
+  stats_enter(phase);
+  return result;
+}
 
-  if (neighbor_header->num_of_keys + node_header->num_of_keys < capacity) {
-    return coalesce_nodes(target_node, neighbor_num, kprime_index_from_get,
-                          k_prime);
-  } else {
-    return redistribute_nodes(target_node, neighbor_num, kprime_index_from_get,
-                              k_prime_key_index, k_prime);
-  }
+/**
+ * helper function for delete entry
+ * @brief Handles node underflow.
+ * Finds neighboring nodes and decides whether to merge or redistribute them and
+ * call. The node is at level of path, below the root
+ */
+int handle_underflow(const tree_path_t *path, int level) {
+  bool changed;
+  return rebalance_node(path, level, &changed);
 }
 
 /* Deletes an entry from the B+ tree.
  * Removes the record and its key and pointer
- * from the leaf, and then makes all appropriate
+ * from the page at level of path, and then makes all appropriate
  * changes to preserve the B+ tree properties.
  */
-int delete_entry(pagenum_t target_node, int64_t key, const char *value) {
-  page_t node_buf;
-  file_read_page(target_node, &node_buf);
-  page_header_t *node_header = (page_header_t *)&node_buf;
+int delete_entry(const tree_path_t *path, int level, int64_t key,
+                 const char *value) {
+  pagenum_t target_node = path->page_nums[level];
+  page_t *node_buf = alloc_page_buf();
+  file_read_page(target_node, node_buf);
+  page_header_t *node_header = (page_header_t *)node_buf;
 
   // Case: Remove key and pointer from node
   int remove_result = FAILURE;
   switch (node_header->is_leaf) {
   case LEAF:
     remove_result =
-        remove_record_from_node((leaf_page_t *)&node_buf, key, value);
+        remove_record_from_node((leaf_page_t *)node_buf, key, value);
     break;
   case INTERNAL:
-    remove_result = remove_entry_from_node((internal_page_t *)&node_buf, key);
+    remove_result = remove_entry_from_node((internal_page_t *)node_buf, key);
     break;
   default:
     perror("delete_entry error: Unknown node type");
+    free_page_buf(node_buf);
     return FAILURE;
   }
 
-  if (remove_result != SUCCESS) {
-    return FAILURE;
+  int result = FAILURE;
+  if (remove_result == SUCCESS) {
+    result = finish_removal(path, level, node_buf);
   }
-  file_write_page(target_node, (page_t *)&node_buf);
+  free_page_buf(node_buf);
+  return result;
+}
 
-  // Case: Deletion from the root
-  page_t header_buf;
-  file_read_page(HEADER_PAGE_POS, &header_buf);
-  header_page_t *header_page = (header_page_t *)&header_buf;
 
-  if (target_node == header_page->root_page_num) {
-    return adjust_root(header_page->root_page_num);
+/**
+ * helper function for delete entry and delete value
+ * @brief Writes the node at level of path after a key was removed from it
+ * in memory, then adjusts the root or handles an underflow
+ */
+int finish_removal(const tree_path_t *path, int level, page_t *node_buf) {
+  pagenum_t target_node = path->page_nums[level];
+  page_header_t *node_header = (page_header_t *)node_buf;
+  file_write_page(target_node, node_buf);
+
+  // Case: Deletion from the root
+  if (level == 0) {
+    return adjust_root(target_node);
   }
 
   // Case: Node stays at or above minimum. (The simple case)
-  if (node_header->num_of_keys >= MIN_KEYS) {
+  if (node_header->num_of_keys >= merge_threshold) {
     return SUCCESS;
   }
 
   // Case: Node falls below minimum (underflow)
-  return handle_underflow(target_node);
+  return handle_underflow(path, level);
 }
 
-void destroy_tree_nodes(pagenum_t root) {
-  if (root == PAGE_NULL) {
-    return;
+// DEFERRED MERGES.
+
+/**
+ * @brief note that a leaf became underfull, or got a tombstone, when key was
+ * deleted from it, for rebalance_deferred. Returns false when too many leaves
+ * are waiting, the caller removes the record and rebalances at once then
+ */
+bool defer_underflow(int64_t key) {
+  if (deferred.count == DEFERRED_MERGE_CAPACITY) {
+    return false;
   }
+  deferred.keys[deferred.count++] = key;
+  return true;
+}
 
-  page_t page_buf;
-  file_read_page(root, &page_buf);
-  page_header_t *page_header = (page_header_t *)&page_buf;
+int deferred_merges(void) { return deferred.count; }
 
-  if (page_header->is_leaf == INTERNAL) {
-    internal_page_t *internal_page = (internal_page_t *)&page_buf;
+void forget_deferred_merges(void) { deferred.count = 0; }
+
+/* Sweeps the tombstones out of up to max_leaves of the leaves deletes left
+ * behind, oldest first, and merges or refills those below merge_threshold,
+ * with the merges cascading up as they would have in the deletes. Leaves
+ * swept, refilled or merged since are skipped. Returns how many still wait.
+ */
+int rebalance_deferred(int max_leaves) {
+  int done = 0;
+  page_t *leaf_buf = alloc_page_buf();
+  while (done < max_leaves && done < deferred.count) {
+    tree_path_t path;
+    int64_t key = deferred.keys[done++];
+    if (find_leaf_path(key, &path, leaf_buf) == PAGE_NULL) {
+      continue;
+    }
+    if (leaf_remove_tombstones((leaf_page_t *)leaf_buf) > 0) {
+      finish_removal(&path, path.height - 1, leaf_buf);
+    } else if (path.height > 1 &&
+               ((page_header_t *)leaf_buf)->num_of_keys < merge_threshold) {
+      handle_underflow(&path, path.height - 1);
+    }
+  }
+  free_page_buf(leaf_buf);
+
+
+  memmove(deferred.keys, deferred.keys + done,
+          (deferred.count - done) * sizeof(int64_t));
+  deferred.count -= done;
+  return deferred.count;
+}
+
+// RANGE DELETION.
 
-    destroy_tree_nodes(internal_page->one_more_page_num);
+/* State of a range deletion. The pages it detaches are collected and freed
+ * in one batch.
+ */
+typedef struct {
+  int64_t start;
+  int64_t end;
+  int64_t removed; // records deleted so far
+  pagenum_t *detached;
+  size_t num_detached;
+  size_t detached_capacity;
+} range_delete_t;
+
+static void detach_page(range_delete_t *range, pagenum_t page_num) {
+  if (range->num_detached == range->detached_capacity) {
+    size_t capacity =
+        range->detached_capacity ? range->detached_capacity * 2 : 64;
+    pagenum_t *detached = (pagenum_t *)realloc(
+        range->detached, capacity * sizeof(pagenum_t));
+    if (detached == NULL) {
+      perror("Detached pages array.");
+      exit(EXIT_FAILURE);
+    }
+    range->detached = detached;
+    range->detached_capacity = capacity;
+  }
+  range->detached[range->num_detached++] = page_num;
+}
+
+/**
+ * helper function for delete range
+ * @brief Detaches a subtree whose keys are all in the range. The values of
+ * its records are released and its pages are listed to be freed
+ */
+static void detach_subtree(range_delete_t *range, pagenum_t page_num) {
+  page_t *page_buf = alloc_page_buf();
+  file_read_page(page_num, page_buf);
+  page_header_t *page_header = (page_header_t *)page_buf;
+
+  if (page_header->is_leaf == INTERNAL) {
+    internal_page_t *internal_page = (internal_page_t *)page_buf;
+    detach_subtree(range, internal_page->one_more_page_num);
     for (int index = 0; index < internal_page->num_of_keys; index++) {
-      destroy_tree_nodes(internal_page->entries[index].page_num);
+      detach_subtree(range, internal_child(internal_page, index));
+    }
+  } else {
+    leaf_page_t *leaf_page = (leaf_page_t *)page_buf;
+    for (int index = 0; index < leaf_page->num_of_keys; index++) {
+      leaf_free_value(leaf_page, index);
     }
+    range->removed += leaf_live_records(leaf_page);
   }
 
-  file_free_page(root);
+  free_page_buf(page_buf);
+  detach_page(range, page_num);
+}
+
+/**
+ * helper function for delete range
+ * @brief Removes the records of the range from a leaf that also holds keys
+ * outside of it
+ */
+static void delete_range_in_leaf(range_delete_t *range, pagenum_t leaf_num,
+                                 page_t *leaf_buf) {
+  leaf_page_t *leaf_page = (leaf_page_t *)leaf_buf;
+  int first = leaf_lower_bound(leaf_page, range->start);
+  int last = first;
+  while (last < leaf_page->num_of_keys &&
+         leaf_key(leaf_page, last) <= range->end) {
+    last++;
+  }
+  if (first == last) {
+    return;
+  }
+
+  for (int index = first; index < last; index++) {
+    range->removed += !leaf_is_tombstone(leaf_page, index);
+    leaf_free_value(leaf_page, index);
+  }
+  leaf_remove_records(leaf_page, first, last);
+  file_write_page(leaf_num, leaf_buf);
 }
 
-void destroy_tree() {
-  page_t header_buf;
-  file_read_page(HEADER_PAGE_POS, &header_buf);
-  header_page_t *header_page = (header_page_t *)&header_buf;
+/**
+ * helper function for delete range
+ * @brief Deletes the range from the subtree under page_num, whose keys lie in
+ * [low, high] and which also holds keys outside of the range. Children inside
+ * the range are detached whole and at most two children on its boundaries
+ * are visited. The page keeps a child, but may be left with fewer than
+ * MIN_KEYS keys
+ */
+static void delete_range_in_node(range_delete_t *range, pagenum_t page_num,
+                                 int64_t low, int64_t high) {
+  page_t *page_buf = alloc_page_buf();
+  file_read_page(page_num, page_buf);
+  page_header_t *page_header = (page_header_t *)page_buf;
+  if (page_header->is_leaf == LEAF) {
+    delete_range_in_leaf(range, page_num, page_buf);
+    free_page_buf(page_buf);
+    return;
+  }
+
+  // children[0] is one_more_page_num, each child keyed by its lowest key
+  internal_page_t *internal_page = (internal_page_t *)page_buf;
+  int num_children = internal_page->num_of_keys + 1;
+  entry_t *children = (entry_t *)malloc(num_children * sizeof(entry_t));
+  if (children == NULL) {
+    perror("Temporary children array.");
+    exit(EXIT_FAILURE);
+  }
+  children[0].key = low;
+  children[0].page_num = internal_page->one_more_page_num;
+  internal_read_entries(internal_page, children + 1);
+
+  int kept = 0;
+  for (int i = 0; i < num_children; i++) {
+    int64_t child_low = children[i].key;
+    int64_t child_high = i + 1 < num_children ? children[i + 1].key - 1 : high;
+
+    if (child_high < range->start || child_low > range->end) {
+      children[kept++] = children[i];
+    } else if (range->start <= child_low && child_high <= range->end) {
+      detach_subtree(range, children[i].page_num);
+    } else {
+      delete_range_in_node(range, children[i].page_num, child_low,
+                           child_high);
+      children[kept++] = children[i];
+    }
+  }
 
-  pagenum_t root_num = header_page->root_page_num;
-  if (root_num != PAGE_NULL) {
-    destroy_tree_nodes(root_num);
+  // the first child left takes the place of one_more_page_num
+  if (kept < num_children) {
+    internal_page->one_more_page_num = children[0].page_num;
+    internal_write_entries(internal_page, children + 1, kept - 1);
+    file_write_page(page_num, page_buf);
   }
+  free(children);
+  free_page_buf(page_buf);
+}
+
+/**
+ * helper function for delete range
+ * @brief Merges or refills the pages on the path to key that a range
+ * deletion left with fewer than merge_threshold keys. The shallowest is
+ * handled first, its parent has the keys rebalance_node needs. A page that
+ * could be neither merged nor refilled is passed over, after a change the
+ * path is found again from the root
+ */
+static void rebalance_path(int64_t key) {
+  tree_path_t path;
+  page_t *page_buf = alloc_page_buf();
+  page_header_t *page_header = (page_header_t *)page_buf;
+  int level = 1;
+
+  while (find_leaf_path(key, &path, NULL) != PAGE_NULL) {
+    file_read_page(path.page_nums[0], page_buf);
+    if (page_header->num_of_keys == 0) {
+      adjust_root(path.page_nums[0]);
+      level = 1;
+      continue;
+    }
+
+    for (; level < path.height; level++) {
+      file_read_page(path.page_nums[level], page_buf);
+      if (page_header->num_of_keys < merge_threshold) {
+        break;
+      }
+    }
+    if (level >= path.height) {
+      break;
+    }
+    bool changed;
+    rebalance_node(&path, level, &changed);
+    level = changed ? 1 : level + 1;
+  }
+  free_page_buf(page_buf);
+}
 
-  header_page->root_page_num = PAGE_NULL;
-  file_write_page(HEADER_PAGE_POS, (page_t *)&header_buf);
+/* Deletes every record whose key is in [start, end] and returns how many
+ * were deleted. Subtrees inside the range are detached without touching
+ * their parents one key at a time and their pages are freed in one batch.
+ * Only the leaves on the two boundaries lose single records, then the leaf
+ * chain is relinked and the pages left too small on the two boundary paths
+ * are rebalanced.
+ */
+int64_t delete_range(int64_t start, int64_t end) {
+  if (start > end) {
+    return 0;
+  }
+
+  page_t *header_buf = alloc_page_buf();
+  file_read_page(HEADER_PAGE_POS, header_buf);
+  pagenum_t root = ((header_page_t *)header_buf)->root_page_num;
+  free_page_buf(header_buf);
+  if (root == PAGE_NULL) {
+    return 0;
+  }
+
+  // the leaves around the range keep keys outside of it
+  pagenum_t left = start > INT64_MIN ? find_leaf(start - 1) : PAGE_NULL;
+  pagenum_t right = end < INT64_MAX ? find_leaf(end + 1) : PAGE_NULL;
+
+  forget_rightmost_leaf();
+  bump_smo_epoch();
+  range_delete_t range = {start, end, 0, NULL, 0, 0};
+  if (start == INT64_MIN && end == INT64_MAX) {
+    detach_subtree(&range, root);
+    link_header_page(PAGE_NULL);
+  } else {
+    delete_range_in_node(&range, root, INT64_MIN, INT64_MAX);
+  }
+
+  if (left != PAGE_NULL && left != right) {
+    page_t *leaf_buf = alloc_page_buf();
+    file_read_page(left, leaf_buf);
+    leaf_page_t *leaf_page = (leaf_page_t *)leaf_buf;
+    if (leaf_page->right_sibling_page_num != right) {
+      leaf_page->right_sibling_page_num = right;
+      file_write_page(left, leaf_buf);
+    }
+    free_page_buf(leaf_buf);
+  }
+
+
+  file_free_pages(range.detached, range.num_detached);
+  free(range.detached);
+
+  if (range.removed > 0) {
+    rebalance_path(start);
+    rebalance_path(end);
+  }
+  return range.removed;
+}
+
+/* Drops the whole tree. Every page but the header belongs to the tree, so
+ * the file is cut back to the header page in one step, and every record of
+ * the value log is dead.
+ */
+void destroy_tree(void) {
+  forget_rightmost_leaf();
+  reset_defragmentation();
+  forget_deferred_merges();
+  bump_smo_epoch();
+  file_truncate();
+  if (vlog_is_open()) {
+    vlog_truncate();
+  }
 }
@@ -1,5 +1,6 @@
 #include "bpt.h"
 #include "bpt_internal.h"
+#include "stats.h"
 
 extern queue *q_head;
 
@@ -7,30 +8,32 @@ extern queue *q_head;
  * of the tree
  */
 void print_leaves(void) {
-  page_t header_buf, current_buf;
+  page_t *current_buf = alloc_page_buf();
 
-  file_read_page(HEADER_PAGE_POS, &header_buf);
-  header_page_t *header = (header_page_t *)&header_buf;
+  file_read_page(HEADER_PAGE_POS, current_buf);
+  header_page_t *header = (header_page_t *)current_buf;
   pagenum_t current_page_num = header->root_page_num;
 
   if (current_page_num == PAGE_NULL) {
     printf("empty tree.\n");
+    free_page_buf(current_buf);
     return;
   }
 
   // find left most leaf page
   while (1) {
-    file_read_page(current_page_num, &current_buf);
-    page_header_t *header = (page_header_t *)&current_buf;
+    file_read_page(current_page_num, current_buf);
+    page_header_t *header = (page_header_t *)current_buf;
 
     if (header->is_leaf == LEAF) {
       break;
     } else {
-      internal_page_t *internal_page = (internal_page_t *)&current_buf;
+      internal_page_t *internal_page = (internal_page_t *)current_buf;
       current_page_num = internal_page->one_more_page_num;
 
       if (current_page_num == PAGE_NULL) {
         printf("error: Internal node with no children.\n");
+        free_page_buf(current_buf);
         return;
       }
     }
@@ -41,12 +44,14 @@ void print_leaves(void) {
     if (current_page_num == PAGE_NULL) {
       break;
     }
-    file_read_page(current_page_num, &current_buf);
-    leaf_page_t *leaf_page = (leaf_page_t *)&current_buf;
-    page_header_t *header = (page_header_t *)&current_buf;
+    file_read_page(current_page_num, current_buf);
+    leaf_page_t *leaf_page = (leaf_page_t *)current_buf;
+    page_header_t *header = (page_header_t *)current_buf;
 
     for (int i = 0; i < header->num_of_keys; i++) {
-      printf("%" PRId64 " ", leaf_page->records[i].key);
+      if (!leaf_is_tombstone(leaf_page, i)) {
+        printf("%" PRId64 " ", leaf_key(leaf_page, i));
+      }
     }
 
     current_page_num = leaf_page->right_sibling_page_num;
@@ -58,6 +63,7 @@ void print_leaves(void) {
   } while (current_page_num != PAGE_NULL);
 
   printf("\n");
+  free_page_buf(current_buf);
 }
 
 /* Utility function to give the height
@@ -66,32 +72,29 @@ void print_leaves(void) {
  */
 int height(pagenum_t header_page_num) {
   int h = 0;
-  page_t header_buf, current_buf;
+  page_t *current_buf = alloc_page_buf();
 
-  file_read_page(header_page_num, &header_buf);
-  header_page_t *header = (header_page_t *)&header_buf;
+  file_read_page(header_page_num, current_buf);
+  header_page_t *header = (header_page_t *)current_buf;
   pagenum_t current_page_num = header->root_page_num;
 
-  if (current_page_num == PAGE_NULL) {
-    return 0;
-  }
-
-  while (1) {
-    file_read_page(current_page_num, &current_buf);
-    page_header_t *header = (page_header_t *)&current_buf;
+  while (current_page_num != PAGE_NULL) {
+    file_read_page(current_page_num, current_buf);
+    page_header_t *header = (page_header_t *)current_buf;
 
     if (header->is_leaf == LEAF) {
       break;
     } else {
-      internal_page_t *internal_page = (internal_page_t *)&current_buf;
+      internal_page_t *internal_page = (internal_page_t *)current_buf;
       current_page_num = internal_page->one_more_page_num;
       h++;
 
       if (current_page_num == PAGE_NULL) {
-        return -1;
+        h = -1;
       }
     }
   }
+  free_page_buf(current_buf);
   return h;
 }
 
@@ -103,13 +106,14 @@ void print_tree() {
   int i = 0;
   int current_level = 0;
 
-  page_t header_buf;
-  file_read_page(HEADER_PAGE_POS, &header_buf);
-  header_page_t *header = (header_page_t *)&header_buf;
+  page_t *now_buf = alloc_page_buf();
+  file_read_page(HEADER_PAGE_POS, now_buf);
+  header_page_t *header = (header_page_t *)now_buf;
   pagenum_t root = header->root_page_num;
 
   if (root == PAGE_NULL) {
     printf("empty tree.\n");
+    free_page_buf(now_buf);
     return;
   }
 
@@ -121,9 +125,8 @@ void print_tree() {
     now_node_ptr = dequeue();
     pagenum_t now_page_num = now_node_ptr->page_num;
 
-    page_t now_buf;
-    file_read_page(now_page_num, &now_buf);
-    page_header_t *now_header = (page_header_t *)&now_buf;
+    file_read_page(now_page_num, now_buf);
+    page_header_t *now_header = (page_header_t *)now_buf;
 
     if (now_node_ptr->level != current_level) {
       current_level = now_node_ptr->level;
@@ -132,14 +135,16 @@ void print_tree() {
 
     printf("[");
     if (now_header->is_leaf == LEAF) {
-      leaf_page_t *leaf_page = (leaf_page_t *)&now_buf;
+      leaf_page_t *leaf_page = (leaf_page_t *)now_buf;
 
       // Leaf Node: 키 출력
       for (i = 0; i < leaf_page->num_of_keys; i++) {
-        printf("%" PRId64 " ", leaf_page->records[i].key);
+        if (!leaf_is_tombstone(leaf_page, i)) {
+          printf("%" PRId64 " ", leaf_key(leaf_page, i));
+        }
       }
     } else {
-      internal_page_t *internal_page = (internal_page_t *)&now_buf;
+      internal_page_t *internal_page = (internal_page_t *)now_buf;
       int next_level = now_node_ptr->level + 1;
 
       // one_more_page_num 삽입
@@ -149,10 +154,11 @@ void print_tree() {
 
       // entry 삽입
       for (i = 0; i < internal_page->num_of_keys; i++) {
-        printf("%" PRId64 " ", internal_page->entries[i].key);
+        printf("%" PRId64 " ", internal_key(internal_page, i));
 
-        if (internal_page->entries[i].page_num != PAGE_NULL) {
-          enqueue(internal_page->entries[i].page_num, next_level);
+        pagenum_t child_num = internal_child(internal_page, i);
+        if (child_num != PAGE_NULL) {
+          enqueue(child_num, next_level);
         }
       }
     }
@@ -161,6 +167,7 @@ void print_tree() {
     free(now_node_ptr);
   }
   printf("\n");
+  free_page_buf(now_buf);
 }
 
 /* Finds the record under a given key and prints an
@@ -201,20 +208,22 @@ int find_and_print_range(int64_t key_start, int64_t key_end) {
     printf("found %d records in range [%" PRId64 ", %" PRId64 "]:\n", num_found,
            key_start, key_end);
 
+    page_t *temp_buf = alloc_page_buf();
     for (i = 0; i < num_found; i++) {
-      page_t temp_buf;
-      file_read_page(returned_pages[i], &temp_buf);
-      leaf_page_t *temp_leaf = (leaf_page_t *)&temp_buf;
+      file_read_page(returned_pages[i], temp_buf);
+      leaf_page_t *temp_leaf = (leaf_page_t *)temp_buf;
 
       int64_t key = returned_keys[i];
       int index = returned_indices[i];
 
-      char *value_ptr = temp_leaf->records[index].value;
+      char value[VALUE_SIZE];
+      leaf_read_value(temp_leaf, index, value, VALUE_SIZE);
 
       printf("Key: %" PRId64 "  Location: page %" PRId64
              ", index %d  Value: %s\n",
-             key, returned_pages[i], index, value_ptr);
+             key, returned_pages[i], index, value);
     }
+    free_page_buf(temp_buf);
   }
   return SUCCESS;
 }
@@ -229,7 +238,6 @@ int find_range(int64_t key_start, int64_t key_end, int64_t returned_keys[],
 
   int i = 0;
   int num_found = 0;
-  page_t leaf_buf;
   leaf_page_t *leaf_page;
 
   pagenum_t current_leaf_num = find_leaf(key_start);
@@ -238,22 +246,23 @@ int find_range(int64_t key_start, int64_t key_end, int64_t returned_keys[],
     return 0;
   }
 
-  file_read_page(current_leaf_num, &leaf_buf);
-  leaf_page = (leaf_page_t *)&leaf_buf;
+  page_t *leaf_buf = alloc_page_buf();
+  file_read_page(current_leaf_num, leaf_buf);
+  leaf_page = (leaf_page_t *)leaf_buf;
 
-  for (i = 0; i < leaf_page->num_of_keys; i++) {
-    if (leaf_page->records[i].key >= key_start) {
-      break;
-    }
-  }
+  i = leaf_lower_bound(leaf_page, key_start);
 
   while (current_leaf_num != PAGE_NULL) {
     for (; i < leaf_page->num_of_keys; i++) {
-      int64_t current_key = leaf_page->records[i].key;
+      int64_t current_key = leaf_key(leaf_page, i);
 
       if (current_key > key_end) {
+        free_page_buf(leaf_buf);
         return num_found;
       }
+      if (leaf_is_tombstone(leaf_page, i)) {
+        continue;
+      }
 
       returned_keys[num_found] = current_key;
       returned_pages[num_found] = current_leaf_num;
@@ -265,14 +274,87 @@ int find_range(int64_t key_start, int64_t key_end, int64_t returned_keys[],
     i = 0;
 
     if (current_leaf_num != PAGE_NULL) {
-      file_read_page(current_leaf_num, &leaf_buf);
-      leaf_page = (leaf_page_t *)&leaf_buf;
+      file_read_page(current_leaf_num, leaf_buf);
+      leaf_page = (leaf_page_t *)leaf_buf;
     }
   }
 
+  free_page_buf(leaf_buf);
   return num_found;
+
+}
+
+/* The finger remembers the last leaf a lookup reached together with its fence
+ * keys, the inclusive range of keys the parents route to it. Any split, merge,
+ * redistribution or root change bumps smo_epoch, so a finger taken before it
+ * is stale and checking it costs no page read.
+ */
+static uint64_t smo_epoch = 1;
+static struct {
+  pagenum_t leaf_num;
+  int64_t low;  // smallest key routed to the leaf
+  int64_t high; // largest key routed to the leaf
+  uint64_t epoch;
+} finger;
+
+/**
+ * @brief invalidate the finger (and any other hint keyed on the tree shape)
+ * after a structure modification
+ */
+void bump_smo_epoch(void) { smo_epoch++; }
+
+static void set_finger(pagenum_t leaf_num, int64_t low, int64_t high) {
+  finger.leaf_num = leaf_num;
+  finger.low = low;
+  finger.high = high;
+  finger.epoch = smo_epoch;
+}
+
+/**
+ * @brief find the leaf of key without descending when it is the finger's leaf
+ * or its right sibling, reading the leaf into leaf_buf (if not NULL)
+ * @return PAGE_NULL when the key is outside both, the caller descends then
+ */
+static pagenum_t find_leaf_by_finger(int64_t key, page_t *leaf_buf) {
+  if (finger.epoch != smo_epoch || finger.leaf_num == PAGE_NULL ||
+      key < finger.low) {
+    return PAGE_NULL;
+  }
+  if (key <= finger.high) {
+    if (leaf_buf != NULL) {
+      file_read_page(finger.leaf_num, leaf_buf);
+    }
+    return finger.leaf_num;
+  }
+
+  // right sibling: it holds the keys from high + 1 up to its upper fence,
+  // which is not known here, so only keys up to its last key are taken
+  page_t *page_buf = leaf_buf != NULL ? leaf_buf : alloc_page_buf();
+  file_read_page(finger.leaf_num, page_buf);
+  pagenum_t sibling_num = ((leaf_page_t *)page_buf)->right_sibling_page_num;
+  if (sibling_num != PAGE_NULL) {
+    file_read_page(sibling_num, page_buf);
+    leaf_page_t *sibling = (leaf_page_t *)page_buf;
+    int64_t high = INT64_MIN; // no key is taken from an empty sibling
+    if (sibling->is_leaf == LEAF && sibling->num_of_keys > 0) {
+      high = sibling->right_sibling_page_num == PAGE_NULL
+                 ? INT64_MAX
+                 : leaf_key(sibling, sibling->num_of_keys - 1);
+    }
+    if (key <= high) {
+      set_finger(sibling_num, finger.high + 1, high);
+    } else {
+      sibling_num = PAGE_NULL;
+    }
+  }
+
+  if (page_buf != leaf_buf) {
+    free_page_buf(page_buf);
+  }
+  return sibling_num;
 }
 
+
 /* Traces the path from the root to a leaf, searching
  * by key.  Displays information about the path
  * if the verbose flag is set.
@@ -280,40 +362,88 @@ int find_range(int64_t key_start, int64_t key_end, int64_t returned_keys[],
  * This function finds the location where the key
  * should be, regardless of whether the key exists.
  */
-pagenum_t find_leaf(int64_t key) {
-  page_t header_buf;
-  file_read_page(HEADER_PAGE_POS, &header_buf);
-  header_page_t *header_page = (header_page_t *)&header_buf;
+pagenum_t find_leaf(int64_t key) { return find_leaf_path(key, NULL, NULL); }
+
+/**
+ * @brief find_leaf that also records the pages from the root to the leaf in
+ * path (if not NULL), for the splits and merges the change may cause, and
+ * leaves the leaf in leaf_buf (if not NULL) so callers need not read it again
+ */
+pagenum_t find_leaf_path(int64_t key, tree_path_t *path, page_t *leaf_buf) {
+  stat_phase_t phase = stats_enter(STAT_PHASE_TRAVERSAL);
+  pagenum_t leaf_num = PAGE_NULL;
+  // callers that need the path change the tree, they always descend
+  if (path == NULL) {
+    leaf_num = find_leaf_by_finger(key, leaf_buf);
+  }
+  if (leaf_num == PAGE_NULL) {
+    leaf_num = find_leaf_bounds(key, path, leaf_buf, NULL, NULL);
+  }
+  stats_enter(phase);
+  return leaf_num;
+}
+
+/**
+ * @brief find_leaf_path descending from the root whatever the finger holds,
+ * that also gives the fence keys of the leaf: the smallest and the largest
+ * key routed to it, in low and high (if not NULL)
+ */
+pagenum_t find_leaf_bounds(int64_t key, tree_path_t *path, page_t *leaf_buf,
+                           int64_t *low_out, int64_t *high_out) {
+  // the header is read into the buffer the descent then reuses
+  page_t *page_buf = leaf_buf != NULL ? leaf_buf : alloc_page_buf();
+  file_read_page(HEADER_PAGE_POS, page_buf);
+  header_page_t *header_page = (header_page_t *)page_buf;
 
   pagenum_t cur_num = header_page->root_page_num;
-  page_t page_buf;
+  int64_t low = INT64_MIN, high = INT64_MAX;
+  if (path != NULL) {
+    path->height = 0;
+  }
 
   // leaf를 찾을때까지 계속해서 읽어나감
-  while (true) {
-    file_read_page(cur_num, &page_buf);
-    page_header_t *page_header = (page_header_t *)&page_buf;
+  while (cur_num != PAGE_NULL) {
+    if (path != NULL) {
+      if (path->height == MAX_TREE_HEIGHT) {
+        fprintf(stderr, "tree deeper than %d pages\n", MAX_TREE_HEIGHT);
+        exit(EXIT_FAILURE);
+      }
+      path->page_nums[path->height++] = cur_num;
+    }
+    file_read_page(cur_num, page_buf);
+    page_header_t *page_header = (page_header_t *)page_buf;
     uint32_t is_leaf = page_header->is_leaf;
 
     if (is_leaf == LEAF) {
-      return cur_num;
+      set_finger(cur_num, low, high);
+      if (low_out != NULL) {
+        *low_out = low;
+      }
+      if (high_out != NULL) {
+        *high_out = high;
+      }
+      break;
     }
 
-    int index = 0;
-    internal_page_t *internal_page = (internal_page_t *)&page_buf;
-    while (index < internal_page->num_of_keys &&
-           key >= internal_page->entries[index].key) {
-      index++;
-    }
+    internal_page_t *internal_page = (internal_page_t *)page_buf;
+    int index = search_internal_key(internal_page, key);
 
+    // the separators around the child are its fence keys
+    if (index > 0) {
+      low = internal_key(internal_page, index - 1);
+    }
+    if (index < internal_page->num_of_keys) {
+      high = internal_key(internal_page, index) - 1;
+    }
     if (index == 0) {
       cur_num = internal_page->one_more_page_num;
     } else {
-      cur_num = internal_page->entries[index - 1].page_num;
-    }
-    if (cur_num == PAGE_NULL) {
-      // 이거는 실행 안되어야 함
-      // perror("find_leaf");
-      return PAGE_NULL;
+      cur_num = internal_child(internal_page, index - 1);
     }
+    // PAGE_NULL here ends the loop, 이거는 실행 안되어야 함
+  }
+  if (page_buf != leaf_buf) {
+    free_page_buf(page_buf);
   }
+  return cur_num;
 }
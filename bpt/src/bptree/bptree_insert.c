@@ -1,8 +1,57 @@
 #include "bpt.h"
 #include "bpt_internal.h"
+#include "stats.h"
 
 // INSERTION
 
+int append_fill_factor = DEFAULT_APPEND_FILL_FACTOR;
+
+/* The last leaf as an insertion left it, so that appending keys above every
+ * key of the tree touches only that leaf. PAGE_NULL when unknown; anything
+ * that may free or replace the last leaf forgets it.
+ */
+static struct {
+  pagenum_t leaf_num;
+  int64_t max_key;
+} rightmost_leaf = {PAGE_NULL, 0};
+
+void remember_rightmost_leaf(pagenum_t leaf_num, int64_t max_key) {
+  rightmost_leaf.leaf_num = leaf_num;
+  rightmost_leaf.max_key = max_key;
+}
+
+void forget_rightmost_leaf(void) { rightmost_leaf.leaf_num = PAGE_NULL; }
+
+/**
+ * @brief insert key straight into the remembered last leaf if it is above
+ * every key there and the leaf has room. Returns false, with nothing
+ * changed, when the insertion has to descend from the root instead
+ */
+bool append_to_rightmost_leaf(int64_t key, char *value) {
+  if (rightmost_leaf.leaf_num == PAGE_NULL || key <= rightmost_leaf.max_key) {
+    return false;
+  }
+
+  page_t *leaf_buf = alloc_page_buf();
+  file_read_page(rightmost_leaf.leaf_num, leaf_buf);
+  leaf_page_t *leaf_page = (leaf_page_t *)leaf_buf;
+
+  // the page is checked again, a split needs the path anyway
+  if (leaf_page->is_leaf != LEAF ||
+      leaf_page->right_sibling_page_num != PAGE_NULL ||
+      leaf_page->num_of_keys == 0 ||
+      leaf_key(leaf_page, leaf_page->num_of_keys - 1) >= key ||
+      !leaf_has_room(leaf_page, value)) {
+    free_page_buf(leaf_buf);
+    return false;
+  }
+
+  insert_into_leaf(rightmost_leaf.leaf_num, leaf_buf, key, value);
+  free_page_buf(leaf_buf);
+  rightmost_leaf.max_key = key;
+  return true;
+}
+
 void copy_value(char *dest, const char *src, size_t size) {
   strncpy(dest, src, size - 1);
   dest[size - 1] = '\0';
@@ -13,6 +62,7 @@ void init_leaf_page(page_t *page) {
   leaf_page->parent_page_num = PAGE_NULL;
   leaf_page->is_leaf = LEAF;
   leaf_page->num_of_keys = 0;
+  leaf_page->format = LEAF_FORMAT_SLOTTED;
   leaf_page->right_sibling_page_num = PAGE_NULL;
 }
 
@@ -21,34 +71,40 @@ void init_internal_page(page_t *page) {
   internal_page->parent_page_num = PAGE_NULL;
   internal_page->is_leaf = INTERNAL;
   internal_page->num_of_keys = 0;
+  internal_page->format = INTERNAL_FORMAT_DELTA;
+  internal_page->key_width = sizeof(uint16_t);
+  internal_page->page_num_width = 1;
   internal_page->one_more_page_num = PAGE_NULL;
 }
 
 /* Creates a new general node, which can be adapted
  * to serve as either a leaf or an internal node.
+ * The page is placed close to hint, the node being split, if it is not
+ * PAGE_NULL.
  */
-pagenum_t make_node(uint32_t isleaf) {
+pagenum_t make_node(uint32_t isleaf, pagenum_t hint) {
   pagenum_t new_page_num;
-  new_page_num = file_alloc_page();
+  new_page_num = file_alloc_page(hint);
   if (new_page_num == PAGE_NULL) {
     perror("Node creation.");
     exit(EXIT_FAILURE);
   }
-  page_t page;
-  memset(&page, 0, PAGE_SIZE);
+  page_t *page = alloc_page_buf();
+  memset(page, 0, page_size);
   switch (isleaf) {
   case LEAF:
-    init_leaf_page(&page);
+    init_leaf_page(page);
     break;
   case INTERNAL:
-    init_internal_page(&page);
+    init_internal_page(page);
     break;
   default:
     perror("make_node");
     exit(EXIT_FAILURE);
     break;
   }
-  file_write_page(new_page_num, &page);
+  file_write_page(new_page_num, page);
+  free_page_buf(page);
 
   return new_page_num;
 }
@@ -56,30 +112,25 @@ pagenum_t make_node(uint32_t isleaf) {
 /* Creates a new leaf by creating a node
  * and then adapting it appropriately.
  */
-pagenum_t make_leaf(void) { return make_node(LEAF); }
+pagenum_t make_leaf(pagenum_t hint) { return make_node(LEAF, hint); }
 
-/* Finds the index within the parent's 'entries' array
+/* Finds the index within the parent's entries
  * where the new key should be inserted, based on the position
  * of the left child node (left_num).
  */
 int get_index_after_left_child(page_t *parent_buffer, pagenum_t left_num) {
   internal_page_t *parent = (internal_page_t *)parent_buffer;
-  // left_num이 leftmost인 경우 entries[0]
-  if (parent->one_more_page_num == left_num) {
-    return 0;
-  }
 
-  // left_num이 entries[index].page_num인 경우 entries[index+1]
-  int index = 0;
-  for (index = 0; index < parent->num_of_keys; index++) {
-    if (parent->entries[index].page_num == left_num) {
-      return index + 1;
-    }
+  // left_num이 leftmost(-1)인 경우 entries[0],
+  // entries[index].page_num인 경우 entries[index+1]
+  int index = search_internal_child(parent, left_num);
+  if (index >= -1) {
+    return index + 1;
   }
 
   // 못찾으면 에러
   perror("get_left_index");
-  return index;
+  return parent->num_of_keys;
 }
 
 /* Inserts a new pointer to a record and its corresponding
@@ -87,21 +138,11 @@ int get_index_after_left_child(page_t *parent_buffer, pagenum_t left_num) {
  */
 int insert_into_leaf(pagenum_t leaf_num, page_t *leaf_buffer, int64_t key,
                      char *value) {
-  int index, insertion_point;
+  int insertion_point;
   leaf_page_t *leaf = (leaf_page_t *)leaf_buffer;
 
-  insertion_point = 0;
-  while (insertion_point < leaf->num_of_keys &&
-         leaf->records[insertion_point].key < key) {
-    insertion_point++;
-  }
-  for (index = leaf->num_of_keys; index > insertion_point; index--) {
-    leaf->records[index] = leaf->records[index - 1];
-  }
-
-  leaf->records[insertion_point].key = key;
-  copy_value(leaf->records[insertion_point].value, value, VALUE_SIZE);
-  leaf->num_of_keys++;
+  insertion_point = leaf_lower_bound(leaf, key);
+  leaf_insert_record(leaf, insertion_point, key, value);
 
   file_write_page(leaf_num, (page_t *)leaf);
   return SUCCESS;
@@ -112,34 +153,62 @@ int insert_into_leaf(pagenum_t leaf_num, page_t *leaf_buffer, int64_t key,
  * Create a temporary array by combining the existing record and the new record
  * and return it
  */
-record_t *prepare_records_for_split(leaf_page_t *leaf_page, int64_t key,
-                                    const char *value) {
+leaf_slot_t *prepare_records_for_split(leaf_page_t *leaf_page, int64_t key,
+                                       const char *value) {
 
-  record_t *temp_records = (record_t *)malloc(RECORD_CNT * sizeof(record_t));
-  if (temp_records == NULL) {
-    perror("Memory allocation for temporary records failed.");
-    exit(EXIT_FAILURE);
-  }
+  leaf_slot_t *temp_records = leaf_alloc_slots(LEAF_ORDER);
+  int insertion_index = leaf_lower_bound(leaf_page, key);
+
+  // read in one pass, then open the gap for the new record
+  int n = leaf_page->num_of_keys;
+  leaf_read_slots(leaf_page, temp_records);
+  memmove(&temp_records[insertion_index + 1], &temp_records[insertion_index],
+          (n - insertion_index) * sizeof(leaf_slot_t));
+
+  // insert new record
+  leaf_make_slot(key, value, &temp_records[insertion_index]);
 
-  int insertion_index = 0;
-  while (insertion_index < RECORD_CNT &&
-         leaf_page->records[insertion_index].key < key) {
-    insertion_index++;
+  return temp_records;
+}
+
+/**
+ * helper function for insert_into_leaf_after_splitting
+ * Returns how many of the temporary records stay in the old leaf. Values have
+ * different sizes, so the records are split by bytes: the old leaf takes the
+ * longest prefix holding at most fill_factor percent of them, then both sides
+ * are checked against the record count
+ */
+int leaf_split_point(const leaf_slot_t *temp_records, int num_records,
+                     int fill_factor) {
+  size_t total = 0;
+  for (int i = 0; i < num_records; i++) {
+    total += LEAF_SLOT_SIZE + temp_records[i].size;
   }
 
-  int i, j;
-  for (i = 0, j = 0; i < leaf_page->num_of_keys; i++, j++) {
-    if (j == insertion_index) {
-      j++;
+  int split = 0;
+  size_t left = 0;
+  while (split < num_records) {
+    size_t size = LEAF_SLOT_SIZE + temp_records[split].size;
+    if ((left + size) * 100 > total * fill_factor) {
+      break;
     }
-    temp_records[j] = leaf_page->records[i];
+    left += size;
+    split++;
   }
 
-  // insert new record
-  temp_records[insertion_index].key = key;
-  copy_value(temp_records[insertion_index].value, value, VALUE_SIZE);
-
-  return temp_records;
+  if (split < 1) {
+    split = 1;
+  }
+  if (split > num_records - 1) {
+    split = num_records - 1;
+  }
+  while (num_records - split > RECORD_CNT) {
+    split++;
+  }
+  while (split > RECORD_CNT) {
+    split--;
+  }
+  return split;
 }
 
 /**
@@ -149,72 +218,82 @@ record_t *prepare_records_for_split(leaf_page_t *leaf_page, int64_t key,
  */
 int64_t distribute_records_to_leaves(leaf_page_t *leaf_page,
                                      leaf_page_t *new_leaf_page,
-                                     record_t *temp_records,
-                                     pagenum_t new_leaf_num) {
-
-  const int split = cut(RECORD_CNT);
+                                     leaf_slot_t *temp_records,
+                                     int num_records, pagenum_t new_leaf_num,
+                                     int fill_factor) {
 
-  int i, j;
+  const int split = leaf_split_point(temp_records, num_records, fill_factor);
 
   // Allocate to old_leaf_page until split point
-  leaf_page->num_of_keys = 0;
-  for (i = 0; i < split; i++) {
-    leaf_page->records[i] = temp_records[i];
-    leaf_page->num_of_keys++;
-  }
-  for (int k = split; k < RECORD_CNT; k++) {
-    memset(&(leaf_page->records[k]), 0, sizeof(record_t));
-  }
+  leaf_clear_records(leaf_page);
+  leaf_append_slots(leaf_page, temp_records, split);
 
   // Records after the split point are allocated to new_leaf_page
-  new_leaf_page->num_of_keys = 0;
-  for (j = 0; i < LEAF_ORDER; i++, j++) {
-    new_leaf_page->records[j] = temp_records[i];
-    new_leaf_page->num_of_keys++;
-  }
-  for (int k = new_leaf_page->num_of_keys; k < RECORD_CNT; k++) {
-    memset(&(new_leaf_page->records[k]), 0, sizeof(record_t));
-  }
+  leaf_clear_records(new_leaf_page);
+  leaf_append_slots(new_leaf_page, temp_records + split, num_records - split);
 
-  // Connect sibling nodes and set parent nodes
+  // Connect sibling nodes
   new_leaf_page->right_sibling_page_num = leaf_page->right_sibling_page_num;
   leaf_page->right_sibling_page_num = new_leaf_num;
-  new_leaf_page->parent_page_num = leaf_page->parent_page_num;
 
-  return new_leaf_page->records[0].key;
+  return leaf_key(new_leaf_page, 0);
 }
 
 /**
- * Splits a node into two by inserting a new key and record into the leaf and
- * passing the split information to the parent
+ * Splits the leaf at the end of path into two by inserting a new key and
+ * record into it and passing the split information to the parent.
+ * A key appended past the end of the last leaf is the pattern of sequence
+ * and timestamp keys: the old leaf is then left append_fill_factor full
+ * instead of half full, since no key will come back to it
  */
-int insert_into_leaf_after_splitting(pagenum_t leaf_num, int64_t key,
+int insert_into_leaf_after_splitting(const tree_path_t *path, int64_t key,
                                      char *value) {
+  const int level = path->height - 1;
+  pagenum_t leaf_num = path->page_nums[level];
   pagenum_t new_leaf_num;
   int64_t new_key;
-  record_t *temp_records;
+  leaf_slot_t *temp_records;
 
-  new_leaf_num = make_leaf();
+  stat_phase_t phase = stats_enter(STAT_PHASE_PROPAGATION);
+  new_leaf_num = make_leaf(leaf_num);
+  stats_add(STAT_SPLITS, 1);
 
-  page_t tmp_old_page;
-  file_read_page(leaf_num, &tmp_old_page);
-  leaf_page_t *leaf_page = (leaf_page_t *)&tmp_old_page;
+  page_t *tmp_old_page = alloc_page_buf();
+  file_read_page(leaf_num, tmp_old_page);
+  leaf_page_t *leaf_page = (leaf_page_t *)tmp_old_page;
+  bool append = leaf_page->right_sibling_page_num == PAGE_NULL &&
+                leaf_lower_bound(leaf_page, key) == leaf_page->num_of_keys;
 
   temp_records = prepare_records_for_split(leaf_page, key, value);
+  int num_records = leaf_page->num_of_keys + 1;
 
-  page_t tmp_new_page;
-  file_read_page(new_leaf_num, &tmp_new_page);
-  leaf_page_t *new_leaf_page = (leaf_page_t *)&tmp_new_page;
+  page_t *tmp_new_page = alloc_page_buf();
+  file_read_page(new_leaf_num, tmp_new_page);
+  leaf_page_t *new_leaf_page = (leaf_page_t *)tmp_new_page;
 
-  new_key = distribute_records_to_leaves(leaf_page, new_leaf_page, temp_records,
-                                         new_leaf_num);
+  new_key = distribute_records_to_leaves(
+      leaf_page, new_leaf_page, temp_records, num_records, new_leaf_num,
+      append ? append_fill_factor : SPLIT_FILL_FACTOR);
 
   free(temp_records);
 
   file_write_page(leaf_num, (page_t *)leaf_page);
   file_write_page(new_leaf_num, (page_t *)new_leaf_page);
+  free_page_buf(tmp_old_page);
+  free_page_buf(tmp_new_page);
+
+  // after an append the new leaf is the last one
+  if (append) {
+    remember_rightmost_leaf(new_leaf_num, key);
+  } else {
+    forget_rightmost_leaf();
+  }
+  bump_smo_epoch();
 
-  return insert_into_parent(leaf_num, new_key, new_leaf_num);
+  int result =
+      insert_into_parent(path, level, leaf_num, new_key, new_leaf_num, append);
+  stats_enter(phase);
+  return result;
 }
 
 /* Inserts a new key and pointer to a node
@@ -223,20 +302,14 @@ int insert_into_leaf_after_splitting(pagenum_t leaf_num, int64_t key,
  */
 int insert_into_node(pagenum_t page_num, int64_t left_index, int64_t key,
                      pagenum_t right) {
-  int index;
-
-  page_t tmp_page;
-  file_read_page(page_num, &tmp_page);
-  internal_page_t *page = (internal_page_t *)&tmp_page;
+  page_t *tmp_page = alloc_page_buf();
+  file_read_page(page_num, tmp_page);
+  internal_page_t *page = (internal_page_t *)tmp_page;
 
-  for (index = page->num_of_keys; index > left_index; index--) {
-    page->entries[index] = page->entries[index - 1];
-  }
-  page->entries[left_index].page_num = right;
-  page->entries[left_index].key = key;
-  page->num_of_keys++;
+  internal_insert_entry(page, left_index, key, right);
 
   file_write_page(page_num, (page_t *)page);
+  free_page_buf(tmp_page);
   return SUCCESS;
 }
 
@@ -249,16 +322,14 @@ entry_t *prepare_entries_for_split(internal_page_t *old_node_page,
                                    int64_t left_index, int64_t key,
                                    pagenum_t right) {
 
-  entry_t *temp_entries = (entry_t *)malloc((ENTRY_CNT) * sizeof(entry_t));
+  entry_t *temp_entries = (entry_t *)malloc((INTERNAL_ORDER) * sizeof(entry_t));
   if (temp_entries == NULL) {
     perror("Temporary entries array.");
     exit(EXIT_FAILURE);
   }
 
   int i;
-  for (i = 0; i < old_node_page->num_of_keys; i++) {
-    temp_entries[i] = old_node_page->entries[i];
-  }
+  internal_read_entries(old_node_page, temp_entries);
 
   // insert new entry
   for (i = old_node_page->num_of_keys; i > left_index; i--) {
@@ -272,114 +343,118 @@ entry_t *prepare_entries_for_split(internal_page_t *old_node_page,
 
 /**
  * helper function for insert_into_node_after_splitting
- * Distribute temp_entries to old_node and new_node, and return k_prime
+ * Returns the index of the entry that moves up to the parent: the old node
+ * keeps the entries before it and the new node the ones after it. The old
+ * node keeps about fill_factor percent of the entries, but the new one at
+ * least MIN_KEYS. The split is moved until both sides can be encoded;
+ * splitting right at the new entry always works, since each side is then a
+ * part of the old page
  */
-int64_t distribute_entries_and_update_children(pagenum_t old_node_num,
-                                               internal_page_t *old_node_page,
-                                               pagenum_t new_node_num,
-                                               internal_page_t *new_node_page,
-                                               entry_t *temp_entries) {
+int internal_split_point(const entry_t *temp_entries, int num_entries,
+                         int fill_factor) {
+  int split = fill_factor == SPLIT_FILL_FACTOR
+                  ? cut(num_entries) - 1
+                  : num_entries * fill_factor / 100;
+  if (split > num_entries - 1 - MIN_KEYS) {
+    split = num_entries - 1 - MIN_KEYS;
+  }
+  if (split < 0) {
+    split = 0;
+  }
 
-  const int split = cut(INTERNAL_ORDER);
-  int i, j;
+  while (split > 0 && !internal_entries_fit(temp_entries, split)) {
+    split--;
+  }
+  while (split < num_entries - 1 &&
+         !internal_entries_fit(temp_entries + split + 1,
+                               num_entries - split - 1)) {
+    split++;
+  }
+  return split;
+}
+
+/**
+ * helper function for insert_into_node_after_splitting
+ * Distribute temp_entries to old_node and new_node, and return k_prime.
+ * Children keep no parent pointer, so the moved ones are not touched
+ */
+int64_t distribute_entries_to_nodes(internal_page_t *old_node_page,
+                                    internal_page_t *new_node_page,
+                                    entry_t *temp_entries, int num_entries,
+                                    int fill_factor) {
+
+  const int split =
+      internal_split_point(temp_entries, num_entries, fill_factor);
 
   // key to send to parents
-  const int64_t k_prime = temp_entries[split - 1].key;
+  const int64_t k_prime = temp_entries[split].key;
 
   // Reassign entries to Old Node
-  old_node_page->num_of_keys = 0;
-  for (i = 0; i < split - 1; i++) {
-    old_node_page->entries[i] = temp_entries[i];
-    old_node_page->num_of_keys++;
-  }
-  for (int k = split - 1; k < ENTRY_CNT; k++) {
-    memset(&(old_node_page->entries[k]), 0, sizeof(entry_t));
-  }
+  internal_write_entries(old_node_page, temp_entries, split);
 
   // Set the P0 pointer of the new node (the right pointer of k_prime)
-  pagenum_t new_node_p0 = temp_entries[split - 1].page_num;
-  new_node_page->one_more_page_num = new_node_p0;
+  new_node_page->one_more_page_num = temp_entries[split].page_num;
 
   // Assigning entries to new nodes
-  new_node_page->num_of_keys = 0;
-  for (i = split, j = 0; i < INTERNAL_ORDER; i++, j++) {
-    new_node_page->entries[j] = temp_entries[i];
-    new_node_page->num_of_keys++;
-  }
-  for (int k = new_node_page->num_of_keys; k < ENTRY_CNT; k++) {
-    memset(&(new_node_page->entries[k]), 0, sizeof(entry_t));
-  }
-
-  new_node_page->parent_page_num = old_node_page->parent_page_num;
-
-  // Update the parent of a child node
-  pagenum_t child = new_node_page->one_more_page_num;
-  page_t tmp_child_page;
-  if (child != PAGE_NULL) {
-    file_read_page(child, &tmp_child_page);
-    page_header_t *child_page_header = (page_header_t *)&tmp_child_page;
-    child_page_header->parent_page_num = new_node_num;
-    file_write_page(child, (page_t *)child_page_header);
-  }
-  for (i = 0; i < new_node_page->num_of_keys; i++) {
-    child = new_node_page->entries[i].page_num;
-    if (child != PAGE_NULL) {
-      file_read_page(child, &tmp_child_page);
-      page_header_t *child_page_header = (page_header_t *)&tmp_child_page;
-      child_page_header->parent_page_num = new_node_num;
-      file_write_page(child, (page_t *)child_page_header);
-    }
-  }
+  internal_write_entries(new_node_page, temp_entries + split + 1,
+                         num_entries - split - 1);
 
   return k_prime;
 }
 
 /**
- * Splits a node into two by inserting a new key and pointer into the internal
- * node and passes the split information to the parent
+ * Splits the internal node at level of path into two by inserting a new key
+ * and pointer into it and passes the split information to the parent.
+ * append tells that right holds the last leaf after an append split, so this
+ * node is the last one of its level and is split the same way
  */
-int insert_into_node_after_splitting(pagenum_t old_node, int64_t left_index,
-                                     int64_t key, pagenum_t right) {
+int insert_into_node_after_splitting(const tree_path_t *path, int level,
+                                     int64_t left_index, int64_t key,
+                                     pagenum_t right, bool append) {
 
+  pagenum_t old_node = path->page_nums[level];
   pagenum_t new_node_num;
   int64_t k_prime;
   entry_t *temp_entries;
 
-  page_t tmp_old_page;
-  file_read_page(old_node, &tmp_old_page);
-  internal_page_t *old_node_page = (internal_page_t *)&tmp_old_page;
+  page_t *tmp_old_page = alloc_page_buf();
+  file_read_page(old_node, tmp_old_page);
+  internal_page_t *old_node_page = (internal_page_t *)tmp_old_page;
 
   temp_entries =
       prepare_entries_for_split(old_node_page, left_index, key, right);
+  int num_entries = old_node_page->num_of_keys + 1;
 
-  new_node_num = make_node(INTERNAL);
-  page_t tmp_new_page;
-  file_read_page(new_node_num, &tmp_new_page);
-  internal_page_t *new_node_page = (internal_page_t *)&tmp_new_page;
+  new_node_num = make_node(INTERNAL, old_node);
+  stats_add(STAT_SPLITS, 1);
+  page_t *tmp_new_page = alloc_page_buf();
+  file_read_page(new_node_num, tmp_new_page);
+  internal_page_t *new_node_page = (internal_page_t *)tmp_new_page;
 
-  k_prime = distribute_entries_and_update_children(
-      old_node, old_node_page, new_node_num, new_node_page, temp_entries);
+  k_prime = distribute_entries_to_nodes(
+      old_node_page, new_node_page, temp_entries, num_entries,
+      append ? append_fill_factor : SPLIT_FILL_FACTOR);
 
   free(temp_entries);
 
   file_write_page(old_node, (page_t *)old_node_page);
   file_write_page(new_node_num, (page_t *)new_node_page);
+  free_page_buf(tmp_old_page);
+  free_page_buf(tmp_new_page);
 
-  return insert_into_parent(old_node, k_prime, new_node_num);
+  return insert_into_parent(path, level, old_node, k_prime, new_node_num,
+                            append);
 }
 
 /* Inserts a new node (leaf or internal node) into the B+ tree.
+ * left is at level of path (or a sibling of that page), so its parent is the
+ * page above it on the path. append is passed on to a split of the parent.
  * Returns the root of the tree after insertion.
  */
-int insert_into_parent(pagenum_t left, int64_t key, pagenum_t right) {
+int insert_into_parent(const tree_path_t *path, int level, pagenum_t left,
+                       int64_t key, pagenum_t right, bool append) {
   int left_index;
-  pagenum_t parent;
-
-  page_t tmp_left_page;
-  file_read_page(left, &tmp_left_page);
-  page_header_t *left_page_header = (page_header_t *)&tmp_left_page;
-
-  parent = left_page_header->parent_page_num;
+  pagenum_t parent = level > 0 ? path->page_nums[level - 1] : PAGE_NULL;
 
   /* Case: new root. */
   if (parent == PAGE_NULL) {
@@ -389,25 +464,28 @@ int insert_into_parent(pagenum_t left, int64_t key, pagenum_t right) {
   /* Case: leaf or node. (Remainder of
    * function body.)
    */
-  page_t tmp_parent_page;
-  file_read_page(parent, &tmp_parent_page);
-  page_header_t *parent_page_header = (page_header_t *)&tmp_parent_page;
+  page_t *tmp_parent_page = alloc_page_buf();
+  file_read_page(parent, tmp_parent_page);
+  internal_page_t *parent_page = (internal_page_t *)tmp_parent_page;
 
   /* Find the parent's pointer to the left
    * node.
    */
-  left_index = get_index_after_left_child(&tmp_parent_page, left);
+  left_index = get_index_after_left_child(tmp_parent_page, left);
+  bool has_room = internal_has_room(parent_page, left_index, key, right);
+  free_page_buf(tmp_parent_page);
 
   /* Simple case: the new key fits into the node.
    */
-  if (parent_page_header->num_of_keys < INTERNAL_ORDER - 1) {
+  if (has_room) {
     return insert_into_node(parent, left_index, key, right);
   }
 
   /* Harder case:  split a node in order
    * to preserve the B+ tree properties.
    */
-  return insert_into_node_after_splitting(parent, left_index, key, right);
+  return insert_into_node_after_splitting(path, level - 1, left_index, key,
+                                          right, append);
 }
 
 /* Creates a new root for two subtrees
@@ -415,40 +493,27 @@ int insert_into_parent(pagenum_t left, int64_t key, pagenum_t right) {
  * the new root.
  */
 int insert_into_new_root(pagenum_t left, int64_t key, pagenum_t right) {
-  pagenum_t root = make_node(INTERNAL);
+  pagenum_t root = make_node(INTERNAL, left);
 
   // root 처리
-  page_t tmp_root_page;
-  file_read_page(root, &tmp_root_page);
-  internal_page_t *root_page = (internal_page_t *)&tmp_root_page;
+  page_t *tmp_root_page = alloc_page_buf();
+  file_read_page(root, tmp_root_page);
+  internal_page_t *root_page = (internal_page_t *)tmp_root_page;
 
   root_page->one_more_page_num = left;
-  root_page->entries[0].key = key;
-  root_page->entries[0].page_num = right;
-  root_page->num_of_keys = 1;
+  internal_insert_entry(root_page, 0, key, right);
   root_page->parent_page_num = PAGE_NULL;
 
   file_write_page(root, (page_t *)root_page);
-
-  // left right 처리
-  page_t tmp_left_page;
-  file_read_page(left, &tmp_left_page);
-  page_header_t *left_header = (page_header_t *)&tmp_left_page;
-  left_header->parent_page_num = root;
-  file_write_page(left, (page_t *)left_header);
-
-  page_t tmp_right_page;
-  file_read_page(right, &tmp_right_page);
-  page_header_t *right_header = (page_header_t *)&tmp_right_page;
-  right_header->parent_page_num = root;
-  file_write_page(right, (page_t *)right_header);
+  free_page_buf(tmp_root_page);
 
   // 헤더 페이지 갱신
-  page_t header_buf;
-  file_read_page(HEADER_PAGE_POS, &header_buf);
-  header_page_t *header_page = (header_page_t *)&header_buf;
+  page_t *header_buf = alloc_page_buf();
+  file_read_page(HEADER_PAGE_POS, header_buf);
+  header_page_t *header_page = (header_page_t *)header_buf;
   header_page->root_page_num = root;
   file_write_page(HEADER_PAGE_POS, (page_t *)header_page);
+  free_page_buf(header_buf);
 
   return SUCCESS;
 }
@@ -458,29 +523,32 @@ int insert_into_new_root(pagenum_t left, int64_t key, pagenum_t right) {
  */
 int start_new_tree(int64_t key, char *value) {
   // make root page
-  pagenum_t root = make_node(LEAF);
-  page_t tmp_root_page;
-  file_read_page(root, &tmp_root_page);
-  leaf_page_t *root_page = (leaf_page_t *)&tmp_root_page;
+  pagenum_t root = make_node(LEAF, PAGE_NULL);
+  page_t *tmp_root_page = alloc_page_buf();
+  file_read_page(root, tmp_root_page);
+  leaf_page_t *root_page = (leaf_page_t *)tmp_root_page;
 
   root_page->parent_page_num = PAGE_NULL;
   root_page->is_leaf = LEAF;
-  root_page->num_of_keys = 1;
   root_page->right_sibling_page_num = PAGE_NULL;
-  root_page->records[0].key = key;
-  copy_value(root_page->records[0].value, value, VALUE_SIZE);
+  leaf_insert_record(root_page, 0, key, value);
 
   link_header_page(root);
 
   file_write_page(root, (page_t *)root_page);
+  free_page_buf(tmp_root_page);
+  remember_rightmost_leaf(root, key);
+  bump_smo_epoch();
   return SUCCESS;
 }
 
 void link_header_page(pagenum_t root) {
-  page_t header_buf;
-  file_read_page(HEADER_PAGE_POS, &header_buf);
-  header_page_t *header_page = (header_page_t *)&header_buf;
+  page_t *header_buf = alloc_page_buf();
+  file_read_page(HEADER_PAGE_POS, header_buf);
+  header_page_t *header_page = (header_page_t *)header_buf;
   header_page->root_page_num = root;
 
   file_write_page(HEADER_PAGE_POS, (page_t *)header_page);
+  free_page_buf(header_buf);
 }
+
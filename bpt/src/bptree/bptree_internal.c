@@ -0,0 +1,307 @@
+#include "bpt.h"
+#include "bpt_internal.h"
+
+// INTERNAL ENTRIES
+
+/* Internal pages are written delta encoded (INTERNAL_FORMAT_DELTA): the page
+ * keeps its first key as base_key and every key as its distance from it in
+ * 2, 4 or 8 bytes, followed by the child page numbers in the fewest bytes
+ * that hold the largest of them. Both widths are chosen again whenever the
+ * page is rewritten, so whether an entry fits is decided by bytes, like for
+ * slotted leaves, and ENTRY_CNT only caps the count. Pages of the fixed-size
+ * layout (INTERNAL_FORMAT_ENTRIES) are read in place and converted the first
+ * time they are modified.
+ */
+
+static const legacy_internal_page_t *
+as_legacy_internal(const internal_page_t *page) {
+  return (const legacy_internal_page_t *)page;
+}
+
+static const uint8_t *page_num_bytes(const internal_page_t *page) {
+  return (const uint8_t *)(page->body + page->num_of_keys * page->key_width);
+}
+
+/**
+ * @brief Returns the bytes a key delta takes when the keys of a page span
+ * from first to last
+ */
+static int key_width_for(int64_t first, int64_t last) {
+  uint64_t spread = (uint64_t)last - (uint64_t)first;
+  if (spread <= UINT16_MAX) {
+    return sizeof(uint16_t);
+  }
+  if (spread <= UINT32_MAX) {
+    return sizeof(uint32_t);
+  }
+  return sizeof(uint64_t);
+}
+
+/**
+ * @brief Returns the fewest bytes that hold page_num
+ */
+static int page_num_width_for(pagenum_t page_num) {
+  int width = 1;
+  while (width < (int)sizeof(pagenum_t) && (page_num >> (8 * width)) != 0) {
+    width++;
+  }
+  return width;
+}
+
+/**
+ * @brief Returns the page number width the entries of page need now
+ */
+static int current_page_num_width(const internal_page_t *page) {
+  if (page->format == INTERNAL_FORMAT_DELTA) {
+    return page->num_of_keys > 0 ? page->page_num_width : 1;
+  }
+
+  pagenum_t largest = 0;
+  for (int i = 0; i < page->num_of_keys; i++) {
+    if (as_legacy_internal(page)->entries[i].page_num > largest) {
+      largest = as_legacy_internal(page)->entries[i].page_num;
+    }
+  }
+  return page_num_width_for(largest);
+}
+
+/**
+ * @brief Returns true if n entries with keys from first to last and page
+ * numbers of page_num_width bytes can be written to one page
+ */
+static bool entries_fit(int n, int64_t first, int64_t last,
+                        int page_num_width) {
+  if (n > ENTRY_CNT) {
+    return false;
+  }
+  if (n == 0) {
+    return true;
+  }
+  size_t entry_size = key_width_for(first, last) + page_num_width;
+  return n * entry_size <= INTERNAL_BODY_SIZE;
+}
+
+static entry_t *alloc_entries(int n) {
+  entry_t *entries = (entry_t *)malloc((n > 0 ? n : 1) * sizeof(entry_t));
+  if (entries == NULL) {
+    perror("Memory allocation for internal entries failed.");
+    exit(EXIT_FAILURE);
+  }
+  return entries;
+}
+
+int64_t internal_key(const internal_page_t *page, int index) {
+  if (page->format == INTERNAL_FORMAT_ENTRIES) {
+    return as_legacy_internal(page)->entries[index].key;
+  }
+
+  uint64_t delta;
+  switch (page->key_width) {
+  case sizeof(uint16_t):
+    delta = page->deltas16[index];
+    break;
+  case sizeof(uint32_t):
+    delta = page->deltas32[index];
+    break;
+  default:
+    delta = page->deltas64[index];
+    break;
+  }
+  return (int64_t)((uint64_t)page->base_key + delta);
+}
+
+pagenum_t internal_child(const internal_page_t *page, int index) {
+  if (page->format == INTERNAL_FORMAT_ENTRIES) {
+    return as_legacy_internal(page)->entries[index].page_num;
+  }
+
+  const uint8_t *bytes = page_num_bytes(page) + index * page->page_num_width;
+  pagenum_t page_num = 0;
+  for (int b = page->page_num_width - 1; b >= 0; b--) {
+    page_num = (page_num << 8) | bytes[b];
+  }
+  return page_num;
+}
+
+/**
+ * @brief copy every entry of page to dest, which holds num_of_keys entries
+ */
+void internal_read_entries(const internal_page_t *page, entry_t *dest) {
+  for (int i = 0; i < page->num_of_keys; i++) {
+    dest[i].key = internal_key(page, i);
+    dest[i].page_num = internal_child(page, i);
+  }
+}
+
+/**
+ * @brief Returns true if the n sorted entries can be written to one page
+ */
+bool internal_entries_fit(const entry_t *entries, int n) {
+  if (n == 0) {
+    return true;
+  }
+
+  pagenum_t largest = 0;
+  for (int i = 0; i < n; i++) {
+    if (entries[i].page_num > largest) {
+      largest = entries[i].page_num;
+    }
+  }
+  return entries_fit(n, entries[0].key, entries[n - 1].key,
+                     page_num_width_for(largest));
+}
+
+/**
+ * @brief replace the entries of page by the n sorted entries, which must fit
+ * (internal_entries_fit). The page is written in INTERNAL_FORMAT_DELTA
+ */
+void internal_write_entries(internal_page_t *page, const entry_t *entries,
+                            int n) {
+  pagenum_t largest = 0;
+  for (int i = 0; i < n; i++) {
+    if (entries[i].page_num > largest) {
+      largest = entries[i].page_num;
+    }
+  }
+
+  page->format = INTERNAL_FORMAT_DELTA;
+  page->num_of_keys = n;
+  page->base_key = n > 0 ? entries[0].key : 0;
+  page->key_width = n > 0 ? key_width_for(entries[0].key, entries[n - 1].key)
+                          : sizeof(uint16_t);
+  page->page_num_width = page_num_width_for(largest);
+  memset(page->body, 0, INTERNAL_BODY_SIZE);
+
+  for (int i = 0; i < n; i++) {
+    uint64_t delta = (uint64_t)entries[i].key - (uint64_t)page->base_key;
+    switch (page->key_width) {
+    case sizeof(uint16_t):
+      page->deltas16[i] = (uint16_t)delta;
+      break;
+    case sizeof(uint32_t):
+      page->deltas32[i] = (uint32_t)delta;
+      break;
+    default:
+      page->deltas64[i] = delta;
+      break;
+    }
+  }
+
+  uint8_t *bytes = (uint8_t *)page_num_bytes(page);
+  for (int i = 0; i < n; i++) {
+    pagenum_t page_num = entries[i].page_num;
+    for (int b = 0; b < page->page_num_width; b++) {
+      *bytes++ = (uint8_t)page_num;
+      page_num >>= 8;
+    }
+  }
+}
+
+/**
+ * @brief Returns true if an entry {key, page_num} can be inserted at index
+ */
+bool internal_has_room(const internal_page_t *page, int index, int64_t key,
+                       pagenum_t page_num) {
+  int n = page->num_of_keys;
+  int64_t first = index == 0 ? key : internal_key(page, 0);
+  int64_t last = index == n ? key : internal_key(page, n - 1);
+
+  int width = current_page_num_width(page);
+  if (page_num_width_for(page_num) > width) {
+    width = page_num_width_for(page_num);
+  }
+  return entries_fit(n + 1, first, last, width);
+}
+
+/**
+ * @brief Returns true if the entries of left, k_prime with the leftmost child
+ * of right and the entries of right fit in one page
+ */
+bool internal_can_merge(const internal_page_t *left, int64_t k_prime,
+                        const internal_page_t *right) {
+  int n = left->num_of_keys + 1 + right->num_of_keys;
+  int64_t first = left->num_of_keys > 0 ? internal_key(left, 0) : k_prime;
+  int64_t last = right->num_of_keys > 0
+                     ? internal_key(right, right->num_of_keys - 1)
+                     : k_prime;
+
+  int width = current_page_num_width(left);
+  if (current_page_num_width(right) > width) {
+    width = current_page_num_width(right);
+  }
+  if (page_num_width_for(right->one_more_page_num) > width) {
+    width = page_num_width_for(right->one_more_page_num);
+  }
+  return entries_fit(n, first, last, width);
+}
+
+/**
+ * @brief insert {key, page_num} at index. The caller checks internal_has_room
+ */
+void internal_insert_entry(internal_page_t *page, int index, int64_t key,
+                           pagenum_t page_num) {
+  int n = page->num_of_keys;
+  entry_t *entries = alloc_entries(n + 1);
+
+  internal_read_entries(page, entries);
+  memmove(&entries[index + 1], &entries[index], (n - index) * sizeof(entry_t));
+  entries[index].key = key;
+  entries[index].page_num = page_num;
+  internal_write_entries(page, entries, n + 1);
+
+  free(entries);
+}
+
+/**
+ * @brief remove the entry at index. The remaining entries always fit: their
+ * spread and page numbers can only shrink
+ */
+void internal_remove_entry(internal_page_t *page, int index) {
+  int n = page->num_of_keys;
+  entry_t *entries = alloc_entries(n);
+
+  internal_read_entries(page, entries);
+  memmove(&entries[index], &entries[index + 1],
+          (n - index - 1) * sizeof(entry_t));
+  internal_write_entries(page, entries, n - 1);
+
+  free(entries);
+}
+
+/**
+ * @brief replace the key at index. Returns false and leaves the page as it
+ * is if the new key widens the deltas past the page
+ */
+bool internal_set_key(internal_page_t *page, int index, int64_t key) {
+  int n = page->num_of_keys;
+  int64_t first = index == 0 ? key : internal_key(page, 0);
+  int64_t last = index == n - 1 ? key : internal_key(page, n - 1);
+  if (!entries_fit(n, first, last, current_page_num_width(page))) {
+    return false;
+  }
+
+  entry_t *entries = alloc_entries(n);
+  internal_read_entries(page, entries);
+  entries[index].key = key;
+  internal_write_entries(page, entries, n);
+  free(entries);
+  return true;
+}
+
+/**
+ * @brief replace the child page number at index. Returns false and leaves the
+ * page as it is if the new page number widens the entries past the page
+ */
+bool internal_set_child(internal_page_t *page, int index, pagenum_t page_num) {
+  int n = page->num_of_keys;
+  entry_t *entries = alloc_entries(n);
+  internal_read_entries(page, entries);
+  entries[index].page_num = page_num;
+
+  bool fits = internal_entries_fit(entries, n);
+  if (fits) {
+    internal_write_entries(page, entries, n);
+  }
+  free(entries);
+  return fits;
+}
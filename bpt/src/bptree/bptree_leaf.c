@@ -0,0 +1,592 @@
+#include "bpt.h"
+#include "bpt_internal.h"
+#include "vlog.h"
+
+// LEAF RECORDS
+
+/* Leaves are written as slotted pages (LEAF_FORMAT_SLOTTED): the keys stay
+ * contiguous for the search kernels, a byte per record holds the value length
+ * and the values are packed behind them in key order. A value longer than
+ * LEAF_INLINE_MAX is replaced by an overflow_ref_t and its length byte is
+ * LEAF_VALUE_OVERFLOW. While a value log is open, values are appended to it
+ * instead and the slot keeps a vlog_ref_t (LEAF_VALUE_VLOG). A record deleted
+ * lazily keeps its key with no value (LEAF_VALUE_TOMBSTONE) until it is
+ * swept; lookups treat it as absent. Pages of the older fixed-size layouts
+ * (LEAF_FORMAT_RECORDS, LEAF_FORMAT_SPLIT) are read in place and converted
+ * the first time they are modified, so a file migrates as its leaves are
+ * rewritten.
+ */
+
+static const legacy_leaf_page_t *as_legacy(const leaf_page_t *leaf) {
+  return (const legacy_leaf_page_t *)leaf;
+}
+
+static const split_leaf_page_t *as_split(const leaf_page_t *leaf) {
+  return (const split_leaf_page_t *)leaf;
+}
+
+static uint8_t *slot_lengths(const leaf_page_t *leaf) {
+  return (uint8_t *)(leaf->body + leaf->num_of_keys * sizeof(int64_t));
+}
+
+static char *slot_values(const leaf_page_t *leaf) {
+  return (char *)(leaf->body + leaf->num_of_keys * LEAF_SLOT_SIZE);
+}
+
+/**
+ * @brief Returns the bytes a slot payload takes for a length byte
+ */
+static size_t slot_payload_size(uint8_t code) {
+  switch (code) {
+  case LEAF_VALUE_OVERFLOW:
+    return sizeof(overflow_ref_t);
+  case LEAF_VALUE_VLOG:
+    return sizeof(vlog_ref_t);
+  case LEAF_VALUE_TOMBSTONE:
+    return 0;
+  default:
+    return code;
+  }
+}
+
+/**
+ * @brief Returns true if a value of length goes to the value log. Values no
+ * longer than the reference stay in the leaf
+ */
+static bool use_value_log(size_t length) {
+  return vlog_is_open() && length > sizeof(vlog_ref_t);
+}
+
+/**
+ * @brief Returns the offset of the value at index from the start of the
+ * values area. The directory keeps lengths only, so this walks the slots in
+ * front of index; code going over many slots keeps a running offset instead
+ * (leaf_read_slots, leaf_append_slots)
+ */
+static size_t slot_value_offset(const leaf_page_t *leaf, int index) {
+  if (index == leaf->num_of_keys) {
+    return leaf->payload_size;
+  }
+  const uint8_t *lengths = slot_lengths(leaf);
+  size_t offset = 0;
+  for (int i = 0; i < index; i++) {
+    offset += slot_payload_size(lengths[i]);
+  }
+  return offset;
+}
+
+/**
+ * @brief Returns the bytes a record with value takes in a slotted leaf
+ */
+size_t leaf_stored_size(const char *value) {
+  size_t length = strlen(value);
+  if (use_value_log(length)) {
+    return LEAF_SLOT_SIZE + sizeof(vlog_ref_t);
+  }
+  if (length > LEAF_INLINE_MAX) {
+    return LEAF_SLOT_SIZE + sizeof(overflow_ref_t);
+  }
+  return LEAF_SLOT_SIZE + length;
+}
+
+static const char *legacy_value(const leaf_page_t *leaf, int index) {
+  if (leaf->format == LEAF_FORMAT_RECORDS) {
+    return as_legacy(leaf)->records[index].value;
+  }
+  return as_split(leaf)->values[index];
+}
+
+/**
+ * @brief convert a page of a fixed-size layout to LEAF_FORMAT_SLOTTED in
+ * memory. A full old page always fits: each record shrinks to at most
+ * LEAF_SLOT_SIZE + VALUE_SIZE - 1 bytes, and old values stay inline
+ */
+void leaf_upgrade(leaf_page_t *leaf) {
+  if (leaf->format == LEAF_FORMAT_SLOTTED) {
+    return;
+  }
+
+  int n = leaf->num_of_keys;
+  leaf_slot_t *slots = leaf_alloc_slots(n);
+  leaf_read_slots(leaf, slots);
+  leaf_clear_records(leaf);
+  leaf_append_slots(leaf, slots, n);
+  free(slots);
+}
+
+int64_t leaf_key(const leaf_page_t *leaf, int index) {
+  switch (leaf->format) {
+  case LEAF_FORMAT_RECORDS:
+    return as_legacy(leaf)->records[index].key;
+  case LEAF_FORMAT_SPLIT:
+    return as_split(leaf)->keys[index];
+  default:
+    return leaf->keys[index];
+  }
+}
+
+/**
+ * @brief copy the record at index in its stored form
+ */
+void leaf_read_slot(const leaf_page_t *leaf, int index, leaf_slot_t *slot) {
+  slot->key = leaf_key(leaf, index);
+
+  if (leaf->format != LEAF_FORMAT_SLOTTED) {
+    const char *value = legacy_value(leaf, index);
+    slot->code = strnlen(value, VALUE_SIZE - 1);
+    slot->size = slot->code;
+    memcpy(slot->payload, value, slot->size);
+    return;
+  }
+
+  slot->code = slot_lengths(leaf)[index];
+  slot->size = slot_payload_size(slot->code);
+  memcpy(slot->payload, slot_values(leaf) + slot_value_offset(leaf, index),
+         slot->size);
+}
+
+/**
+ * @brief copy every record in its stored form to dest, which holds
+ * num_of_keys slots, walking the values once
+ */
+void leaf_read_slots(const leaf_page_t *leaf, leaf_slot_t *dest) {
+  if (leaf->format != LEAF_FORMAT_SLOTTED) {
+    for (int i = 0; i < leaf->num_of_keys; i++) {
+      leaf_read_slot(leaf, i, &dest[i]);
+    }
+    return;
+  }
+
+  const uint8_t *lengths = slot_lengths(leaf);
+  const char *values = slot_values(leaf);
+  size_t offset = 0;
+  for (int i = 0; i < leaf->num_of_keys; i++) {
+    dest[i].key = leaf->keys[i];
+    dest[i].code = lengths[i];
+    dest[i].size = slot_payload_size(lengths[i]);
+    memcpy(dest[i].payload, values + offset, dest[i].size);
+    offset += dest[i].size;
+  }
+}
+
+/**
+ * @brief array for n records in their stored form, for leaf_read_slots
+ */
+leaf_slot_t *leaf_alloc_slots(int n) {
+  leaf_slot_t *slots = (leaf_slot_t *)malloc((n > 0 ? n : 1) *
+                                             sizeof(leaf_slot_t));
+  if (slots == NULL) {
+    perror("Memory allocation for leaf slots failed.");
+    exit(EXIT_FAILURE);
+  }
+  return slots;
+}
+
+/**
+ * @brief build the stored form of a new record, appending the value to the
+ * value log or writing it to overflow pages when it is longer than
+ * LEAF_INLINE_MAX
+ */
+void leaf_make_slot(int64_t key, const char *value, leaf_slot_t *slot) {
+  size_t length = strlen(value);
+  slot->key = key;
+
+  if (use_value_log(length)) {
+    vlog_ref_t ref;
+    ref.offset = vlog_append(key, value, length);
+    ref.length = length;
+    slot->code = LEAF_VALUE_VLOG;
+    slot->size = sizeof(vlog_ref_t);
+    memcpy(slot->payload, &ref, sizeof(vlog_ref_t));
+    return;
+  }
+
+  if (length <= LEAF_INLINE_MAX) {
+    slot->code = length;
+    slot->size = length;
+    memcpy(slot->payload, value, length);
+    return;
+  }
+
+  overflow_ref_t ref;
+  ref.first_page_num = overflow_write(value, length);
+  ref.length = length;
+  slot->code = LEAF_VALUE_OVERFLOW;
+  slot->size = sizeof(overflow_ref_t);
+  memcpy(slot->payload, &ref, sizeof(overflow_ref_t));
+}
+
+/**
+ * @brief copy the value at index to dest as a C string of at most size - 1
+ * bytes and return the full length of the value
+ */
+size_t leaf_read_value(const leaf_page_t *leaf, int index, char *dest,
+                       size_t size) {
+  leaf_slot_t slot;
+  leaf_read_slot(leaf, index, &slot);
+
+  if (slot.code == LEAF_VALUE_OVERFLOW) {
+    overflow_ref_t ref;
+    memcpy(&ref, slot.payload, sizeof(overflow_ref_t));
+    overflow_read(ref.first_page_num, dest, size);
+    return ref.length;
+  }
+  if (slot.code == LEAF_VALUE_VLOG) {
+    vlog_ref_t ref;
+    memcpy(&ref, slot.payload, sizeof(vlog_ref_t));
+    size_t copied = ref.length < size - 1 ? ref.length : size - 1;
+    vlog_read_value(ref.offset, dest, copied);
+    dest[copied] = '\0';
+    return ref.length;
+  }
+
+  size_t copied = slot.size < size - 1 ? slot.size : size - 1;
+  memcpy(dest, slot.payload, copied);
+  dest[copied] = '\0';
+  return slot.size;
+}
+
+/**
+ * @brief release the overflow pages of the value at index, or mark its value
+ * log record dead. Called before the record is dropped for good
+ */
+void leaf_free_value(const leaf_page_t *leaf, int index) {
+  if (leaf->format != LEAF_FORMAT_SLOTTED) {
+    return;
+  }
+
+  leaf_slot_t slot;
+  switch (slot_lengths(leaf)[index]) {
+  case LEAF_VALUE_OVERFLOW: {
+    leaf_read_slot(leaf, index, &slot);
+    overflow_ref_t ref;
+    memcpy(&ref, slot.payload, sizeof(overflow_ref_t));
+    overflow_free(ref.first_page_num);
+    break;
+  }
+  case LEAF_VALUE_VLOG: {
+    leaf_read_slot(leaf, index, &slot);
+    vlog_ref_t ref;
+    memcpy(&ref, slot.payload, sizeof(vlog_ref_t));
+    vlog_discard(ref.length);
+    break;
+  }
+  default:
+    break;
+  }
+}
+
+/**
+ * @brief Returns the bytes of the body in use, as if the leaf was slotted
+ */
+size_t leaf_used_size(const leaf_page_t *leaf) {
+  if (leaf->format == LEAF_FORMAT_SLOTTED) {
+    return leaf->num_of_keys * LEAF_SLOT_SIZE + leaf->payload_size;
+  }
+
+  size_t used = 0;
+  for (int i = 0; i < leaf->num_of_keys; i++) {
+    used += LEAF_SLOT_SIZE + strnlen(legacy_value(leaf, i), VALUE_SIZE - 1);
+  }
+  return used;
+}
+
+/**
+ * @brief Returns true if one more record with value fits in the leaf
+ */
+bool leaf_has_room(const leaf_page_t *leaf, const char *value) {
+  if (leaf->num_of_keys >= RECORD_CNT) {
+    return false;
+  }
+  return leaf_used_size(leaf) + leaf_stored_size(value) <= LEAF_BODY_SIZE;
+}
+
+/**
+ * @brief Returns true if slot, read from another leaf, fits in the leaf
+ */
+bool leaf_has_room_for_slot(const leaf_page_t *leaf, const leaf_slot_t *slot) {
+  if (leaf->num_of_keys >= RECORD_CNT) {
+    return false;
+  }
+  return leaf_used_size(leaf) + LEAF_SLOT_SIZE + slot->size <= LEAF_BODY_SIZE;
+}
+
+/**
+ * @brief Returns true if the records of both leaves fit in a single leaf
+ */
+bool leaf_can_merge(const leaf_page_t *left, const leaf_page_t *right) {
+  if (left->num_of_keys + right->num_of_keys > RECORD_CNT) {
+    return false;
+  }
+  return leaf_used_size(left) + leaf_used_size(right) <= LEAF_BODY_SIZE;
+}
+
+/**
+ * @brief Returns the first index whose key is not less than key
+ */
+int leaf_lower_bound(const leaf_page_t *leaf, int64_t key) {
+  switch (leaf->format) {
+  case LEAF_FORMAT_RECORDS: {
+    int index = 0;
+    while (index < leaf->num_of_keys &&
+           as_legacy(leaf)->records[index].key < key) {
+      index++;
+    }
+    return index;
+  }
+  case LEAF_FORMAT_SPLIT:
+    return search_sorted_keys(as_split(leaf)->keys, leaf->num_of_keys, key);
+  default:
+    return search_sorted_keys(leaf->keys, leaf->num_of_keys, key);
+  }
+}
+
+/**
+ * @brief Returns the index of key in the leaf, -1 if not exists or deleted
+ */
+int leaf_find_key(const leaf_page_t *leaf, int64_t key) {
+  int index = leaf_lower_bound(leaf, key);
+  if (index < leaf->num_of_keys && leaf_key(leaf, index) == key &&
+      !leaf_is_tombstone(leaf, index)) {
+    return index;
+  }
+  return -1;
+}
+
+/**
+ * @brief Returns true if the record at index was deleted lazily
+ */
+bool leaf_is_tombstone(const leaf_page_t *leaf, int index) {
+  return leaf->format == LEAF_FORMAT_SLOTTED &&
+         slot_lengths(leaf)[index] == LEAF_VALUE_TOMBSTONE;
+}
+
+/**
+ * @brief Returns the records of the leaf that are not tombstones
+ */
+int leaf_live_records(const leaf_page_t *leaf) {
+  int live = 0;
+  for (int i = 0; i < leaf->num_of_keys; i++) {
+    live += !leaf_is_tombstone(leaf, i);
+  }
+  return live;
+}
+
+/**
+ * @brief insert a record in its stored form at index. The directory and the
+ * values behind index are moved up; the caller checks the room first
+ */
+void leaf_insert_slot(leaf_page_t *leaf, int index, const leaf_slot_t *slot) {
+  leaf_upgrade(leaf);
+
+  const int n = leaf->num_of_keys;
+  const size_t size = slot->size;
+  const size_t offset = slot_value_offset(leaf, index);
+  char *body = leaf->body;
+
+  // values: the tail first, the areas overlap
+  size_t old_values = n * LEAF_SLOT_SIZE;
+  size_t new_values = (n + 1) * LEAF_SLOT_SIZE;
+  memmove(body + new_values + offset + size, body + old_values + offset,
+          leaf->payload_size - offset);
+  memmove(body + new_values, body + old_values, offset);
+  memcpy(body + new_values + offset, slot->payload, size);
+
+  // lengths
+  size_t old_lengths = n * sizeof(int64_t);
+  size_t new_lengths = (n + 1) * sizeof(int64_t);
+  memmove(body + new_lengths + index + 1, body + old_lengths + index,
+          n - index);
+  memmove(body + new_lengths, body + old_lengths, index);
+  body[new_lengths + index] = (char)slot->code;
+
+  // keys
+  memmove(&leaf->keys[index + 1], &leaf->keys[index],
+          (n - index) * sizeof(int64_t));
+  leaf->keys[index] = slot->key;
+
+  leaf->num_of_keys++;
+  leaf->payload_size += size;
+}
+
+/**
+ * @brief append n records in their stored form, whose keys follow the keys
+ * of the leaf, moving the directory and the values once. The caller checks
+ * the room first
+ */
+void leaf_append_slots(leaf_page_t *leaf, const leaf_slot_t *slots, int n) {
+  leaf_upgrade(leaf);
+
+  const int old_n = leaf->num_of_keys;
+  char *body = leaf->body;
+
+  // values, then lengths: each moves up past the grown area in front of it
+  char *values = body + (old_n + n) * LEAF_SLOT_SIZE;
+  memmove(values, body + old_n * LEAF_SLOT_SIZE, leaf->payload_size);
+  uint8_t *lengths = (uint8_t *)(body + (old_n + n) * sizeof(int64_t));
+  memmove(lengths, body + old_n * sizeof(int64_t), old_n);
+
+  size_t offset = leaf->payload_size;
+  for (int i = 0; i < n; i++) {
+    leaf->keys[old_n + i] = slots[i].key;
+    lengths[old_n + i] = slots[i].code;
+    memcpy(values + offset, slots[i].payload, slots[i].size);
+    offset += slots[i].size;
+  }
+
+  leaf->num_of_keys += n;
+  leaf->payload_size = offset;
+}
+
+/**
+ * @brief insert a new record at index
+ */
+void leaf_insert_record(leaf_page_t *leaf, int index, int64_t key,
+                        const char *value) {
+  leaf_slot_t slot;
+  leaf_make_slot(key, value, &slot);
+  leaf_insert_slot(leaf, index, &slot);
+}
+
+/**
+ * @brief remove the record at index and compact the page, the freed bytes at
+ * the end of the body are cleared. Overflow pages of the value are kept, see
+ * leaf_free_value
+ */
+void leaf_remove_record(leaf_page_t *leaf, int index) {
+  leaf_upgrade(leaf);
+
+  const int n = leaf->num_of_keys;
+  const size_t length = slot_payload_size(slot_lengths(leaf)[index]);
+  const size_t offset = slot_value_offset(leaf, index);
+  const size_t used = leaf_used_size(leaf);
+  char *body = leaf->body;
+
+  // keys
+  memmove(&leaf->keys[index], &leaf->keys[index + 1],
+          (n - index - 1) * sizeof(int64_t));
+
+  // lengths
+  size_t old_lengths = n * sizeof(int64_t);
+  size_t new_lengths = (n - 1) * sizeof(int64_t);
+  memmove(body + new_lengths, body + old_lengths, index);
+  memmove(body + new_lengths + index, body + old_lengths + index + 1,
+          n - index - 1);
+
+  // values
+  size_t old_values = n * LEAF_SLOT_SIZE;
+  size_t new_values = (n - 1) * LEAF_SLOT_SIZE;
+  memmove(body + new_values, body + old_values, offset);
+  memmove(body + new_values + offset, body + old_values + offset + length,
+          leaf->payload_size - offset - length);
+
+  leaf->num_of_keys--;
+  leaf->payload_size -= length;
+  memset(body + leaf_used_size(leaf), 0, used - leaf_used_size(leaf));
+}
+
+/**
+ * @brief replace the value at index in place, moving only the values behind
+ * it. Returns false with the records unchanged if the new value does not fit,
+ * otherwise the old value is released as by leaf_free_value
+ */
+bool leaf_replace_value(leaf_page_t *leaf, int index, const char *value) {
+  leaf_upgrade(leaf);
+
+  const size_t old_size = slot_payload_size(slot_lengths(leaf)[index]);
+  const size_t new_size = leaf_stored_size(value) - LEAF_SLOT_SIZE;
+  const size_t used = leaf_used_size(leaf);
+  if (used - old_size + new_size > LEAF_BODY_SIZE) {
+    return false;
+  }
+
+  leaf_free_value(leaf, index);
+  leaf_slot_t slot;
+  leaf_make_slot(leaf->keys[index], value, &slot);
+
+  const size_t offset = slot_value_offset(leaf, index);
+  char *values = slot_values(leaf);
+  memmove(values + offset + new_size, values + offset + old_size,
+          leaf->payload_size - offset - old_size);
+  memcpy(values + offset, slot.payload, new_size);
+  slot_lengths(leaf)[index] = slot.code;
+
+  leaf->payload_size = leaf->payload_size - old_size + new_size;
+  if (new_size < old_size) {
+    memset(leaf->body + leaf_used_size(leaf), 0, used - leaf_used_size(leaf));
+  }
+  return true;
+}
+
+/**
+ * @brief turn the record at index into a tombstone, dropping its value bytes
+ * from the page. The value is released first, see leaf_free_value
+ */
+void leaf_set_tombstone(leaf_page_t *leaf, int index) {
+  leaf_upgrade(leaf);
+
+  const size_t old_size = slot_payload_size(slot_lengths(leaf)[index]);
+  const size_t offset = slot_value_offset(leaf, index);
+  const size_t used = leaf_used_size(leaf);
+  char *values = slot_values(leaf);
+  memmove(values + offset, values + offset + old_size,
+          leaf->payload_size - offset - old_size);
+  slot_lengths(leaf)[index] = LEAF_VALUE_TOMBSTONE;
+
+  leaf->payload_size -= old_size;
+  memset(leaf->body + leaf_used_size(leaf), 0, used - leaf_used_size(leaf));
+}
+
+/**
+ * @brief remove the records from first up to last (excluded) and compact the
+ * page in one pass. Only the slots go: callers release overflow chains and
+ * value log records first with leaf_free_value, as delete_range_in_leaf does
+ */
+
+void leaf_remove_records(leaf_page_t *leaf, int first, int last) {
+  int n = leaf->num_of_keys;
+  leaf_slot_t *slots = leaf_alloc_slots(n);
+  leaf_read_slots(leaf, slots);
+  memmove(&slots[first], &slots[last], (n - last) * sizeof(leaf_slot_t));
+
+  leaf_clear_records(leaf);
+  leaf_append_slots(leaf, slots, n - (last - first));
+  free(slots);
+}
+
+/**
+ * @brief remove the tombstones of the leaf and return how many there were
+ */
+int leaf_remove_tombstones(leaf_page_t *leaf) {
+  int n = leaf->num_of_keys;
+  int kept = 0;
+  for (int index = 0; index < n; index++) {
+    kept += !leaf_is_tombstone(leaf, index);
+  }
+  if (kept == n) {
+    return 0;
+  }
+
+  leaf_slot_t *slots = leaf_alloc_slots(n);
+  leaf_read_slots(leaf, slots);
+  kept = 0;
+  for (int index = 0; index < n; index++) {
+    if (slots[index].code != LEAF_VALUE_TOMBSTONE) {
+      slots[kept++] = slots[index];
+    }
+  }
+  leaf_clear_records(leaf);
+  leaf_append_slots(leaf, slots, kept);
+  free(slots);
+  return n - kept;
+}
+
+/**
+ * @brief drop every record, leaving an empty LEAF_FORMAT_SLOTTED leaf
+ */
+void leaf_clear_records(leaf_page_t *leaf) {
+  leaf->format = LEAF_FORMAT_SLOTTED;
+  leaf->num_of_keys = 0;
+  leaf->payload_size = 0;
+  memset(leaf->body, 0, LEAF_BODY_SIZE);
+}
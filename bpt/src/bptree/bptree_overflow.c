@@ -0,0 +1,98 @@
+#include "bpt.h"
+#include "bpt_internal.h"
+
+// OVERFLOW PAGES
+
+/* A value longer than LEAF_INLINE_MAX is written to a chain of overflow
+ * pages and the leaf keeps only an overflow_ref_t, so large values do not
+ * cost leaf fanout. Chains are never shared: moving a record between leaves
+ * moves its reference, removing the record frees the chain.
+ */
+
+#define OVERFLOW_DATA_SIZE (page_size - 2 * sizeof(uint64_t))
+
+/**
+ * @brief write length bytes of value to a new chain of overflow pages and
+ * return its first page
+ */
+pagenum_t overflow_write(const char *value, size_t length) {
+  pagenum_t first_num = make_overflow_page(PAGE_NULL);
+  pagenum_t page_num = first_num;
+  size_t written = 0;
+  page_t *page_buf = alloc_page_buf();
+
+  while (true) {
+    memset(page_buf, 0, page_size);
+    overflow_page_t *page = (overflow_page_t *)page_buf;
+
+    size_t chunk = length - written;
+    if (chunk > OVERFLOW_DATA_SIZE) {
+      chunk = OVERFLOW_DATA_SIZE;
+    }
+    memcpy(page->data, value + written, chunk);
+    page->length = chunk;
+    written += chunk;
+
+    if (written < length) {
+      page->next_page_num = make_overflow_page(page_num);
+    }
+    file_write_page(page_num, page_buf);
+
+    if (written == length) {
+      free_page_buf(page_buf);
+      return first_num;
+    }
+    page_num = page->next_page_num;
+  }
+}
+
+/**
+ * @brief copy at most size - 1 bytes of the value in the chain to dest and
+ * terminate it
+ */
+void overflow_read(pagenum_t first_num, char *dest, size_t size) {
+  pagenum_t page_num = first_num;
+  size_t copied = 0;
+  page_t *page_buf = alloc_page_buf();
+
+  while (page_num != PAGE_NULL && copied + 1 < size) {
+    file_read_page(page_num, page_buf);
+    overflow_page_t *page = (overflow_page_t *)page_buf;
+
+    size_t chunk = page->length;
+    if (chunk > size - 1 - copied) {
+      chunk = size - 1 - copied;
+    }
+    memcpy(dest + copied, page->data, chunk);
+    copied += chunk;
+    page_num = page->next_page_num;
+  }
+  dest[copied] = '\0';
+  free_page_buf(page_buf);
+}
+
+/**
+ * @brief return every page of the chain to the free page list
+ */
+void overflow_free(pagenum_t first_num) {
+  pagenum_t page_num = first_num;
+  page_t *page_buf = alloc_page_buf();
+
+  while (page_num != PAGE_NULL) {
+    file_read_page(page_num, page_buf);
+    pagenum_t next_num = ((overflow_page_t *)page_buf)->next_page_num;
+    file_free_page(page_num);
+    page_num = next_num;
+  }
+  free_page_buf(page_buf);
+
+}
+
+pagenum_t make_overflow_page(pagenum_t hint) {
+  pagenum_t page_num = file_alloc_page(hint);
+  if (page_num == PAGE_NULL) {
+    perror("Overflow page creation.");
+    exit(EXIT_FAILURE);
+  }
+  return page_num;
+}
@@ -0,0 +1,544 @@
+#include "bpt.h"
+#include "bpt_internal.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SEARCH_X86 1
+#endif
+
+// IN-PAGE SEARCH
+
+/* Delta-encoded internal pages keep their keys as contiguous 16, 32 or 64-bit
+ * distances from base_key, so a probe is turned into a delta once and
+ * compared against the array directly. Pages of the old layout keep entry_t
+ * {key, page_num} pairs and are walked with a 16-byte stride. Binary search
+ * narrows the range down to SEARCH_WINDOW entries and the remaining window is
+ * scanned by a kernel that is picked once from the CPU features (AVX2, SSE4.2
+ * or plain C). Leaf keys are contiguous and scanned by the same family of
+ * kernels. A child is looked up by comparing the low byte of its page number
+ * against every byte of the packed page numbers at once and checking the
+ * whole number only where an entry starts.
+ */
+#define SEARCH_WINDOW 32
+
+typedef struct {
+  // number of entries whose key is <= key (entries are sorted)
+  int (*count_entry_keys)(const entry_t *entries, int n, int64_t key);
+  // index of the entry pointing to child, -1 if none
+  int (*find_entry_child)(const entry_t *entries, int n, pagenum_t child);
+  // index of the page number of width bytes equal to child (little-endian
+  // bytes) in a packed array of n, -1 if none
+  int (*find_packed_child)(const uint8_t *bytes, int n, int width,
+                           const uint8_t *child);
+  // number of keys < key (keys are sorted)
+  int (*count_keys_below)(const int64_t *keys, int n, int64_t key);
+  // number of deltas <= delta (deltas are sorted)
+  int (*count_deltas16)(const uint16_t *deltas, int n, uint16_t delta);
+  int (*count_deltas32)(const uint32_t *deltas, int n, uint32_t delta);
+} search_kernels_t;
+
+static int count_entry_keys_scalar(const entry_t *entries, int n,
+                                   int64_t key) {
+  int index = 0;
+  while (index < n && entries[index].key <= key) {
+    index++;
+  }
+  return index;
+}
+
+static int find_entry_child_scalar(const entry_t *entries, int n,
+                                   pagenum_t child) {
+  for (int index = 0; index < n; index++) {
+    if (entries[index].page_num == child) {
+      return index;
+    }
+  }
+  return -1;
+}
+
+static int find_packed_child_scalar(const uint8_t *bytes, int n, int width,
+                                    const uint8_t *child) {
+  for (int index = 0; index < n; index++) {
+    if (memcmp(bytes + index * width, child, width) == 0) {
+      return index;
+    }
+  }
+  return -1;
+}
+
+/**
+ * @brief the entries starting at the set bits of equal, a mask of the bytes
+ * from pos on whose value is the low byte of child, checked in full
+ */
+static int check_packed_candidates(const uint8_t *bytes, int n, int width,
+                                   const uint8_t *child, int pos,
+                                   uint32_t equal) {
+  while (equal != 0) {
+    int byte = pos + __builtin_ctz(equal);
+    equal &= equal - 1;
+    if (byte % width == 0 && byte / width < n &&
+        memcmp(bytes + byte, child, width) == 0) {
+      return byte / width;
+    }
+  }
+  return -1;
+}
+
+static int count_keys_below_scalar(const int64_t *keys, int n, int64_t key) {
+  int index = 0;
+  while (index < n && keys[index] < key) {
+    index++;
+  }
+  return index;
+}
+
+static int count_deltas16_scalar(const uint16_t *deltas, int n,
+                                 uint16_t delta) {
+  int index = 0;
+  while (index < n && deltas[index] <= delta) {
+    index++;
+  }
+  return index;
+}
+
+static int count_deltas32_scalar(const uint32_t *deltas, int n,
+                                 uint32_t delta) {
+  int index = 0;
+  while (index < n && deltas[index] <= delta) {
+    index++;
+  }
+  return index;
+}
+
+static const search_kernels_t scalar_kernels = {
+    count_entry_keys_scalar, find_entry_child_scalar,
+    find_packed_child_scalar, count_keys_below_scalar, count_deltas16_scalar,
+    count_deltas32_scalar};
+
+#ifdef SEARCH_X86
+/**
+ * @brief two entries per 128-bit compare; keys are sorted so the scan stops
+ * at the first block holding a key greater than the probe
+ */
+__attribute__((target("sse4.2"))) static int
+count_entry_keys_sse42(const entry_t *entries, int n, int64_t key) {
+  const __m128i probe = _mm_set1_epi64x(key);
+  int index = 0;
+
+  for (; index + 2 <= n; index += 2) {
+    __m128i e0 = _mm_loadu_si128((const __m128i *)&entries[index]);
+    __m128i e1 = _mm_loadu_si128((const __m128i *)&entries[index + 1]);
+    __m128i keys = _mm_unpacklo_epi64(e0, e1);
+    int greater =
+        _mm_movemask_pd(_mm_castsi128_pd(_mm_cmpgt_epi64(keys, probe)));
+    if (greater != 0) {
+      return index + __builtin_ctz(greater);
+    }
+  }
+  return index + count_entry_keys_scalar(entries + index, n - index, key);
+}
+
+__attribute__((target("sse4.2"))) static int
+find_entry_child_sse42(const entry_t *entries, int n, pagenum_t child) {
+  const __m128i target = _mm_set1_epi64x((long long)child);
+  int index = 0;
+
+  for (; index + 2 <= n; index += 2) {
+    __m128i e0 = _mm_loadu_si128((const __m128i *)&entries[index]);
+    __m128i e1 = _mm_loadu_si128((const __m128i *)&entries[index + 1]);
+    __m128i nums = _mm_unpackhi_epi64(e0, e1);
+    int equal =
+        _mm_movemask_pd(_mm_castsi128_pd(_mm_cmpeq_epi64(nums, target)));
+    if (equal != 0) {
+      return index + __builtin_ctz(equal);
+    }
+  }
+  int rest = find_entry_child_scalar(entries + index, n - index, child);
+  return rest < 0 ? -1 : index + rest;
+}
+
+/**
+ * @brief 16 bytes per compare; entries crossing the end of a block are still
+ * found from their first byte, the rest is left to the scalar kernel
+ */
+__attribute__((target("sse4.2"))) static int
+find_packed_child_sse42(const uint8_t *bytes, int n, int width,
+                        const uint8_t *child) {
+  const __m128i low = _mm_set1_epi8((char)child[0]);
+  const int total = n * width;
+  int pos = 0;
+
+  for (; pos + 16 <= total; pos += 16) {
+    __m128i block = _mm_loadu_si128((const __m128i *)(bytes + pos));
+    uint32_t equal = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(block, low));
+    int index =
+        check_packed_candidates(bytes, n, width, child, pos, equal);
+    if (index >= 0) {
+      return index;
+    }
+  }
+  int first = (pos + width - 1) / width;
+  int rest = find_packed_child_scalar(bytes + first * width, n - first, width,
+                                      child);
+  return rest < 0 ? -1 : first + rest;
+}
+
+__attribute__((target("sse4.2"))) static int
+count_keys_below_sse42(const int64_t *keys, int n, int64_t key) {
+  const __m128i probe = _mm_set1_epi64x(key);
+  int index = 0;
+
+  for (; index + 2 <= n; index += 2) {
+    __m128i block = _mm_loadu_si128((const __m128i *)&keys[index]);
+    int below =
+        _mm_movemask_pd(_mm_castsi128_pd(_mm_cmpgt_epi64(probe, block)));
+    if (below != 0x3) {
+      return index + __builtin_popcount(below);
+    }
+  }
+  return index + count_keys_below_scalar(keys + index, n - index, key);
+}
+
+/**
+ * @brief deltas are unsigned, flipping the sign bit of both sides lets the
+ * signed compares order them
+ */
+__attribute__((target("sse4.2"))) static int
+count_deltas16_sse42(const uint16_t *deltas, int n, uint16_t delta) {
+  const __m128i bias = _mm_set1_epi16((short)0x8000);
+  const __m128i probe = _mm_xor_si128(_mm_set1_epi16((short)delta), bias);
+  int index = 0;
+
+  for (; index + 8 <= n; index += 8) {
+    __m128i block = _mm_xor_si128(
+        _mm_loadu_si128((const __m128i *)&deltas[index]), bias);
+    int greater = _mm_movemask_epi8(_mm_cmpgt_epi16(block, probe));
+    if (greater != 0) {
+      return index + __builtin_ctz(greater) / 2;
+    }
+  }
+  return index + count_deltas16_scalar(deltas + index, n - index, delta);
+}
+
+__attribute__((target("sse4.2"))) static int
+count_deltas32_sse42(const uint32_t *deltas, int n, uint32_t delta) {
+  const __m128i bias = _mm_set1_epi32((int)0x80000000u);
+  const __m128i probe = _mm_xor_si128(_mm_set1_epi32((int)delta), bias);
+  int index = 0;
+
+  for (; index + 4 <= n; index += 4) {
+    __m128i block = _mm_xor_si128(
+        _mm_loadu_si128((const __m128i *)&deltas[index]), bias);
+    int greater =
+        _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(block, probe)));
+    if (greater != 0) {
+      return index + __builtin_ctz(greater);
+    }
+  }
+  return index + count_deltas32_scalar(deltas + index, n - index, delta);
+}
+
+static const search_kernels_t sse42_kernels = {
+    count_entry_keys_sse42, find_entry_child_sse42, find_packed_child_sse42,
+    count_keys_below_sse42, count_deltas16_sse42, count_deltas32_sse42};
+
+/**
+ * @brief four entries per 256-bit compare. unpack works per 128-bit lane, so
+ * the key vector holds entries in the order 0, 2, 1, 3 and the mask bits are
+ * mapped back through lane_order
+ */
+static const int lane_order[4] = {0, 2, 1, 3};
+
+__attribute__((target("avx2"))) static int
+count_entry_keys_avx2(const entry_t *entries, int n, int64_t key) {
+  const __m256i probe = _mm256_set1_epi64x(key);
+  int index = 0;
+
+  for (; index + 4 <= n; index += 4) {
+    __m256i e01 = _mm256_loadu_si256((const __m256i *)&entries[index]);
+    __m256i e23 = _mm256_loadu_si256((const __m256i *)&entries[index + 2]);
+    __m256i keys = _mm256_unpacklo_epi64(e01, e23);
+    int greater = _mm256_movemask_pd(
+        _mm256_castsi256_pd(_mm256_cmpgt_epi64(keys, probe)));
+    if (greater != 0) {
+      // sorted keys: the number of set lanes tells how many are past the probe
+      return index + 4 - __builtin_popcount(greater);
+    }
+  }
+  return index + count_entry_keys_scalar(entries + index, n - index, key);
+}
+
+__attribute__((target("avx2"))) static int
+find_entry_child_avx2(const entry_t *entries, int n, pagenum_t child) {
+  const __m256i target = _mm256_set1_epi64x((long long)child);
+  int index = 0;
+
+  for (; index + 4 <= n; index += 4) {
+    __m256i e01 = _mm256_loadu_si256((const __m256i *)&entries[index]);
+    __m256i e23 = _mm256_loadu_si256((const __m256i *)&entries[index + 2]);
+    __m256i nums = _mm256_unpackhi_epi64(e01, e23);
+    int equal = _mm256_movemask_pd(
+        _mm256_castsi256_pd(_mm256_cmpeq_epi64(nums, target)));
+    if (equal != 0) {
+      return index + lane_order[__builtin_ctz(equal)];
+    }
+  }
+  int rest = find_entry_child_scalar(entries + index, n - index, child);
+  return rest < 0 ? -1 : index + rest;
+}
+
+__attribute__((target("avx2"))) static int
+find_packed_child_avx2(const uint8_t *bytes, int n, int width,
+                       const uint8_t *child) {
+  const __m256i low = _mm256_set1_epi8((char)child[0]);
+  const int total = n * width;
+  int pos = 0;
+
+  for (; pos + 32 <= total; pos += 32) {
+    __m256i block = _mm256_loadu_si256((const __m256i *)(bytes + pos));
+    uint32_t equal =
+        (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(block, low));
+    int index =
+        check_packed_candidates(bytes, n, width, child, pos, equal);
+    if (index >= 0) {
+      return index;
+    }
+  }
+  int first = (pos + width - 1) / width;
+  int rest = find_packed_child_scalar(bytes + first * width, n - first, width,
+                                      child);
+  return rest < 0 ? -1 : first + rest;
+}
+
+__attribute__((target("avx2"))) static int
+count_keys_below_avx2(const int64_t *keys, int n, int64_t key) {
+  const __m256i probe = _mm256_set1_epi64x(key);
+  int index = 0;
+
+  for (; index + 4 <= n; index += 4) {
+    __m256i block = _mm256_loadu_si256((const __m256i *)&keys[index]);
+    int below = _mm256_movemask_pd(
+        _mm256_castsi256_pd(_mm256_cmpgt_epi64(probe, block)));
+    if (below != 0xf) {
+      return index + __builtin_popcount(below);
+    }
+  }
+  return index + count_keys_below_scalar(keys + index, n - index, key);
+}
+
+__attribute__((target("avx2"))) static int
+count_deltas16_avx2(const uint16_t *deltas, int n, uint16_t delta) {
+  const __m256i bias = _mm256_set1_epi16((short)0x8000);
+  const __m256i probe =
+      _mm256_xor_si256(_mm256_set1_epi16((short)delta), bias);
+  int index = 0;
+
+  for (; index + 16 <= n; index += 16) {
+    __m256i block = _mm256_xor_si256(
+        _mm256_loadu_si256((const __m256i *)&deltas[index]), bias);
+    unsigned greater =
+        (unsigned)_mm256_movemask_epi8(_mm256_cmpgt_epi16(block, probe));
+    if (greater != 0) {
+      return index + __builtin_ctz(greater) / 2;
+    }
+  }
+  return index + count_deltas16_scalar(deltas + index, n - index, delta);
+}
+
+__attribute__((target("avx2"))) static int
+count_deltas32_avx2(const uint32_t *deltas, int n, uint32_t delta) {
+  const __m256i bias = _mm256_set1_epi32((int)0x80000000u);
+  const __m256i probe = _mm256_xor_si256(_mm256_set1_epi32((int)delta), bias);
+  int index = 0;
+
+  for (; index + 8 <= n; index += 8) {
+    __m256i block = _mm256_xor_si256(
+        _mm256_loadu_si256((const __m256i *)&deltas[index]), bias);
+    int greater = _mm256_movemask_ps(
+        _mm256_castsi256_ps(_mm256_cmpgt_epi32(block, probe)));
+    if (greater != 0) {
+      return index + __builtin_ctz(greater);
+    }
+  }
+  return index + count_deltas32_scalar(deltas + index, n - index, delta);
+}
+
+static const search_kernels_t avx2_kernels = {
+    count_entry_keys_avx2, find_entry_child_avx2, find_packed_child_avx2,
+    count_keys_below_avx2, count_deltas16_avx2, count_deltas32_avx2};
+#endif
+
+static const search_kernels_t *kernels = NULL;
+
+/**
+ * @brief pick the kernels for this CPU on the first search. The store of the
+ * pointer is idempotent, so racing callers are harmless.
+ */
+static const search_kernels_t *get_search_kernels(void) {
+  if (kernels != NULL) {
+    return kernels;
+  }
+
+  const search_kernels_t *selected = &scalar_kernels;
+#ifdef SEARCH_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    selected = &avx2_kernels;
+  } else if (__builtin_cpu_supports("sse4.2")) {
+    selected = &sse42_kernels;
+  }
+#endif
+  kernels = selected;
+  return kernels;
+}
+
+static int search_legacy_entries(const legacy_internal_page_t *page,
+                                 int64_t key) {
+  int low = 0;
+  int high = page->num_of_keys;
+
+  // entries[0, low) <= key < entries[high, num_of_keys)
+  while (high - low > SEARCH_WINDOW) {
+    int mid = low + (high - low) / 2;
+    if (page->entries[mid].key <= key) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+  return low + get_search_kernels()->count_entry_keys(page->entries + low,
+                                                      high - low, key);
+}
+
+static int search_deltas16(const uint16_t *deltas, int n, uint16_t delta) {
+  int low = 0;
+  int high = n;
+
+  while (high - low > SEARCH_WINDOW) {
+    int mid = low + (high - low) / 2;
+    if (deltas[mid] <= delta) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+  return low + get_search_kernels()->count_deltas16(deltas + low, high - low,
+                                                    delta);
+}
+
+static int search_deltas32(const uint32_t *deltas, int n, uint32_t delta) {
+  int low = 0;
+  int high = n;
+
+  while (high - low > SEARCH_WINDOW) {
+    int mid = low + (high - low) / 2;
+    if (deltas[mid] <= delta) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+  return low + get_search_kernels()->count_deltas32(deltas + low, high - low,
+                                                    delta);
+}
+
+static int search_deltas64(const uint64_t *deltas, int n, uint64_t delta) {
+  int low = 0;
+  int high = n;
+
+  while (low < high) {
+    int mid = low + (high - low) / 2;
+    if (deltas[mid] <= delta) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+  return low;
+}
+
+/**
+ * @brief Returns how many separator keys of the internal page are less than or
+ * equal to key. 0 means the key belongs to one_more_page_num, i (> 0) means it
+ * belongs to the child of entry i - 1
+ */
+int search_internal_key(const internal_page_t *page, int64_t key) {
+  if (page->format == INTERNAL_FORMAT_ENTRIES) {
+    return search_legacy_entries((const legacy_internal_page_t *)page, key);
+  }
+
+  int n = page->num_of_keys;
+  if (n == 0 || key < page->base_key) {
+    return 0;
+  }
+
+  // every delta of the page is within key_width, a larger one is past all
+  uint64_t delta = (uint64_t)key - (uint64_t)page->base_key;
+  switch (page->key_width) {
+  case sizeof(uint16_t):
+    if (delta > UINT16_MAX) {
+      return n;
+    }
+    return search_deltas16(page->deltas16, n, (uint16_t)delta);
+  case sizeof(uint32_t):
+    if (delta > UINT32_MAX) {
+      return n;
+    }
+    return search_deltas32(page->deltas32, n, (uint32_t)delta);
+  default:
+    return search_deltas64(page->deltas64, n, delta);
+  }
+}
+
+/**
+ * @brief Returns the index of the entry pointing to child, -1 if child is
+ * one_more_page_num and -2 if the page does not point to child at all
+ */
+int search_internal_child(const internal_page_t *page, pagenum_t child) {
+  if (page->one_more_page_num == child) {
+    return -1;
+  }
+
+  if (page->format == INTERNAL_FORMAT_ENTRIES) {
+    int index = get_search_kernels()->find_entry_child(
+        ((const legacy_internal_page_t *)page)->entries, page->num_of_keys,
+        child);
+    return index < 0 ? -2 : index;
+  }
+
+  // little-endian bytes of child in the width of the page, wider is absent
+  int width = page->page_num_width;
+  uint8_t child_bytes[sizeof(pagenum_t)];
+  for (int b = 0; b < (int)sizeof(pagenum_t); b++) {
+    child_bytes[b] = (uint8_t)(child >> (8 * b));
+    if (b >= width && child_bytes[b] != 0) {
+      return -2;
+    }
+  }
+
+  const uint8_t *bytes =
+      (const uint8_t *)(page->body + page->num_of_keys * page->key_width);
+  int index = get_search_kernels()->find_packed_child(bytes, page->num_of_keys,
+                                                      width, child_bytes);
+  return index < 0 ? -2 : index;
+}
+
+/**
+ * @brief Returns the first index whose key is not less than key in a sorted
+ * array of n keys (n if every key is smaller)
+ */
+int search_sorted_keys(const int64_t *keys, int n, int64_t key) {
+  int low = 0;
+  int high = n;
+
+  while (high - low > SEARCH_WINDOW) {
+    int mid = low + (high - low) / 2;
+    if (keys[mid] < key) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+  return low +
+         get_search_kernels()->count_keys_below(keys + low, high - low, key);
+}
@@ -119,6 +119,8 @@ void usage(void) {
   printf("  r <k1> <k2>    Print all keys and values in range [min(k1,k2) ... "
          "max(k1,k2)] (max range is 10000)\n");
   printf("  t              Print the entire B+ tree structure\n");
+  printf("  s              Print what the engine did since the table was "
+         "opened and how long it took, by operation\n");
   printf("  q              Quit the program (closes the current table)\n");
   printf("  ?              Show this help message\n\n");
   printf("> ");
@@ -0,0 +1,96 @@
+#include "bpt.h"
+#include "bpt_internal.h"
+#include "vlog.h"
+
+// VALUE LOG GARBAGE COLLECTION
+
+/* Records are collected from the tail of the value log. A record is live if
+ * the leaf slot of its key still references its offset: the value is appended
+ * again and the slot is pointed at the copy. Dead records are skipped. The
+ * tail then moves past the collected range and its space is released.
+ */
+
+/**
+ * @brief Returns true if enough of the value log is dead to be worth a pass
+ */
+bool value_log_needs_gc(void) {
+  if (!vlog_is_open()) {
+    return false;
+  }
+
+  uint64_t size = vlog_head() - vlog_tail();
+  uint64_t garbage = vlog_garbage();
+  return garbage >= VLOG_GC_MIN_GARBAGE && garbage * 2 >= size;
+}
+
+/**
+ * @brief move the value of the record at offset to the head of the log if the
+ * tree still references it. Returns true if the record was live
+ */
+static bool relocate_vlog_record(uint64_t offset, const vlog_record_t *record) {
+  pagenum_t leaf_num = find_leaf(record->key);
+  if (leaf_num == PAGE_NULL) {
+    return false;
+  }
+
+  page_t *leaf_buf = alloc_page_buf();
+  file_read_page(leaf_num, leaf_buf);
+  leaf_page_t *leaf = (leaf_page_t *)leaf_buf;
+
+  int index = leaf_find_key(leaf, record->key);
+  leaf_slot_t slot;
+  vlog_ref_t ref;
+  if (index >= 0) {
+    leaf_read_slot(leaf, index, &slot);
+    memcpy(&ref, slot.payload, sizeof(vlog_ref_t));
+  }
+  if (index < 0 || slot.code != LEAF_VALUE_VLOG || ref.offset != offset) {
+    free_page_buf(leaf_buf);
+    return false;
+  }
+
+  char *value = (char *)malloc(record->length);
+  if (value == NULL) {
+    perror("Memory allocation for value log record failed.");
+    exit(EXIT_FAILURE);
+  }
+  vlog_read_value(offset, value, record->length);
+  ref.offset = vlog_append(record->key, value, record->length);
+  free(value);
+
+  // same size, so the slot is rewritten in place
+  memcpy(slot.payload, &ref, sizeof(vlog_ref_t));
+  leaf_remove_record(leaf, index);
+  leaf_insert_slot(leaf, index, &slot);
+  file_write_page(leaf_num, leaf_buf);
+  free_page_buf(leaf_buf);
+  return true;
+
+}
+
+/**
+ * @brief collect records from the tail of the value log until about budget
+ * bytes were scanned. Returns the number of bytes the tail moved
+ */
+uint64_t collect_value_log(uint64_t budget) {
+  const uint64_t tail = vlog_tail();
+  const uint64_t head = vlog_head();
+  uint64_t offset = tail;
+  uint64_t garbage = 0;
+
+  while (offset < head && offset - tail < budget) {
+    vlog_record_t record;
+    vlog_read_record(offset, &record);
+    uint64_t size = sizeof(vlog_record_t) + record.length;
+
+    if (!relocate_vlog_record(offset, &record)) {
+      garbage += size;
+    }
+    offset += size;
+  }
+
+  if (offset != tail) {
+    vlog_advance_tail(offset, garbage);
+  }
+  return offset - tail;
+}
@@ -0,0 +1,187 @@
+#include "codec.h"
+#include <stdint.h>
+#include <string.h>
+
+#define HASH_BITS 12
+#define HASH_SIZE (1 << HASH_BITS)
+#define LENGTH_MASK 15
+
+static uint32_t read32(const char *p) {
+  uint32_t value;
+  memcpy(&value, p, sizeof(value));
+  return value;
+}
+
+static uint32_t hash32(uint32_t value) {
+  return (value * 2654435761u) >> (32 - HASH_BITS);
+}
+
+/**
+ * @brief write the extra bytes of a length that did not fit in its nibble
+ * and return the new output position, or capacity + 1 if dest is full
+ */
+static size_t put_length(char *dest, size_t op, size_t capacity,
+                         size_t length) {
+  length -= LENGTH_MASK;
+  while (length >= 255) {
+    if (op >= capacity) {
+      return capacity + 1;
+    }
+    dest[op++] = (char)255;
+    length -= 255;
+  }
+  if (op >= capacity) {
+    return capacity + 1;
+  }
+  dest[op++] = (char)length;
+  return op;
+}
+
+/**
+ * @brief append one sequence; match_length 0 marks the last one
+ */
+static size_t put_sequence(char *dest, size_t op, size_t capacity,
+                           const char *literals, size_t literal_length,
+                           size_t offset, size_t match_length) {
+  if (op >= capacity) {
+    return capacity + 1;
+  }
+  size_t token_pos = op++;
+  size_t match_code = match_length > 0 ? match_length - CODEC_MIN_MATCH : 0;
+  uint8_t token =
+      (uint8_t)(((literal_length < LENGTH_MASK ? literal_length : LENGTH_MASK)
+                 << 4) |
+                (match_code < LENGTH_MASK ? match_code : LENGTH_MASK));
+  dest[token_pos] = (char)token;
+
+  if (literal_length >= LENGTH_MASK) {
+    op = put_length(dest, op, capacity, literal_length);
+  }
+  if (op > capacity || capacity - op < literal_length) {
+    return capacity + 1;
+  }
+  memcpy(dest + op, literals, literal_length);
+  op += literal_length;
+
+  if (match_length == 0) {
+    return op;
+  }
+  if (capacity - op < 2) {
+    return capacity + 1;
+  }
+  dest[op++] = (char)(offset & 0xFF);
+  dest[op++] = (char)(offset >> 8);
+  if (match_code >= LENGTH_MASK) {
+    op = put_length(dest, op, capacity, match_code);
+  }
+  return op;
+}
+
+size_t codec_compress(const char *src, size_t length, char *dest,
+                      size_t capacity) {
+  uint32_t table[HASH_SIZE]; // position + 1 of the last 4 bytes per hash
+  memset(table, 0, sizeof(table));
+
+  size_t anchor = 0;
+  size_t ip = 0;
+  size_t op = 0;
+
+  while (ip + CODEC_MIN_MATCH <= length) {
+    uint32_t sequence = read32(src + ip);
+    uint32_t h = hash32(sequence);
+    size_t candidate = table[h];
+    table[h] = (uint32_t)ip + 1;
+
+    if (candidate == 0 || ip - (candidate - 1) > CODEC_MAX_OFFSET ||
+        read32(src + candidate - 1) != sequence) {
+      ip++;
+      continue;
+    }
+    candidate--;
+
+    size_t match_length = CODEC_MIN_MATCH;
+    while (ip + match_length < length &&
+           src[candidate + match_length] == src[ip + match_length]) {
+      match_length++;
+    }
+
+    op = put_sequence(dest, op, capacity, src + anchor, ip - anchor,
+                      ip - candidate, match_length);
+    if (op > capacity) {
+      return 0;
+    }
+    ip += match_length;
+    anchor = ip;
+  }
+
+  op = put_sequence(dest, op, capacity, src + anchor, length - anchor, 0, 0);
+  return op > capacity ? 0 : op;
+}
+
+/**
+ * @brief read the extra bytes of a length, -1 if src ends first
+ */
+static long get_length(const char *src, size_t length, size_t *ip) {
+  long value = LENGTH_MASK;
+  uint8_t byte;
+  do {
+    if (*ip >= length) {
+      return -1;
+    }
+    byte = (uint8_t)src[(*ip)++];
+    value += byte;
+  } while (byte == 255);
+  return value;
+}
+
+long codec_decompress(const char *src, size_t length, char *dest,
+                      size_t capacity) {
+  size_t ip = 0;
+  size_t op = 0;
+
+  while (ip < length) {
+    uint8_t token = (uint8_t)src[ip++];
+
+    long literal_length = token >> 4;
+    if (literal_length == LENGTH_MASK &&
+        (literal_length = get_length(src, length, &ip)) < 0) {
+      return -1;
+    }
+    if ((size_t)literal_length > length - ip ||
+        (size_t)literal_length > capacity - op) {
+      return -1;
+    }
+    memcpy(dest + op, src + ip, literal_length);
+    ip += literal_length;
+    op += literal_length;
+
+    // the last sequence has no match
+    if (ip == length) {
+      break;
+    }
+
+    if (length - ip < 2) {
+      return -1;
+    }
+    size_t offset = (uint8_t)src[ip] | ((size_t)(uint8_t)src[ip + 1] << 8);
+    ip += 2;
+    if (offset == 0 || offset > op) {
+      return -1;
+    }
+
+    long match_length = token & LENGTH_MASK;
+    if (match_length == LENGTH_MASK &&
+        (match_length = get_length(src, length, &ip)) < 0) {
+      return -1;
+    }
+    match_length += CODEC_MIN_MATCH;
+    if ((size_t)match_length > capacity - op) {
+      return -1;
+    }
+    // byte by byte, a match may overlap the bytes it produces
+    for (long i = 0; i < match_length; i++, op++) {
+      dest[op] = dest[op - offset];
+    }
+  }
+  return (long)op;
+}
@@ -1,9 +1,164 @@
 #include "db_api.h"
 #include "bpt.h"
+#include "bpt_internal.h"
+#include "stats.h"
+#include "vlog.h"
+#include <limits.h>
+#include <sched.h>
+#include <pthread.h>
+#include <time.h>
 
 extern int fd;
 int global_table_id = -1;
 
+/* Every API call holds table_lock. The maintenance thread takes it between
+ * calls to do background work on the open table (value log collection,
+ * deferred merges, tombstone sweeps and leaf defragmentation).
+ */
+static pthread_mutex_t table_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t maintenance_cond = PTHREAD_COND_INITIALIZER;
+static pthread_t maintenance_thread;
+static bool maintenance_running = false;
+static uint32_t defrag_rate = 0; // leaves per second, 0 means off
+
+#define MAINTENANCE_INTERVAL_MS 100
+#define VLOG_SUFFIX ".vlog"
+#define PAGE_MAP_SUFFIX ".pagemap"
+
+static void *maintenance_main(void *arg) {
+  // defragmentation earns defrag_rate leaves per 1000 ms; the credit, in
+  // leaves times milliseconds, keeps the fractions of a leaf between ticks
+  uint64_t defrag_credit = 0;
+  uint64_t credited_ns = stats_clock();
+
+  pthread_mutex_lock(&table_lock);
+  while (maintenance_running) {
+    // a call is timed only when there is work, an idle wakeup is not one
+    if (value_log_needs_gc()) {
+      stats_begin(STAT_OP_MAINTENANCE);
+      collect_value_log(VLOG_GC_STEP_BYTES);
+      stats_end();
+      // let waiting API calls in between steps
+      pthread_mutex_unlock(&table_lock);
+      sched_yield();
+      pthread_mutex_lock(&table_lock);
+      continue;
+    }
+    if (deferred_merges() > 0) {
+      stats_begin(STAT_OP_MAINTENANCE);
+      rebalance_deferred(DEFERRED_MERGE_BATCH);
+      stats_end();
+      pthread_mutex_unlock(&table_lock);
+      sched_yield();
+      pthread_mutex_lock(&table_lock);
+      continue;
+    }
+    if (defrag_rate > 0) {
+      uint64_t elapsed_ms = (stats_clock() - credited_ns) / 1000000;
+      credited_ns += elapsed_ms * 1000000;
+      defrag_credit += (uint64_t)defrag_rate * elapsed_ms;
+      // no more than a second's worth after the thread was kept busy
+      if (defrag_credit > (uint64_t)defrag_rate * 1000) {
+        defrag_credit = (uint64_t)defrag_rate * 1000;
+      }
+      uint64_t budget = defrag_credit / 1000;
+      if (budget > 0) {
+        defrag_credit -= budget * 1000;
+        stats_begin(STAT_OP_MAINTENANCE);
+        defragment_leaves(budget > INT_MAX ? INT_MAX : (int)budget);
+        stats_end();
+      }
+    }
+
+
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_nsec += MAINTENANCE_INTERVAL_MS * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+      deadline.tv_sec++;
+      deadline.tv_nsec -= 1000000000L;
+    }
+    pthread_cond_timedwait(&maintenance_cond, &table_lock, &deadline);
+  }
+  pthread_mutex_unlock(&table_lock);
+  return NULL;
+}
+
+static int start_maintenance(void) {
+  maintenance_running = true;
+  if (pthread_create(&maintenance_thread, NULL, maintenance_main, NULL) != 0) {
+    maintenance_running = false;
+    return FAILURE;
+  }
+  return SUCCESS;
+}
+
+static void stop_maintenance(void) {
+  if (!maintenance_running) {
+    return;
+  }
+  pthread_mutex_lock(&table_lock);
+  maintenance_running = false;
+  pthread_cond_signal(&maintenance_cond);
+  pthread_mutex_unlock(&table_lock);
+  pthread_join(maintenance_thread, NULL);
+}
+
+/**
+ * @brief take the table lock for an API call of kind op, timing the call from
+ * before the wait
+ */
+static void lock_table(stat_op_t op) {
+  uint64_t since = stats_clock();
+  pthread_mutex_lock(&table_lock);
+  stats_begin(op);
+  stats_waited(since);
+}
+
+static void unlock_table(void) {
+  stats_end();
+  pthread_mutex_unlock(&table_lock);
+}
+
+/**
+ * @brief ‘pathname’ followed by suffix, the caller frees it
+ */
+static char *sidecar_pathname(const char *pathname, const char *suffix) {
+  size_t length = strlen(pathname) + strlen(suffix) + 1;
+  char *sidecar = (char *)malloc(length);
+  if (sidecar != NULL) {
+    snprintf(sidecar, length, "%s%s", pathname, suffix);
+  }
+  return sidecar;
+}
+
+static int open_value_log(const char *pathname) {
+  char *vlog_pathname = sidecar_pathname(pathname, VLOG_SUFFIX);
+  if (vlog_pathname == NULL) {
+    return FAILURE;
+  }
+
+  int result = vlog_open(vlog_pathname) == 0 ? SUCCESS : FAILURE;
+  free(vlog_pathname);
+  return result;
+}
+
+static int open_page_map(const char *pathname) {
+  char *map_pathname = sidecar_pathname(pathname, PAGE_MAP_SUFFIX);
+  if (map_pathname == NULL) {
+    return FAILURE;
+  }
+
+  int result = file_enable_compression(map_pathname) == 0 ? SUCCESS : FAILURE;
+  free(map_pathname);
+  return result;
+}
+
+static bool valid_page_size(uint32_t size) {
+  return size >= MIN_PAGE_SIZE && size <= MAX_PAGE_SIZE &&
+         (size & (size - 1)) == 0;
+}
+
 /**
  * @brief Open existing data file using ‘pathname’ or create one if not existed
  • If success, return the table id,
@@ -11,6 +166,39 @@ int global_table_id = -1;
  * Otherwise, return negative value
  */
 int open_table(char *pathname) {
+  return open_table_with_options(pathname, NULL);
+}
+
+/**
+ * @brief open_table with options, NULL means the defaults
+ * A table opened once with value_log keeps using its value log
+ * (‘pathname’.vlog) whenever it is opened again.
+ * compress_pages and page_size only apply to a table being created; they are
+ * kept for the life of the file, along with the page map
+ * (‘pathname’.pagemap) of a compressed table. append_fill_factor,
+ * merge_threshold, defer_merges, lazy_deletes and defrag_rate apply while the
+ * table is open.
+ */
+int open_table_with_options(char *pathname, const table_options_t *options) {
+  uint32_t fill_factor = DEFAULT_APPEND_FILL_FACTOR;
+  if (options != NULL && options->append_fill_factor != 0) {
+    fill_factor = options->append_fill_factor;
+    if (fill_factor < SPLIT_FILL_FACTOR || fill_factor > 100) {
+      return FAILURE;
+    }
+  }
+  uint32_t threshold = MIN_KEYS;
+  if (options != NULL && options->merge_threshold != 0) {
+    threshold = options->merge_threshold;
+  }
+  bool deferred = options != NULL && options->defer_merges;
+  bool lazy = options != NULL && options->lazy_deletes;
+  uint32_t rate = options != NULL ? options->defrag_rate : 0;
+  if (rate > INT32_MAX / MAINTENANCE_INTERVAL_MS) {
+    return FAILURE;
+  }
+
+  stats_reset();
   mode_t mode = 0644;
   if ((fd = open(pathname, O_RDWR | O_CREAT, mode)) == -1) {
     return FAILURE;
@@ -19,12 +207,98 @@ int open_table(char *pathname) {
   // setup metadata (header_page)
   struct stat stat_buf;
   if (fstat(fd, &stat_buf) == -1) {
+    close(fd);
     return FAILURE;
   }
-  if (stat_buf.st_size == 0) {
+  bool created = stat_buf.st_size == 0;
+  if (created) {
+    page_size = DEFAULT_PAGE_SIZE;
+    if (options != NULL && options->page_size != 0) {
+      if (!valid_page_size(options->page_size)) {
+        close(fd);
+        return FAILURE;
+      }
+      page_size = options->page_size;
+    }
     init_header_page();
   }
 
+  // the header page fits in the smallest page whatever the page size is
+  page_t *header_buf = alloc_page_buf();
+  page_size = MIN_PAGE_SIZE;
+  file_read_page(HEADER_PAGE_POS, header_buf);
+
+  header_page_t *header_page = (header_page_t *)header_buf;
+  page_size =
+      header_page->page_size ? header_page->page_size : LEGACY_PAGE_SIZE;
+
+  // files of an older format are read as is; their leaves are converted
+  // when rewritten, so mark the file as holding the current format
+  // a page refilled up to the threshold must leave its neighbor as many keys
+  if (header_page->version > FORMAT_VERSION || !valid_page_size(page_size) ||
+      threshold > RECORD_CNT / 2 || threshold > (ENTRY_CNT - 1) / 2) {
+    free_page_buf(header_buf);
+    page_size = DEFAULT_PAGE_SIZE;
+    close(fd);
+    return FAILURE;
+  }
+
+  uint32_t flags = header_page->flags;
+  if (options != NULL && options->value_log) {
+    flags |= HEADER_FLAG_VALUE_LOG;
+  }
+  if (created && options != NULL && options->compress_pages) {
+    flags |= HEADER_FLAG_COMPRESSED;
+  }
+  if (header_page->version < FORMAT_VERSION || header_page->flags != flags) {
+    // written back at the page size of the table, zero past the smallest page
+    page_t *page_buf = alloc_page_buf();
+    memset(page_buf, 0, page_size);
+    memcpy(page_buf, header_buf, MIN_PAGE_SIZE);
+    header_page = (header_page_t *)page_buf;
+    header_page->version = FORMAT_VERSION;
+    header_page->flags = flags;
+    header_page->page_size = page_size;
+    file_write_page(HEADER_PAGE_POS, page_buf);
+    free_page_buf(page_buf);
+  }
+  free_page_buf(header_buf);
+
+
+  if (flags & HEADER_FLAG_COMPRESSED) {
+    if (open_page_map(pathname) != SUCCESS) {
+      file_disable_compression();
+      close(fd);
+      return FAILURE;
+    }
+  }
+
+  if (flags & HEADER_FLAG_VALUE_LOG) {
+    if (open_value_log(pathname) != SUCCESS) {
+      file_disable_compression();
+      close(fd);
+      return FAILURE;
+    }
+  }
+
+  append_fill_factor = fill_factor;
+  merge_threshold = (int)threshold;
+  defer_merges = deferred;
+  lazy_deletes = lazy;
+  defrag_rate = (flags & HEADER_FLAG_COMPRESSED) ? 0 : rate;
+  forget_deferred_merges();
+  reset_defragmentation();
+  forget_rightmost_leaf();
+  bump_smo_epoch();
+
+  if ((flags & HEADER_FLAG_VALUE_LOG) || deferred || lazy || defrag_rate > 0) {
+    if (start_maintenance() != SUCCESS) {
+      vlog_close();
+      file_disable_compression();
+      close(fd);
+      return FAILURE;
+    }
+  }
   global_table_id = 0;
   return global_table_id; // 추후에 table_id는 구현할 기능
 }
@@ -35,38 +309,174 @@ int open_table(char *pathname) {
  * Otherwise, return non-zero value
  */
 int db_insert(int64_t key, char *value) {
+  lock_table(STAT_OP_INSERT);
   int result = insert(key, value);
+  unlock_table();
   if (result == SUCCESS) {
     return SUCCESS;
   }
   return result;
 }
 
+/**
+ * @brief  Insert input ‘key/value’ (record), or overwrite the value if ‘key’
+ * already exists.
+ * If success, return 0
+ * Otherwise, return non-zero value
+ */
+int db_upsert(int64_t key, char *value) {
+  lock_table(STAT_OP_INSERT);
+  int result = upsert(key, value);
+  unlock_table();
+  return result;
+}
+
+/**
+ * @brief  Replace the value of an existing ‘key’. Only the leaf is rewritten
+ * unless the new value does not fit in it.
+ * If success, return 0
+ * Otherwise, return non-zero value
+ */
+int db_update(int64_t key, char *value) {
+  lock_table(STAT_OP_UPDATE);
+  int result = update(key, value);
+  unlock_table();
+  return result;
+}
+
+/**
+ * @brief  Replace the value of ‘key’ only if it equals ‘expected’.
+ * If swapped, return 0
+ * If the value differs, return VALUE_MISMATCH
+ * Otherwise, return non-zero value
+ */
+int db_compare_and_swap(int64_t key, const char *expected, char *value) {
+  lock_table(STAT_OP_UPDATE);
+  int result = compare_and_swap(key, expected, value);
+  unlock_table();
+  return result;
+}
+
+/**
+ * @brief  Read, modify and write back the value of ‘key’ while the table is
+ * locked, see value_modifier_t.
+ * If success, return 0
+ * Otherwise, return non-zero value
+ */
+int db_modify(int64_t key, value_modifier_t modifier, void *arg) {
+  lock_table(STAT_OP_UPDATE);
+  int result = modify(key, modifier, arg);
+  unlock_table();
+  return result;
+}
+
 /**
  * @brief Find the record containing input key
  * If found matching ‘key’, store matched ‘value’ string in ret_val and return 0
  * Otherwise, return non zero value
- * Memory allocation for ret_val should occur in caller
+ * Memory allocation for ret_val (VALUE_SIZE bytes) should occur in caller,
+ * longer values are cut, see db_find_value
  */
 int db_find(int64_t key, char *ret_val) {
-  if (find(key, ret_val) == SUCCESS) {
+  lock_table(STAT_OP_FIND);
+  int result = find(key, ret_val);
+  unlock_table();
+  if (result == SUCCESS) {
     return SUCCESS;
   }
   return FAILURE;
 }
 
+/**
+ * @brief Find the record containing input key, for values of any length
+ * If found, store at most size - 1 bytes of the value in ret_val, the full
+ * length of the value in value_size (if not NULL) and return 0
+ * Otherwise, return non zero value
+ */
+int db_find_value(int64_t key, char *ret_val, size_t size,
+                  size_t *value_size) {
+  lock_table(STAT_OP_FIND);
+  int result = find_value(key, ret_val, size, value_size);
+  unlock_table();
+  if (result == SUCCESS) {
+    return SUCCESS;
+  }
+  return FAILURE;
+}
+
+/**
+ * @brief Find the keys of the records with ‘key_start’ <= key <= ‘key_end’
+ * and store them in order in keys, which holds key_end - key_start + 1 keys
+ * at most. The range spans MAX_RANGE_SIZE keys at most
+ * Return the number of keys found, or -1 if the range is too wide
+ */
+int db_find_range(int64_t key_start, int64_t key_end, int64_t keys[]) {
+  if (key_start <= key_end &&
+      (uint64_t)key_end - (uint64_t)key_start >= MAX_RANGE_SIZE) {
+    return -1;
+  }
+  pagenum_t pages[MAX_RANGE_SIZE];
+  int indices[MAX_RANGE_SIZE];
+
+  lock_table(STAT_OP_RANGE);
+  int result = find_range(key_start, key_end, keys, pages, indices);
+  unlock_table();
+  return result;
+}
+
 /**
  * @brief Find the matching record and delete it if found
  * If success, return 0. Otherwise, return non-zero value
  */
 int db_delete(int64_t key) {
+  lock_table(STAT_OP_DELETE);
   int result = delete (key);
+  unlock_table();
   if (result == SUCCESS) {
     return SUCCESS;
   }
   return FAILURE;
 }
 
+/**
+ * @brief Delete the matching record and copy its value like db_find_value.
+ * ret_val and value_size may be NULL
+ * If success, return 0. Otherwise, return non-zero value
+ */
+int db_delete_value(int64_t key, char *ret_val, size_t size,
+                    size_t *value_size) {
+  lock_table(STAT_OP_DELETE);
+  int result = delete_value(key, ret_val, size, value_size);
+  unlock_table();
+  return result;
+}
+
+/**
+ * @brief Delete every record with ‘start’ <= key <= ‘end’
+ * Return the number of deleted records
+ */
+int64_t db_delete_range(int64_t start, int64_t end) {
+  lock_table(STAT_OP_DELETE);
+  int64_t result = delete_range(start, end);
+  unlock_table();
+  return result;
+}
+
+/**
+ * @brief Delete every record. The data file is cut back to its header page
+ * and the value log is emptied, without visiting the records
+ * If success, return 0. Otherwise, return non-zero value
+ */
+int db_truncate(void) {
+  if (global_table_id < 0) {
+    return FAILURE;
+  }
+  lock_table(STAT_OP_OTHER);
+  destroy_tree();
+  unlock_table();
+  return SUCCESS;
+}
+
 /**
  * NOT NECESSARY-------------------
  */
@@ -76,7 +486,9 @@ void db_print_tree(void) {
     printf("table not open\n");
     return;
   }
+  lock_table(STAT_OP_OTHER);
   print_tree();
+  unlock_table();
 }
 
 void db_print_leaves(void) {
@@ -84,7 +496,19 @@ void db_print_leaves(void) {
     printf("table not open\n");
     return;
   }
+  lock_table(STAT_OP_OTHER);
   print_leaves();
+  unlock_table();
+}
+
+void db_print_latency(void) {
+  if (global_table_id < 0) {
+    printf("table not open\n");
+    return;
+  }
+  pthread_mutex_lock(&table_lock);
+  print_latency();
+  pthread_mutex_unlock(&table_lock);
 }
 
 int db_find_and_print_range(int64_t key_start, int64_t key_end) {
@@ -92,9 +516,54 @@ int db_find_and_print_range(int64_t key_start, int64_t key_end) {
     printf("table not open\n");
     return FAILURE;
   }
-  if (find_and_print_range(key_start, key_end) != SUCCESS) {
+  lock_table(STAT_OP_RANGE);
+  int result = find_and_print_range(key_start, key_end);
+  unlock_table();
+  if (result != SUCCESS) {
+    return FAILURE;
+  }
+  return SUCCESS;
+}
+
+/**
+ * @brief Copy the counters of the open table, see db_stats_t, to stats.
+ * They start from zero when the table is opened
+ * If success, return 0. Otherwise, return non-zero value
+ */
+int db_get_stats(db_stats_t *stats) {
+  if (global_table_id < 0) {
+    return FAILURE;
+  }
+  pthread_mutex_lock(&table_lock);
+  stats_snapshot(stats);
+  pthread_mutex_unlock(&table_lock);
+  return SUCCESS;
+}
+
+/**
+ * @brief Copy the latency histogram of API calls of kind op to histogram, of
+ * whole calls for STAT_PHASE_TOTAL or else of the time they spent in phase.
+ * Read percentiles off it with latency_percentile
+ * If success, return 0. Otherwise, return non-zero value
+ */
+int db_get_latency(stat_op_t op, int phase, latency_histogram_t *histogram) {
+  if (global_table_id < 0 || op < 0 || op >= STAT_OP_CNT || phase < 0 ||
+      phase > STAT_PHASE_TOTAL) {
     return FAILURE;
-  };
+  }
+  pthread_mutex_lock(&table_lock);
+  latency_snapshot(op, phase, histogram);
+  pthread_mutex_unlock(&table_lock);
+  return SUCCESS;
+}
+
+/**
+ * @brief Start the latency histograms over, the counters are kept
+ */
+void db_reset_latency(void) {
+  pthread_mutex_lock(&table_lock);
+  latency_reset();
+  pthread_mutex_unlock(&table_lock);
 }
 
 int close_table(void) {
@@ -103,14 +572,29 @@ int close_table(void) {
     return SUCCESS;
   }
 
+  stop_maintenance();
+  stats_begin(STAT_OP_OTHER);
+  // merges and sweeps still waiting are done now, the file keeps no
+  // underfull leaves or tombstones
+  while (rebalance_deferred(DEFERRED_MERGE_BATCH) > 0) {
+  }
+
   int result = SUCCESS;
 
+  if (vlog_close() != 0) {
+    perror("cannot close value log");
+    result = FAILURE;
+  }
+
+  file_disable_compression();
+
   if (close(fd) == -1) {
     perror("cannot close fd");
     result = FAILURE;
   }
 
   global_table_id = -1;
+  stats_end();
 
   printf("table closed\n");
   return result;
@@ -1,13 +1,64 @@
 #include "file.h"
+#include "codec.h"
+#include "stats.h"
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
 
 int fd = -1; // temp file discripter
+uint32_t page_size = DEFAULT_PAGE_SIZE;
 
-off_t get_offset(pagenum_t pagenum) { return (off_t)pagenum * PAGE_SIZE; }
+// PAGE COMPRESSION
+
+/* A compressed table keeps its header page raw at offset 0 and every other
+ * page as an extent of whole sectors behind it, holding an extent_header_t and
+ * the codec output. A page that does not shrink by at least a sector is
+ * stored raw in PAGE_SECTORS sectors. Where each page lives is kept in the
+ * page map file, one map entry (sector offset << 8 | sectors) per page
+ * number. A page that changes size is written to a new extent before its map
+ * entry is switched, so a crash leaves either image in place. Decompressed
+ * pages are kept in a small direct-mapped cache.
+ */
+
+#define SECTOR_SIZE 512
+#define PAGE_SECTORS (page_size / SECTOR_SIZE)
+#define MAX_PAGE_SECTORS (MAX_PAGE_SIZE / SECTOR_SIZE)
+#define MAP_SECTORS_BITS 8
+#define MAP_SECTORS_MASK ((1 << MAP_SECTORS_BITS) - 1)
+#define PAGE_CACHE_SIZE 64
+
+typedef struct {
+  uint32_t length; // bytes of codec output
+  uint32_t reserved;
+} extent_header_t;
+
+typedef struct {
+  uint64_t *offsets;
+  size_t count;
+  size_t capacity;
+} extent_list_t;
+
+typedef struct {
+  pagenum_t page_num;
+  bool valid;
+  page_t page;
+} cached_page_t;
+
+static int map_fd = -1;
+static uint64_t *page_map;
+static pagenum_t map_size;
+static uint64_t data_end; // first sector past the last extent
+static extent_list_t free_extents[MAX_PAGE_SECTORS + 1]; // by sector count
+static cached_page_t *page_cache;
+static char *block; // one extent being read or written, page_size bytes
+
+off_t get_offset(pagenum_t pagenum) { return (off_t)pagenum * page_size; }
 
 uint32_t get_isleaf_flag(const page_t *page) {
   return *(uint32_t *)(page->data + sizeof(pagenum_t));
@@ -19,61 +70,493 @@ void handle_error(const char *msg) {
 }
 
 /**
- * @brief Allocate an on-disk page from the free page list
+ * @brief Write src over the page at pagenum of an uncompressed file, without
+ * fsync
+ */
+static void write_raw_page(pagenum_t pagenum, const page_t *src) {
+  off_t offset = get_offset(pagenum);
+
+  if (lseek(fd, offset, SEEK_SET) == (off_t)-1) {
+    handle_error("lseek error");
+  }
+
+  if (write(fd, src, page_size) != (ssize_t)page_size) {
+    handle_error("write error");
+  }
+}
+
+// PAGE PLACEMENT
+
+/* A page allocated with a hint, the page number of the node being split,
+ * is taken from the first ALLOC_SEARCH_LIMIT pages of the free page list if
+ * one lies within ALLOC_NEAR_DISTANCE pages of the hint, so siblings stay
+ * close in the file. When the free page list is empty the file grows by an
+ * extent of ALLOC_EXTENT_PAGES pages instead of one; the page after the first
+ * heads the free page list, so the next splits around here find their pages
+ * right behind it. Compressed tables place pages through the page map and
+ * take the head of the free page list.
+ */
+
+#define ALLOC_SEARCH_LIMIT 8
+#define ALLOC_NEAR_DISTANCE 64
+#define ALLOC_EXTENT_PAGES 8
+
+/**
+ * @brief put the pages of a new extent after its first page on the free page
+ * list in file order. They are linked in memory and written with one write
+ * and one fsync, before the header that links them is written
+ */
+static void preallocate_extent(header_page_t *header, pagenum_t first_num) {
+  const int count = ALLOC_EXTENT_PAGES - 1;
+  char *pages = (char *)calloc(count, page_size);
+  if (pages == NULL) {
+    handle_error("extent allocation error");
+  }
+  for (int i = 0; i < count; i++) {
+    free_page_t *free_page = (free_page_t *)(pages + (size_t)i * page_size);
+    free_page->next_free_page_num =
+        i + 1 < count ? first_num + 2 + i : header->free_page_num;
+  }
+
+  stats_add(STAT_PAGE_WRITES, count);
+  size_t size = (size_t)count * page_size;
+  if (pwrite(fd, pages, size, get_offset(first_num + 1)) != (ssize_t)size) {
+    handle_error("write error");
+  }
+  if (stats_fsync(fd) != 0) {
+    handle_error("fsync error");
+  }
+  free(pages);
+
+  header->free_page_num = first_num + 1;
+  header->num_of_pages = first_num + ALLOC_EXTENT_PAGES;
+}
+
+/**
+ * @brief Allocate an on-disk page from the free page list, close to hint
+ * unless it is PAGE_NULL
  */
-pagenum_t file_alloc_page() {
-  header_page_t header;
-  free_page_t free_page;
+pagenum_t file_alloc_page(pagenum_t hint) {
+  page_t *header_buf = alloc_page_buf();
+  page_t *free_buf = alloc_page_buf();
+  header_page_t *header = (header_page_t *)header_buf;
+  free_page_t *free_page = (free_page_t *)free_buf;
   pagenum_t allocated_page_num;
 
-  file_read_page(HEADER_PAGE_POS, (page_t *)&header);
-  allocated_page_num = header.free_page_num;
+  stats_add(STAT_PAGE_ALLOCS, 1);
+
+  file_read_page(HEADER_PAGE_POS, header_buf);
+  allocated_page_num = header->free_page_num;
 
   if (allocated_page_num == PAGE_NULL) {
-    pagenum_t new_page_num = header.num_of_pages;
-    header.num_of_pages += 1;
-    file_write_page(HEADER_PAGE_POS, (page_t *)&header);
+    pagenum_t new_page_num = header->num_of_pages;
+    if (hint != PAGE_NULL && map_fd < 0) {
+      preallocate_extent(header, new_page_num);
+    } else {
+      header->num_of_pages += 1;
+    }
+    file_write_page(HEADER_PAGE_POS, header_buf);
 
+    free_page_buf(header_buf);
+    free_page_buf(free_buf);
     return new_page_num;
   }
 
-  file_read_page(allocated_page_num, (page_t *)&free_page);
-  header.free_page_num = free_page.next_free_page_num;
-  file_write_page(HEADER_PAGE_POS, (page_t *)&header);
+  if (hint != PAGE_NULL && map_fd < 0) {
+    // the free page nearest to hint among the first few, and the one before
+    pagenum_t prev_num = PAGE_NULL, best_prev_num = PAGE_NULL;
+    pagenum_t best_num = PAGE_NULL, best_next_num = PAGE_NULL;
+    pagenum_t best_distance = ALLOC_NEAR_DISTANCE + 1;
+    pagenum_t page_num = header->free_page_num;
+    for (int i = 0; i < ALLOC_SEARCH_LIMIT && page_num != PAGE_NULL; i++) {
+      file_read_page(page_num, free_buf);
+      pagenum_t distance = page_num > hint ? page_num - hint : hint - page_num;
+      if (distance < best_distance) {
+        best_distance = distance;
+        best_num = page_num;
+        best_prev_num = prev_num;
+        best_next_num = free_page->next_free_page_num;
+      }
+      prev_num = page_num;
+      page_num = free_page->next_free_page_num;
+    }
 
+    // unlink it, the head of the list is taken below like any other
+    if (best_num != PAGE_NULL && best_prev_num != PAGE_NULL) {
+      file_read_page(best_prev_num, free_buf);
+      free_page->next_free_page_num = best_next_num;
+      file_write_page(best_prev_num, free_buf);
+      free_page_buf(header_buf);
+      free_page_buf(free_buf);
+      return best_num;
+    }
+  }
+
+  file_read_page(allocated_page_num, free_buf);
+  header->free_page_num = free_page->next_free_page_num;
+  file_write_page(HEADER_PAGE_POS, header_buf);
+
+  free_page_buf(header_buf);
+  free_page_buf(free_buf);
   return allocated_page_num;
 }
 
+/**
+ * @brief Allocate a page past the end of the file even if the free page list
+ * has pages, so pages allocated one after another are contiguous
+ */
+pagenum_t file_alloc_page_at_end(void) {
+  stats_add(STAT_PAGE_ALLOCS, 1);
+  page_t *header_buf = alloc_page_buf();
+  header_page_t *header = (header_page_t *)header_buf;
+  file_read_page(HEADER_PAGE_POS, header_buf);
+  pagenum_t new_page_num = header->num_of_pages;
+  header->num_of_pages += 1;
+  file_write_page(HEADER_PAGE_POS, header_buf);
+  free_page_buf(header_buf);
+  return new_page_num;
+}
+
 /**
  * @brief Free an on-disk page to the free page list
  */
 void file_free_page(pagenum_t pagenum) {
-  header_page_t header;
-  page_t removing_page;
-  free_page_t new_free_page;
-  memset(&new_free_page, 0, PAGE_SIZE);
+  file_free_pages(&pagenum, 1);
+}
+
+void file_free_pages(const pagenum_t *pagenums, size_t count) {
+  if (count == 0) {
+    return;
+  }
+  stats_add(STAT_PAGE_FREES, count);
+
+  page_t *header_buf = alloc_page_buf();
+  page_t *free_buf = alloc_page_buf();
+  header_page_t *header = (header_page_t *)header_buf;
+  free_page_t *new_free_page = (free_page_t *)free_buf;
+  memset(free_buf, 0, page_size);
+
+  // 페이지들을 한 번에 프리 페이지 리스트 앞에 연결하고 헤더는 한 번만 씀.
+  // 압축하지 않은 테이블은 프리 페이지를 fsync 없이 쓰고 헤더 전에 한 번만
+  // fsync함 (압축 테이블은 페이지 맵 때문에 페이지마다 씀)
+  file_read_page(HEADER_PAGE_POS, header_buf);
+  for (size_t i = 0; i < count; i++) {
+    new_free_page->next_free_page_num = header->free_page_num;
+    header->free_page_num = pagenums[i];
+    if (map_fd >= 0) {
+      file_write_page(pagenums[i], free_buf);
+    } else {
+      stats_add(STAT_PAGE_WRITES, 1);
+      write_raw_page(pagenums[i], free_buf);
+    }
+  }
+  if (map_fd < 0 && stats_fsync(fd) != 0) {
+    handle_error("fsync error");
+  }
+  file_write_page(HEADER_PAGE_POS, header_buf);
+  free_page_buf(header_buf);
+  free_page_buf(free_buf);
+}
+
+/**
+ * @brief Drop every page but the header page. The header is written first
+ * with no root and no free pages, then the file is cut back to it
+ */
+void file_truncate(void) {
+  page_t *header_buf = alloc_page_buf();
+  header_page_t *header = (header_page_t *)header_buf;
+  file_read_page(HEADER_PAGE_POS, header_buf);
+  header->root_page_num = PAGE_NULL;
+  header->free_page_num = PAGE_NULL;
+  header->num_of_pages = HEADER_PAGE_POS + 1;
+  file_write_page(HEADER_PAGE_POS, header_buf);
+  free_page_buf(header_buf);
+
+  if (map_fd >= 0) {
+    if (ftruncate(map_fd, 0) != 0 || stats_fsync(map_fd) != 0) {
+      handle_error("page map truncate error");
+    }
+    memset(page_map, 0, map_size * sizeof(uint64_t));
+    for (int size = 0; size <= MAX_PAGE_SECTORS; size++) {
+      free_extents[size].count = 0;
+    }
+    for (int i = 0; i < PAGE_CACHE_SIZE; i++) {
+      page_cache[i].valid = false;
+    }
+    data_end = PAGE_SECTORS;
+  }
+
+  if (ftruncate(fd, get_offset(HEADER_PAGE_POS + 1)) != 0 ||
+      stats_fsync(fd) != 0) {
+    handle_error("truncate error");
+  }
+}
+
+static void push_extent(uint64_t offset, uint64_t sectors) {
+  extent_list_t *list = &free_extents[sectors];
+  if (list->count == list->capacity) {
+    size_t capacity = list->capacity ? list->capacity * 2 : 64;
+    uint64_t *offsets =
+        (uint64_t *)realloc(list->offsets, capacity * sizeof(uint64_t));
+    if (offsets == NULL) {
+      handle_error("extent list allocation error");
+    }
+    list->offsets = offsets;
+    list->capacity = capacity;
+  }
+  list->offsets[list->count++] = offset;
+}
+
+/**
+ * @brief Returns the first sector of a free extent of sectors, splitting a
+ * larger free extent or growing the file when none fits
+ */
+static uint64_t alloc_extent(uint64_t sectors) {
+  for (uint64_t size = sectors; size <= PAGE_SECTORS; size++) {
+    extent_list_t *list = &free_extents[size];
+    if (list->count == 0) {
+      continue;
+    }
+    uint64_t offset = list->offsets[--list->count];
+    if (size > sectors) {
+      push_extent(offset + sectors, size - sectors);
+    }
+    return offset;
+  }
+
+  uint64_t offset = data_end;
+  data_end += sectors;
+  return offset;
+}
+
+/**
+ * @brief hand the sectors between start and end to the free lists
+ */
+static void release_range(uint64_t start, uint64_t end) {
+  while (start < end) {
+    uint64_t sectors = end - start;
+    if (sectors > PAGE_SECTORS) {
+      sectors = PAGE_SECTORS;
+    }
+    push_extent(start, sectors);
+    start += sectors;
+  }
+}
+
+static uint64_t map_entry(pagenum_t pagenum) {
+  return pagenum < map_size ? page_map[pagenum] : 0;
+}
+
+static void set_map_entry(pagenum_t pagenum, uint64_t entry) {
+  if (pagenum >= map_size) {
+    pagenum_t size = map_size ? map_size : 64;
+    while (size <= pagenum) {
+      size *= 2;
+    }
+    uint64_t *grown = (uint64_t *)realloc(page_map, size * sizeof(uint64_t));
+    if (grown == NULL) {
+      handle_error("page map allocation error");
+    }
+    memset(grown + map_size, 0, (size - map_size) * sizeof(uint64_t));
+    page_map = grown;
+    map_size = size;
+  }
+  page_map[pagenum] = entry;
+
+  off_t offset = (off_t)pagenum * sizeof(uint64_t);
+  if (pwrite(map_fd, &entry, sizeof(uint64_t), offset) != sizeof(uint64_t)) {
+    handle_error("page map write error");
+  }
+  if (stats_fsync(map_fd) != 0) {
+    handle_error("page map fsync error");
+  }
+}
+
+static void cache_store(pagenum_t pagenum, const page_t *page) {
+  cached_page_t *slot = &page_cache[pagenum % PAGE_CACHE_SIZE];
+  slot->page_num = pagenum;
+  slot->valid = true;
+  memcpy(&slot->page, page, page_size);
+}
+
+static int compare_extents(const void *a, const void *b) {
+  uint64_t left = *(const uint64_t *)a >> MAP_SECTORS_BITS;
+  uint64_t right = *(const uint64_t *)b >> MAP_SECTORS_BITS;
+  return left < right ? -1 : left > right;
+}
+
+/**
+ * @brief Store the pages of the open file compressed, with the page map in
+ * map_pathname (created if not existed). The free extents are rebuilt from
+ * the gaps between the mapped ones.
+ * If success, return 0. Otherwise, return non-zero value
+ */
+int file_enable_compression(const char *map_pathname) {
+  if ((map_fd = open(map_pathname, O_RDWR | O_CREAT, 0644)) == -1) {
+    return -1;
+  }
+
+  struct stat stat_buf;
+  if (fstat(map_fd, &stat_buf) == -1) {
+    file_disable_compression();
+    return -1;
+  }
+
+  map_size = stat_buf.st_size / sizeof(uint64_t);
+  page_map = (uint64_t *)calloc(map_size ? map_size : 1, sizeof(uint64_t));
+  uint64_t *extents =
+      (uint64_t *)malloc((map_size ? map_size : 1) * sizeof(uint64_t));
+  page_cache = (cached_page_t *)calloc(PAGE_CACHE_SIZE, sizeof(cached_page_t));
+  block = (char *)malloc(page_size);
+  if (page_map == NULL || extents == NULL || page_cache == NULL ||
+      block == NULL) {
+    free(extents);
+    file_disable_compression();
+    return -1;
+  }
+  size_t length = map_size * sizeof(uint64_t);
+  if (pread(map_fd, page_map, length, 0) != (ssize_t)length) {
+    free(extents);
+    file_disable_compression();
+    return -1;
+  }
+
+  size_t num_extents = 0;
+  for (pagenum_t pagenum = 0; pagenum < map_size; pagenum++) {
+    if (page_map[pagenum] != 0) {
+      extents[num_extents++] = page_map[pagenum];
+    }
+  }
+  qsort(extents, num_extents, sizeof(uint64_t), compare_extents);
+
+  // the header page takes the first PAGE_SECTORS sectors
+  data_end = PAGE_SECTORS;
+  for (size_t i = 0; i < num_extents; i++) {
+    uint64_t offset = extents[i] >> MAP_SECTORS_BITS;
+    release_range(data_end, offset);
+    data_end = offset + (extents[i] & MAP_SECTORS_MASK);
+  }
+  free(extents);
+  return 0;
+}
 
-  // 헤더 페이지를 읽어와서 프리 페이지 리스트 참조
-  file_read_page(HEADER_PAGE_POS, (page_t *)&header);
-  new_free_page.next_free_page_num = header.free_page_num;
-  header.free_page_num = pagenum;
+/**
+ * @brief Close the page map and drop the page cache
+ */
+void file_disable_compression(void) {
+  if (map_fd >= 0) {
+    close(map_fd);
+    map_fd = -1;
+  }
+  free(page_map);
+  page_map = NULL;
+  map_size = 0;
+  free(page_cache);
+  page_cache = NULL;
+  free(block);
+  block = NULL;
+  for (int size = 0; size <= MAX_PAGE_SECTORS; size++) {
+    free(free_extents[size].offsets);
+    memset(&free_extents[size], 0, sizeof(extent_list_t));
+  }
+}
+
+static void read_compressed_page(pagenum_t pagenum, page_t *dest) {
+  cached_page_t *slot = &page_cache[pagenum % PAGE_CACHE_SIZE];
+  if (slot->valid && slot->page_num == pagenum) {
+    stats_add(STAT_CACHE_HITS, 1);
+    memcpy(dest, &slot->page, page_size);
+    return;
+  }
+  stats_add(STAT_CACHE_MISSES, 1);
 
-  // 삭제할 자리에 새로 작성할 프리 페이지 작성
-  file_write_page(pagenum, (page_t *)&new_free_page);
-  file_write_page(HEADER_PAGE_POS, (page_t *)&header);
+  uint64_t entry = map_entry(pagenum);
+  if (entry == 0) {
+    // allocated but never written
+    memset(dest, 0, page_size);
+    return;
+  }
+
+  uint64_t sectors = entry & MAP_SECTORS_MASK;
+  off_t offset = (off_t)(entry >> MAP_SECTORS_BITS) * SECTOR_SIZE;
+  if (sectors == PAGE_SECTORS) {
+    if (pread(fd, dest, page_size, offset) != (ssize_t)page_size) {
+      handle_error("read error");
+    }
+  } else {
+    size_t size = sectors * SECTOR_SIZE;
+    if (pread(fd, block, size, offset) != (ssize_t)size) {
+      handle_error("read error");
+    }
+    extent_header_t *header = (extent_header_t *)block;
+    if (header->length > size - sizeof(extent_header_t) ||
+        codec_decompress(block + sizeof(extent_header_t), header->length,
+                         dest->data, page_size) != (long)page_size) {
+      fprintf(stderr, "corrupted page %" PRIu64 "\n", (uint64_t)pagenum);
+      exit(EXIT_FAILURE);
+    }
+  }
+  cache_store(pagenum, dest);
+}
+
+static void write_compressed_page(pagenum_t pagenum, const page_t *src) {
+  memset(block, 0, page_size);
+  extent_header_t *header = (extent_header_t *)block;
+
+  // keep the codec output if it saves at least one sector
+  size_t length =
+      codec_compress(src->data, page_size, block + sizeof(extent_header_t),
+                     page_size - SECTOR_SIZE - sizeof(extent_header_t));
+  const char *image = block;
+  uint64_t sectors;
+  if (length == 0) {
+    image = src->data;
+    sectors = PAGE_SECTORS;
+  } else {
+    header->length = length;
+    sectors = (sizeof(extent_header_t) + length + SECTOR_SIZE - 1) /
+              SECTOR_SIZE;
+  }
+
+  uint64_t old_entry = map_entry(pagenum);
+  bool in_place = old_entry != 0 && (old_entry & MAP_SECTORS_MASK) == sectors;
+  uint64_t offset =
+      in_place ? old_entry >> MAP_SECTORS_BITS : alloc_extent(sectors);
+
+  size_t size = sectors * SECTOR_SIZE;
+  if (pwrite(fd, image, size, (off_t)offset * SECTOR_SIZE) != (ssize_t)size) {
+    handle_error("write error");
+  }
+  if (stats_fsync(fd) != 0) {
+    handle_error("fsync error");
+  }
+
+  if (!in_place) {
+    set_map_entry(pagenum, offset << MAP_SECTORS_BITS | sectors);
+    if (old_entry != 0) {
+      push_extent(old_entry >> MAP_SECTORS_BITS, old_entry & MAP_SECTORS_MASK);
+    }
+  }
+  cache_store(pagenum, src);
 }
 
 /**
  * @brief Read an on-disk page into the in-memory page structure(dest)
  */
 void file_read_page(pagenum_t pagenum, page_t *dest) {
+  stats_add(STAT_PAGE_READS, 1);
+  if (map_fd >= 0 && pagenum != HEADER_PAGE_POS) {
+    read_compressed_page(pagenum, dest);
+    return;
+  }
+
   off_t offset = get_offset(pagenum);
 
   if (lseek(fd, offset, SEEK_SET) == (off_t)-1) {
     handle_error("lseek error");
   }
 
-  if (read(fd, dest, PAGE_SIZE) != PAGE_SIZE) {
+  if (read(fd, dest, page_size) != (ssize_t)page_size) {
     handle_error("read error");
   }
 }
@@ -82,17 +565,14 @@ void file_read_page(pagenum_t pagenum, page_t *dest) {
  * @brief Write an in-memory page(src) to the on-disk page
  */
 void file_write_page(pagenum_t pagenum, const page_t *src) {
-  off_t offset = get_offset(pagenum);
-
-  if (lseek(fd, offset, SEEK_SET) == (off_t)-1) {
-    handle_error("lseek error");
-  }
-
-  if (write(fd, src, PAGE_SIZE) != PAGE_SIZE) {
-    handle_error("write error");
+  stats_add(STAT_PAGE_WRITES, 1);
+  if (map_fd >= 0 && pagenum != HEADER_PAGE_POS) {
+    write_compressed_page(pagenum, src);
+    return;
   }
 
-  if (fsync(fd) != 0) {
+  write_raw_page(pagenum, src);
+  if (stats_fsync(fd) != 0) {
     handle_error("fsync error");
   }
 }
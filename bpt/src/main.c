@@ -12,6 +12,7 @@ int main(int argc, char **argv) {
   char input_value[VALUE_SIZE];
   int64_t range;
   char instruction;
+  db_stats_t stats;
 
   license_notice();
   usage();
@@ -47,6 +48,7 @@ int main(int argc, char **argv) {
     case 'f': // Find
     case 'r': // Range Search
     case 't': // Print Tree
+    case 's': // Print Stats
 
       if (global_table_id < 0) {
         printf("Table not open Use 'o <pathname>' first\n");
@@ -98,6 +100,13 @@ int main(int argc, char **argv) {
         case 't':
           db_print_tree();
           break;
+
+        case 's':
+          if (db_get_stats(&stats) == SUCCESS) {
+            print_stats(&stats);
+            db_print_latency();
+          }
+          break;
         }
       }
       break;
@@ -117,7 +126,7 @@ int main(int argc, char **argv) {
       break;
 
     default:
-      printf("Unknown command '%c'. Supported: o, i, d, f, r, t, q\n",
+      printf("Unknown command '%c'. Supported: o, i, d, f, r, t, s, q\n",
              instruction);
       break;
     }
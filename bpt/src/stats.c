@@ -0,0 +1,239 @@
+#include "stats.h"
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+static db_stats_t stats;
+static stat_op_t current_op = STAT_OP_OTHER;
+static latency_histogram_t latency[STAT_OP_CNT][STAT_PHASE_CNT + 1];
+
+// the call being timed
+static struct {
+  bool timing;
+  stat_phase_t phase;
+  uint64_t start;       // when the call started
+  uint64_t phase_start; // when it entered phase
+  uint64_t phase_ns[STAT_PHASE_CNT];
+} call;
+
+static const char *counter_names[STAT_COUNTER_CNT] = {
+    "reads",  "writes", "fsyncs", "hits",   "misses",
+    "splits", "merges", "redist", "allocs", "frees"};
+
+static const char *op_names[STAT_OP_CNT] = {
+    "other", "insert", "update", "find", "range", "delete", "maintenance"};
+
+static const char *phase_names[STAT_PHASE_CNT] = {
+    "lock", "traversal", "leaf", "propagation", "sync"};
+
+uint64_t stats_clock(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+void stats_begin(stat_op_t op) {
+  current_op = op;
+  if (op != STAT_OP_OTHER && op != STAT_OP_MAINTENANCE) {
+    stats.calls[op]++;
+  }
+
+  call.timing = true;
+  call.phase = STAT_PHASE_LEAF;
+  call.start = stats_clock();
+  call.phase_start = call.start;
+  memset(call.phase_ns, 0, sizeof(call.phase_ns));
+}
+
+void stats_waited(uint64_t since) {
+  if (call.timing && since < call.start) {
+    call.phase_ns[STAT_PHASE_LOCK] += call.start - since;
+    call.start = since;
+  }
+}
+
+stat_phase_t stats_enter(stat_phase_t phase) {
+  stat_phase_t previous = call.phase;
+  if (call.timing) {
+    uint64_t now = stats_clock();
+    call.phase_ns[previous] += now - call.phase_start;
+    call.phase_start = now;
+  }
+  call.phase = phase;
+  return previous;
+}
+
+int stats_fsync(int fd) {
+  stats_add(STAT_FSYNCS, 1);
+  stat_phase_t phase = stats_enter(STAT_PHASE_SYNC);
+  int result = fsync(fd);
+  stats_enter(phase);
+  return result;
+}
+
+static int latency_bucket(uint64_t ns) {
+  if (ns >> LATENCY_MAX_BITS) {
+    ns = (1ULL << LATENCY_MAX_BITS) - 1;
+  }
+  if (ns < (1 << LATENCY_SUB_BUCKET_BITS)) {
+    return (int)ns;
+  }
+  int bits = 63 - __builtin_clzll(ns);
+  int shift = bits - LATENCY_SUB_BUCKET_BITS;
+  int sub = (int)(ns >> shift) & ((1 << LATENCY_SUB_BUCKET_BITS) - 1);
+  return ((shift + 1) << LATENCY_SUB_BUCKET_BITS) + sub;
+}
+
+/**
+ * @brief the largest value that falls into bucket
+ */
+static uint64_t latency_bucket_top(int bucket) {
+  if (bucket < (1 << LATENCY_SUB_BUCKET_BITS)) {
+    return bucket;
+  }
+  int shift = (bucket >> LATENCY_SUB_BUCKET_BITS) - 1;
+  uint64_t sub = bucket & ((1 << LATENCY_SUB_BUCKET_BITS) - 1);
+  uint64_t bottom = ((1ULL << LATENCY_SUB_BUCKET_BITS) + sub) << shift;
+  return bottom + (1ULL << shift) - 1;
+}
+
+void latency_record(latency_histogram_t *histogram, uint64_t ns) {
+  histogram->count++;
+  histogram->buckets[latency_bucket(ns)]++;
+  if (ns > histogram->max_ns) {
+    histogram->max_ns = ns;
+  }
+}
+
+void stats_end(void) {
+  if (!call.timing) {
+    return;
+  }
+  uint64_t now = stats_clock();
+  call.phase_ns[call.phase] += now - call.phase_start;
+  call.timing = false;
+
+  latency_record(&latency[current_op][STAT_PHASE_TOTAL], now - call.start);
+  for (int phase = 0; phase < STAT_PHASE_CNT; phase++) {
+    latency_record(&latency[current_op][phase], call.phase_ns[phase]);
+  }
+}
+
+void latency_reset(void) { memset(latency, 0, sizeof(latency)); }
+
+void latency_snapshot(stat_op_t op, int phase, latency_histogram_t *dest) {
+  memcpy(dest, &latency[op][phase], sizeof(latency_histogram_t));
+}
+
+uint64_t latency_percentile(const latency_histogram_t *histogram,
+                            double percentile) {
+  if (histogram->count == 0) {
+    return 0;
+  }
+  // the rank of the value counted from 1, rounded up past rounding errors
+  uint64_t rank = (uint64_t)(percentile / 100.0 * histogram->count + 1 - 1e-6);
+  if (rank == 0) {
+    rank = 1;
+  }
+  uint64_t seen = 0;
+  for (int bucket = 0; bucket < LATENCY_BUCKET_CNT; bucket++) {
+    seen += histogram->buckets[bucket];
+    if (seen >= rank) {
+      uint64_t top = latency_bucket_top(bucket);
+      return top < histogram->max_ns ? top : histogram->max_ns;
+    }
+  }
+  return histogram->max_ns;
+}
+
+void stats_add(stat_counter_t counter, uint64_t n) {
+  stats.counters[current_op][counter] += n;
+}
+
+void stats_reset(void) {
+  memset(&stats, 0, sizeof(db_stats_t));
+  current_op = STAT_OP_OTHER;
+  call.timing = false;
+  latency_reset();
+}
+
+void stats_snapshot(db_stats_t *dest) { memcpy(dest, &stats, sizeof(stats)); }
+
+uint64_t stats_total(const db_stats_t *stats, stat_counter_t counter) {
+  uint64_t total = 0;
+  for (int op = 0; op < STAT_OP_CNT; op++) {
+    total += stats->counters[op][counter];
+  }
+  return total;
+}
+
+/**
+ * @brief print a row per counter and a column per op that counted anything,
+ * then the total
+ */
+void print_stats(const db_stats_t *stats) {
+  bool counted[STAT_OP_CNT];
+  printf("%-8s", "");
+  for (int op = 0; op < STAT_OP_CNT; op++) {
+    counted[op] = stats->calls[op] != 0;
+    for (int counter = 0; counter < STAT_COUNTER_CNT; counter++) {
+      counted[op] = counted[op] || stats->counters[op][counter] != 0;
+    }
+    if (counted[op]) {
+      printf(" %11s", op_names[op]);
+    }
+  }
+  printf(" %11s\n", "total");
+
+  printf("%-8s", "calls");
+  uint64_t calls = 0;
+  for (int op = 0; op < STAT_OP_CNT; op++) {
+    if (counted[op]) {
+      printf(" %11" PRIu64, stats->calls[op]);
+      calls += stats->calls[op];
+    }
+  }
+  printf(" %11" PRIu64 "\n", calls);
+
+  for (int counter = 0; counter < STAT_COUNTER_CNT; counter++) {
+    printf("%-8s", counter_names[counter]);
+    for (int op = 0; op < STAT_OP_CNT; op++) {
+      if (counted[op]) {
+        printf(" %11" PRIu64, stats->counters[op][counter]);
+      }
+    }
+    printf(" %11" PRIu64 "\n", stats_total(stats, (stat_counter_t)counter));
+  }
+}
+
+static void print_percentiles(const latency_histogram_t *histogram) {
+  printf(" %10.1f %10.1f %10.1f %10.1f\n",
+         latency_percentile(histogram, 50) / 1000.0,
+         latency_percentile(histogram, 99) / 1000.0,
+         latency_percentile(histogram, 99.9) / 1000.0,
+         histogram->max_ns / 1000.0);
+}
+
+/**
+ * @brief print a row per op that was timed and a row per phase under it, in
+ * microseconds
+ */
+void print_latency(void) {
+  printf("%-20s %10s %10s %10s %10s %10s\n", "latency (us)", "calls", "p50",
+         "p99", "p999", "max");
+  for (int op = 0; op < STAT_OP_CNT; op++) {
+    const latency_histogram_t *total = &latency[op][STAT_PHASE_TOTAL];
+    if (total->count == 0) {
+      continue;
+    }
+    printf("%-20s %10" PRIu64, op_names[op], total->count);
+    print_percentiles(total);
+    for (int phase = 0; phase < STAT_PHASE_CNT; phase++) {
+      printf("  %-18s %10s", phase_names[phase], "");
+      print_percentiles(&latency[op][phase]);
+    }
+  }
+}
@@ -0,0 +1,161 @@
+#define _GNU_SOURCE
+#include "vlog.h"
+#include "stats.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <linux/falloc.h>
+#endif
+
+static int vlog_fd = -1;
+static vlog_header_t vlog_header;
+static uint64_t head; // end of the last record
+
+static void vlog_error(const char *msg) {
+  perror(msg);
+  exit(EXIT_FAILURE);
+}
+
+static void write_header(void) {
+  char block[VLOG_HEADER_SIZE];
+  memset(block, 0, VLOG_HEADER_SIZE);
+  memcpy(block, &vlog_header, sizeof(vlog_header_t));
+  if (pwrite(vlog_fd, block, VLOG_HEADER_SIZE, 0) != VLOG_HEADER_SIZE) {
+    vlog_error("vlog header write error");
+  }
+}
+
+/**
+ * @brief Open the value log at pathname or create one if not existed
+ * If success, return 0. Otherwise, return non-zero value
+ */
+int vlog_open(const char *pathname) {
+  if ((vlog_fd = open(pathname, O_RDWR | O_CREAT, 0644)) == -1) {
+    return -1;
+  }
+
+  struct stat stat_buf;
+  if (fstat(vlog_fd, &stat_buf) == -1) {
+    close(vlog_fd);
+    vlog_fd = -1;
+    return -1;
+  }
+
+  if (stat_buf.st_size == 0) {
+    memset(&vlog_header, 0, sizeof(vlog_header_t));
+    vlog_header.magic = VLOG_MAGIC;
+    vlog_header.tail = VLOG_HEADER_SIZE;
+    write_header();
+    head = VLOG_HEADER_SIZE;
+    return 0;
+  }
+
+  if (pread(vlog_fd, &vlog_header, sizeof(vlog_header_t), 0) !=
+          sizeof(vlog_header_t) ||
+      vlog_header.magic != VLOG_MAGIC) {
+    close(vlog_fd);
+    vlog_fd = -1;
+    return -1;
+  }
+  // records are only appended, so the file ends at the head
+  head = stat_buf.st_size;
+  return 0;
+}
+
+int vlog_close(void) {
+  if (vlog_fd < 0) {
+    return 0;
+  }
+  write_header();
+  int result = close(vlog_fd);
+  vlog_fd = -1;
+  return result;
+}
+
+bool vlog_is_open(void) { return vlog_fd >= 0; }
+
+/**
+ * @brief Append a record and return its offset. The record is synced before
+ * returning, so a leaf never references a value that is not on disk
+ */
+uint64_t vlog_append(int64_t key, const char *value, size_t length) {
+  vlog_record_t record = {key, length};
+  uint64_t offset = head;
+
+  if (pwrite(vlog_fd, &record, sizeof(vlog_record_t), offset) !=
+          sizeof(vlog_record_t) ||
+      pwrite(vlog_fd, value, length, offset + sizeof(vlog_record_t)) !=
+          (ssize_t)length) {
+    vlog_error("vlog append error");
+  }
+  if (stats_fsync(vlog_fd) != 0) {
+    vlog_error("vlog fsync error");
+  }
+
+  head += sizeof(vlog_record_t) + length;
+  return offset;
+}
+
+void vlog_read_record(uint64_t offset, vlog_record_t *record) {
+  if (pread(vlog_fd, record, sizeof(vlog_record_t), offset) !=
+      sizeof(vlog_record_t)) {
+    vlog_error("vlog read error");
+  }
+}
+
+void vlog_read_value(uint64_t offset, char *dest, size_t length) {
+  if (pread(vlog_fd, dest, length, offset + sizeof(vlog_record_t)) !=
+      (ssize_t)length) {
+    vlog_error("vlog read error");
+  }
+}
+
+void vlog_discard(uint64_t length) {
+  vlog_header.garbage += sizeof(vlog_record_t) + length;
+}
+
+uint64_t vlog_head(void) { return head; }
+
+uint64_t vlog_tail(void) { return vlog_header.tail; }
+
+uint64_t vlog_garbage(void) { return vlog_header.garbage; }
+
+/**
+ * @brief Move the tail past records that were collected and punch a hole
+ * over them, so the file keeps its offsets but not the disk space
+ */
+void vlog_advance_tail(uint64_t tail, uint64_t garbage) {
+  uint64_t old_tail = vlog_header.tail;
+
+  vlog_header.tail = tail;
+  vlog_header.garbage =
+      vlog_header.garbage > garbage ? vlog_header.garbage - garbage : 0;
+  write_header();
+  if (stats_fsync(vlog_fd) != 0) {
+    vlog_error("vlog fsync error");
+  }
+
+#ifdef FALLOC_FL_PUNCH_HOLE
+  // best effort, the space is simply kept on file systems without holes
+  fallocate(vlog_fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, old_tail,
+            tail - old_tail);
+#else
+  (void)old_tail;
+#endif
+}
+
+void vlog_truncate(void) {
+  vlog_header.tail = VLOG_HEADER_SIZE;
+  vlog_header.garbage = 0;
+  head = VLOG_HEADER_SIZE;
+  write_header();
+  if (ftruncate(vlog_fd, VLOG_HEADER_SIZE) != 0 ||
+      stats_fsync(vlog_fd) != 0) {
+    vlog_error("vlog truncate error");
+  }
+}
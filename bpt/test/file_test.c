@@ -1,6 +1,7 @@
-// gcc -I../include ../src/file.c file_test.c -o file_test
+// gcc -I../include ../src/file.c ../src/codec.c ../src/stats.c file_test.c -o file_test
 
 #include <fcntl.h>
+#include <inttypes.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -9,6 +10,7 @@
 
 #include "file.h"
 #include "page.h"
+#include "stats.h"
 
 extern int fd;
 const char *TEST_DB_FILE = "test_db.dat";
@@ -38,7 +40,7 @@ void setup_test_file(const char *filename) {
   initial_header.root_page_num = PAGE_NULL;
   initial_header.num_of_pages = HEADER_PAGE_POS + 1; // 1
 
-  memset(&header_buffer, 0, PAGE_SIZE);
+  memset(&header_buffer, 0, page_size);
   memcpy(header_buffer.data, &initial_header, sizeof(header_page_t));
   file_write_page(HEADER_PAGE_POS, &header_buffer);
 }
@@ -60,9 +62,9 @@ int main() {
   // Sequential Allocation
   print_header_status("Initial State"); // Head: 0, Total: 1
 
-  p1 = file_alloc_page();
-  p2 = file_alloc_page();
-  p3 = file_alloc_page();
+  p1 = file_alloc_page(PAGE_NULL);
+  p2 = file_alloc_page(PAGE_NULL);
+  p3 = file_alloc_page(PAGE_NULL);
 
   printf(
       "[1] Allocated Pages (Sequential): %ld, %ld, %ld (Expected: 1, 2, 3)\n",
@@ -79,22 +81,67 @@ int main() {
   print_header_status("After Deallocation");
 
   // Allocation with Recycle
-  p4 = file_alloc_page();
+  p4 = file_alloc_page(PAGE_NULL);
   printf("[3] Recycled Page 1: %ld (Expected: 3)\n", p4);
 
   print_header_status("After First Recycle");
 
-  p5 = file_alloc_page();
+  p5 = file_alloc_page(PAGE_NULL);
   printf("[3] Recycled Page 2: %ld (Expected: 2)\n", p5);
 
   print_header_status("After Second Recycle");
 
   // Sequential Allocation Check (After Recycle)
-  pagenum_t p6 = file_alloc_page();
+  pagenum_t p6 = file_alloc_page(PAGE_NULL);
   printf("[4] Allocated Page (Extension): %ld (Expected: 4)\n", p6);
 
   print_header_status("After Final Extension");
 
+  // Allocation with a Placement Hint
+  stats_reset();
+  pagenum_t p7 = file_alloc_page(p6);
+  printf("[5] Allocated Page near %ld: %ld (Expected: 5, extent up to 12)\n",
+         p6, p7);
+
+  // the rest of the extent is written at once, then the header
+  db_stats_t stats;
+  stats_snapshot(&stats);
+  uint64_t fsyncs = stats_total(&stats, STAT_FSYNCS);
+  printf("[5] fsyncs for the extent: %" PRIu64 " (Expected: 2)\n", fsyncs);
+  if (fsyncs > 2) {
+    printf("FAIL: extent allocation takes %" PRIu64 " fsyncs\n", fsyncs);
+    cleanup_test_file(TEST_DB_FILE);
+    return EXIT_FAILURE;
+  }
+
+  print_header_status("After Extent Allocation"); // Head: 6, Total: 13
+
+  file_free_page(p1);
+  pagenum_t p8 = file_alloc_page(p7);
+  printf("[6] Allocated Page near %ld: %ld (Expected: 6, not freed 1)\n", p7,
+         p8);
+
+  print_header_status("After Nearby Allocation"); // Head: 1, Total: 13
+
+  // Batch Deallocation: the free pages are synced once, then the header
+  pagenum_t batch[4];
+  for (int i = 0; i < 4; i++) {
+    batch[i] = file_alloc_page(PAGE_NULL);
+  }
+  stats_reset();
+  file_free_pages(batch, 4);
+  stats_snapshot(&stats);
+  fsyncs = stats_total(&stats, STAT_FSYNCS);
+  printf("[7] fsyncs for freeing %d pages: %" PRIu64 " (Expected: 2)\n", 4,
+         fsyncs);
+  if (fsyncs > 2) {
+    printf("FAIL: freeing a batch takes %" PRIu64 " fsyncs\n", fsyncs);
+    cleanup_test_file(TEST_DB_FILE);
+    return EXIT_FAILURE;
+  }
+
+  print_header_status("After Batch Deallocation"); // Head: 9, Total: 13
+
   cleanup_test_file(TEST_DB_FILE);
 
   return 0;
@@ -0,0 +1,5 @@
+#ifndef BPTREE_INTERNAL_H
+#define BPTREE_INTERNAL_H
+// Dummy header to make Ceedling recognize the files because it cannot link
+// header files associated with multiple source files.
+#endif
\ No newline at end of file
@@ -1,23 +1,32 @@
 #include "helper_mock.h"
+#include "bpt.h"
+#include "bpt_internal.h"
 #include <string.h>
 
 page_t MOCK_PAGES[MAX_MOCK_PAGES];
-
-void setup_data_store(void) { memset(MOCK_PAGES, 0, sizeof(MOCK_PAGES)); }
+uint32_t page_size = DEFAULT_PAGE_SIZE; // file.c is mocked
+
+void setup_data_store(void) {
+  memset(MOCK_PAGES, 0, sizeof(MOCK_PAGES));
+  forget_rightmost_leaf();
+  forget_deferred_merges();
+  reset_defragmentation();
+  bump_smo_epoch();
+}
 
 void MOCK_file_read_page(pagenum_t pagenum, page_t *dest, int num_calls) {
   if (pagenum < MAX_MOCK_PAGES) {
-    memcpy(dest, &MOCK_PAGES[pagenum], PAGE_SIZE);
+    memcpy(dest, &MOCK_PAGES[pagenum], page_size);
   }
 }
 
 void MOCK_file_write_page(pagenum_t pagenum, const page_t *src, int num_calls) {
   if (pagenum < MAX_MOCK_PAGES) {
-    memcpy(&MOCK_PAGES[pagenum], src, PAGE_SIZE);
+    memcpy(&MOCK_PAGES[pagenum], src, page_size);
   }
 }
 
-pagenum_t MOCK_file_alloc_page(int num_calls) {
+pagenum_t MOCK_file_alloc_page(pagenum_t hint, int num_calls) {
   header_page_t header;
   MOCK_file_read_page(HEADER_PAGE_POS, (page_t *)&header, 0);
 
@@ -34,17 +43,31 @@ pagenum_t MOCK_file_alloc_page(int num_calls) {
   header.num_of_pages += 1;
   MOCK_file_write_page(HEADER_PAGE_POS, (page_t *)&header, 0);
 
-  memset(&MOCK_PAGES[new_page_num], 0, PAGE_SIZE);
+  memset(&MOCK_PAGES[new_page_num], 0, page_size);
 
   return new_page_num;
 }
 
+pagenum_t MOCK_file_alloc_page_at_end(int num_calls) {
+  header_page_t header;
+  MOCK_file_read_page(HEADER_PAGE_POS, (page_t *)&header, 0);
+  pagenum_t new_page_num = header.num_of_pages;
+  if (new_page_num >= MAX_MOCK_PAGES) {
+    return 0;
+  }
+
+  header.num_of_pages += 1;
+  MOCK_file_write_page(HEADER_PAGE_POS, (page_t *)&header, 0);
+  memset(&MOCK_PAGES[new_page_num], 0, page_size);
+  return new_page_num;
+}
+
 void MOCK_file_free_page(pagenum_t pagenum, int num_calls) {
   if (pagenum >= MAX_MOCK_PAGES || pagenum <= HEADER_PAGE_POS) {
     return;
   }
 
-  memset(&MOCK_PAGES[pagenum], 0, PAGE_SIZE);
+  memset(&MOCK_PAGES[pagenum], 0, page_size);
 
   header_page_t header;
   free_page_t *free_page = (free_page_t *)&MOCK_PAGES[pagenum];
@@ -57,15 +80,24 @@ void MOCK_file_free_page(pagenum_t pagenum, int num_calls) {
   MOCK_file_write_page(HEADER_PAGE_POS, (page_t *)&header, 0);
 }
 
+void MOCK_file_free_pages(const pagenum_t *pagenums, size_t count,
+                          int num_calls) {
+  for (size_t i = 0; i < count; i++) {
+    MOCK_file_free_page(pagenums[i], num_calls);
+  }
+}
+
 void init_header_page_for_mock(void) {
   page_t header_buf;
-  memset(&header_buf, 0, PAGE_SIZE);
+  memset(&header_buf, 0, page_size);
   header_page_t *header_page = (header_page_t *)&header_buf;
 
   header_page->root_page_num = PAGE_NULL;
   header_page->num_of_pages = HEADER_PAGE_POS + 1;
+  header_page->version = FORMAT_VERSION;
+  header_page->page_size = page_size;
 
-  memcpy(&MOCK_PAGES[HEADER_PAGE_POS], &header_buf, PAGE_SIZE);
+  memcpy(&MOCK_PAGES[HEADER_PAGE_POS], &header_buf, page_size);
 }
 
 // ---------------utils for mock-------------------
@@ -86,4 +118,10 @@ header_page_t get_header_page(void) {
   page_t buf;
   MOCK_file_read_page(HEADER_PAGE_POS, &buf, 0);
   return *(header_page_t *)&buf;
-}
\ No newline at end of file
+}
+// value of a record as a C string, valid until the next call
+const char *get_leaf_value(const leaf_page_t *leaf, int index) {
+  static char value[VALUE_SIZE];
+  leaf_read_value(leaf, index, value, VALUE_SIZE);
+  return value;
+}
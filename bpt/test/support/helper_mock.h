@@ -1,6 +1,10 @@
 #include "page.h"
+#include <stddef.h>
 
+// bench/node_bench.c builds larger trees on the same store
+#ifndef MAX_MOCK_PAGES
 #define MAX_MOCK_PAGES 300
+#endif
 
 // mock data store
 extern page_t MOCK_PAGES[MAX_MOCK_PAGES];
@@ -10,11 +14,15 @@ void setup_data_store(void);
 
 void MOCK_file_read_page(pagenum_t pagenum, page_t *dest, int num_calls);
 void MOCK_file_write_page(pagenum_t pagenum, const page_t *src, int num_calls);
-pagenum_t MOCK_file_alloc_page(int num_calls);
+pagenum_t MOCK_file_alloc_page(pagenum_t hint, int num_calls);
+pagenum_t MOCK_file_alloc_page_at_end(int num_calls);
 void MOCK_file_free_page(pagenum_t pagenum, int num_calls);
+void MOCK_file_free_pages(const pagenum_t *pagenums, size_t count,
+                          int num_calls);
 
 // ---------------utils for mock-------------------
 void init_header_page_for_mock(void);
 leaf_page_t get_leaf_page(pagenum_t pagenum);
 internal_page_t get_internal_page(pagenum_t pagenum);
-header_page_t get_header_page(void);
\ No newline at end of file
+header_page_t get_header_page(void);
+const char *get_leaf_value(const leaf_page_t *leaf, int index);
\ No newline at end of file
@@ -0,0 +1,91 @@
+#include "bpt.h"
+#include "bpt_internal.h"
+#include "bptree.h"
+#include "bptree_defrag.h"
+#include "bptree_delete.h"
+#include "bptree_find.h"
+#include "bptree_insert.h"
+#include "bptree_internal.h"
+#include "bptree_leaf.h"
+#include "bptree_overflow.h"
+#include "bptree_search.h"
+#include "bptree_utils.h"
+#include "bptree_vlog.h"
+#include "codec.h"
+#include "helper_mock.h"
+#include "mock_file.h"
+#include "stats.h"
+#include "unity.h"
+#include "vlog.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+static char page[DEFAULT_PAGE_SIZE];
+static char compressed[DEFAULT_PAGE_SIZE * 2];
+static char restored[DEFAULT_PAGE_SIZE];
+
+void setUp() {
+  memset(page, 0, sizeof(page));
+  memset(restored, 0, sizeof(restored));
+}
+
+void tearDown() {}
+
+static size_t assert_round_trip(void) {
+  size_t length = codec_compress(page, DEFAULT_PAGE_SIZE, compressed,
+                                 sizeof(compressed));
+  TEST_ASSERT_NOT_EQUAL(0, length);
+  TEST_ASSERT_EQUAL(DEFAULT_PAGE_SIZE, codec_decompress(compressed, length, restored,
+                                                sizeof(restored)));
+  TEST_ASSERT_EQUAL_MEMORY(page, restored, DEFAULT_PAGE_SIZE);
+  return length;
+}
+
+void test_codec_zero_page(void) {
+  size_t length = assert_round_trip();
+  TEST_ASSERT_LESS_THAN(64, length);
+}
+
+void test_codec_sorted_keys(void) {
+  // a leaf like page: ascending keys followed by short text values
+  int64_t *keys = (int64_t *)page;
+  for (int i = 0; i < 128; i++) {
+    keys[i] = 100000 + i * 3;
+  }
+  for (int i = 0; i < 128; i++) {
+    snprintf(page + 1024 + i * 24, 24, "value_%d_abcdef", 100000 + i * 3);
+  }
+
+  size_t length = assert_round_trip();
+  TEST_ASSERT_LESS_THAN(DEFAULT_PAGE_SIZE / 2, length);
+}
+
+void test_codec_incompressible_page(void) {
+  srand(32);
+  for (int i = 0; i < DEFAULT_PAGE_SIZE; i++) {
+    page[i] = (char)rand();
+  }
+
+  // the output does not fit in a smaller buffer
+  TEST_ASSERT_EQUAL(0, codec_compress(page, DEFAULT_PAGE_SIZE, compressed,
+                                      DEFAULT_PAGE_SIZE - 512));
+  assert_round_trip();
+}
+
+void test_codec_rejects_invalid_block(void) {
+  memset(page, 'a', DEFAULT_PAGE_SIZE);
+  size_t length = assert_round_trip();
+
+  // truncated block does not give back the page
+  TEST_ASSERT_NOT_EQUAL(DEFAULT_PAGE_SIZE, codec_decompress(compressed, length / 2,
+                                                    restored,
+                                                    sizeof(restored)));
+  // output larger than the destination
+  TEST_ASSERT_EQUAL(-1, codec_decompress(compressed, length, restored,
+                                         DEFAULT_PAGE_SIZE - 1));
+  // match offset before the start of the output
+  char block[] = {0x10, 'a', 0x02, 0x00};
+  TEST_ASSERT_EQUAL(-1, codec_decompress(block, sizeof(block), restored,
+                                         sizeof(restored)));
+}
@@ -1,13 +1,21 @@
 #include "bpt.h"
 #include "bpt_internal.h"
 #include "bptree.h"
+#include "bptree_defrag.h"
 #include "bptree_delete.h"
 #include "bptree_find.h"
 #include "bptree_insert.h"
+#include "bptree_internal.h"
+#include "bptree_leaf.h"
+#include "bptree_overflow.h"
+#include "bptree_search.h"
 #include "bptree_utils.h"
+#include "bptree_vlog.h"
 #include "helper_mock.h"
 #include "mock_file.h"
 #include "page.h"
+#include "stats.h"
+#include "vlog.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -27,6 +35,9 @@
 
 void setUp(void) {
   setup_data_store();
+  merge_threshold = MIN_KEYS;
+  defer_merges = false;
+  lazy_deletes = false;
   file_read_page_Stub(MOCK_file_read_page);
   file_write_page_Stub(MOCK_file_write_page);
 }
@@ -44,7 +55,7 @@ void test_delete_root_becomes_empty(void) {
   h0->root_page_num = ROOT_NUM;
   h0->num_of_pages = 3;
 
-  leaf_page_t *l1 = (leaf_page_t *)&MOCK_PAGES[ROOT_NUM];
+  legacy_leaf_page_t *l1 = (legacy_leaf_page_t *)&MOCK_PAGES[ROOT_NUM];
   l1->parent_page_num = PAGE_NULL;
   l1->is_leaf = LEAF;
   l1->num_of_keys = 1;
@@ -56,7 +67,8 @@ void test_delete_root_becomes_empty(void) {
   // P2는 루트이며 키 0개가 되므로 해제되어야 함
   file_free_page_Expect(ROOT_NUM);
 
-  delete_entry(ROOT_NUM, 5, DELETE_VALUE);
+  tree_path_t path = {{ROOT_NUM}, 1};
+  delete_entry(&path, 0, 5, DELETE_VALUE);
 
   // Verification
   pagenum_t NEW_ROOT = h0->root_page_num;
@@ -79,7 +91,7 @@ void test_delete_leaf_redistribution_R_to_L(void) {
   h0->root_page_num = ROOT_NUM;
   h0->num_of_pages = 5;
 
-  internal_page_t *i2 = (internal_page_t *)&MOCK_PAGES[ROOT_NUM];
+  legacy_internal_page_t *i2 = (legacy_internal_page_t *)&MOCK_PAGES[ROOT_NUM];
   i2->is_leaf = INTERNAL;
   i2->num_of_keys = 1;
   i2->one_more_page_num = P3;
@@ -87,7 +99,7 @@ void test_delete_leaf_redistribution_R_to_L(void) {
   i2->entries[0].page_num = P4;
 
   // setup neighbor
-  leaf_page_t *l3 = (leaf_page_t *)&MOCK_PAGES[P3];
+  legacy_leaf_page_t *l3 = (legacy_leaf_page_t *)&MOCK_PAGES[P3];
   l3->parent_page_num = ROOT_NUM;
   l3->is_leaf = LEAF;
   l3->num_of_keys = RECORD_CNT;
@@ -100,7 +112,7 @@ void test_delete_leaf_redistribution_R_to_L(void) {
   l3->right_sibling_page_num = P4;
 
   // setup target
-  leaf_page_t *l4 = (leaf_page_t *)&MOCK_PAGES[P4];
+  legacy_leaf_page_t *l4 = (legacy_leaf_page_t *)&MOCK_PAGES[P4];
   l4->parent_page_num = ROOT_NUM;
   l4->is_leaf = LEAF;
   l4->num_of_keys = 1;
@@ -108,7 +120,8 @@ void test_delete_leaf_redistribution_R_to_L(void) {
   strcpy(l4->records[0].value, DELETE_VALUE);
   l4->right_sibling_page_num = PAGE_NULL;
 
-  delete_entry(P4, 4, DELETE_VALUE);
+  tree_path_t path = {{ROOT_NUM, P4}, 2};
+  delete_entry(&path, 1, 4, DELETE_VALUE);
 
   // Verification
   pagenum_t NEW_ROOT = h0->root_page_num;
@@ -117,16 +130,16 @@ void test_delete_leaf_redistribution_R_to_L(void) {
   // check target status
   leaf_page_t *l4_final = (leaf_page_t *)&MOCK_PAGES[P4];
   TEST_ASSERT_EQUAL_INT(1, l4_final->num_of_keys);
-  TEST_ASSERT_EQUAL_INT64(3, l4_final->records[0].key);
-  TEST_ASSERT_EQUAL_STRING("val3", l4_final->records[0].value);
+  TEST_ASSERT_EQUAL_INT64(3, leaf_key(l4_final, 0));
+  TEST_ASSERT_EQUAL_STRING("val3", get_leaf_value(l4_final, 0));
 
   // check neighbor status
   leaf_page_t *l3_final = (leaf_page_t *)&MOCK_PAGES[P3];
   TEST_ASSERT_EQUAL_INT(2, l3_final->num_of_keys);
-  TEST_ASSERT_EQUAL_INT64(1, l3_final->records[0].key);
-  TEST_ASSERT_EQUAL_STRING("val1", l3_final->records[0].value);
-  TEST_ASSERT_EQUAL_INT64(2, l3_final->records[1].key);
-  TEST_ASSERT_EQUAL_STRING("val2", l3_final->records[1].value);
+  TEST_ASSERT_EQUAL_INT64(1, leaf_key(l3_final, 0));
+  TEST_ASSERT_EQUAL_STRING("val1", get_leaf_value(l3_final, 0));
+  TEST_ASSERT_EQUAL_INT64(2, leaf_key(l3_final, 1));
+  TEST_ASSERT_EQUAL_STRING("val2", get_leaf_value(l3_final, 1));
 }
 
 /**
@@ -145,7 +158,7 @@ void test_delete_leaf_coalesce_swap_R_to_L(void) {
   h0->num_of_pages = 6;
 
   // setup root
-  internal_page_t *i2 = (internal_page_t *)&MOCK_PAGES[ROOT_NUM];
+  legacy_internal_page_t *i2 = (legacy_internal_page_t *)&MOCK_PAGES[ROOT_NUM];
   i2->is_leaf = INTERNAL;
   i2->num_of_keys = 1;
   i2->one_more_page_num = P3;
@@ -153,7 +166,7 @@ void test_delete_leaf_coalesce_swap_R_to_L(void) {
   i2->entries[0].page_num = P4;
 
   // setup target
-  leaf_page_t *l3 = (leaf_page_t *)&MOCK_PAGES[P3];
+  legacy_leaf_page_t *l3 = (legacy_leaf_page_t *)&MOCK_PAGES[P3];
   l3->parent_page_num = ROOT_NUM;
   l3->is_leaf = LEAF;
   l3->num_of_keys = 1;
@@ -162,7 +175,7 @@ void test_delete_leaf_coalesce_swap_R_to_L(void) {
   l3->right_sibling_page_num = P4;
 
   // setup neighbor
-  leaf_page_t *l4 = (leaf_page_t *)&MOCK_PAGES[P4];
+  legacy_leaf_page_t *l4 = (legacy_leaf_page_t *)&MOCK_PAGES[P4];
   l4->parent_page_num = ROOT_NUM;
   l4->is_leaf = LEAF;
   l4->num_of_keys = 2; // [6, 7]
@@ -176,7 +189,8 @@ void test_delete_leaf_coalesce_swap_R_to_L(void) {
   file_free_page_Expect(P4);
   file_free_page_Expect(ROOT_NUM);
 
-  int result = delete_entry(P3, 3, DELETE_VALUE);
+  tree_path_t path = {{ROOT_NUM, P3}, 2};
+  int result = delete_entry(&path, 1, 3, DELETE_VALUE);
   pagenum_t NEW_ROOT = h0->root_page_num;
 
   // 3. Verification
@@ -186,14 +200,11 @@ void test_delete_leaf_coalesce_swap_R_to_L(void) {
   // check target status
   leaf_page_t *l3_final = (leaf_page_t *)&MOCK_PAGES[P3];
   TEST_ASSERT_EQUAL_INT(2, l3_final->num_of_keys);
-  TEST_ASSERT_EQUAL_INT64(6, l3_final->records[0].key);
-  TEST_ASSERT_EQUAL_STRING("val6", l3_final->records[0].value);
-  TEST_ASSERT_EQUAL_INT64(7, l3_final->records[1].key);
-  TEST_ASSERT_EQUAL_STRING("val7", l3_final->records[1].value);
+  TEST_ASSERT_EQUAL_INT64(6, leaf_key(l3_final, 0));
+  TEST_ASSERT_EQUAL_STRING("val6", get_leaf_value(l3_final, 0));
+  TEST_ASSERT_EQUAL_INT64(7, leaf_key(l3_final, 1));
+  TEST_ASSERT_EQUAL_STRING("val7", get_leaf_value(l3_final, 1));
   TEST_ASSERT_EQUAL_HEX64(P5, l3_final->right_sibling_page_num);
-
-  // P2가 해제되었으므로 P3의 부모 포인터는 PAGE_NULL이어야 함
-  TEST_ASSERT_EQUAL_HEX64(PAGE_NULL, l3_final->parent_page_num);
 }
 
 /**
@@ -215,7 +226,7 @@ void test_delete_internal_coalesce(void) {
   h0->root_page_num = ROOT_NUM;
   h0->num_of_pages = 8;
 
-  internal_page_t *i1 = (internal_page_t *)&MOCK_PAGES[ROOT_NUM];
+  legacy_internal_page_t *i1 = (legacy_internal_page_t *)&MOCK_PAGES[ROOT_NUM];
   i1->is_leaf = INTERNAL;
   i1->num_of_keys = 1;
   i1->one_more_page_num = P3;
@@ -223,7 +234,7 @@ void test_delete_internal_coalesce(void) {
   i1->entries[0].page_num = P4;
 
   // setup neighbor
-  internal_page_t *i3 = (internal_page_t *)&MOCK_PAGES[P3];
+  legacy_internal_page_t *i3 = (legacy_internal_page_t *)&MOCK_PAGES[P3];
   i3->parent_page_num = ROOT_NUM;
   i3->is_leaf = INTERNAL;
   i3->num_of_keys = 1; // [10]
@@ -232,7 +243,7 @@ void test_delete_internal_coalesce(void) {
   i3->entries[0].page_num = L8;
 
   // setup target
-  internal_page_t *i4 = (internal_page_t *)&MOCK_PAGES[P4];
+  legacy_internal_page_t *i4 = (legacy_internal_page_t *)&MOCK_PAGES[P4];
   i4->parent_page_num = ROOT_NUM;
   i4->is_leaf = INTERNAL;
   i4->num_of_keys = 1;
@@ -254,7 +265,8 @@ void test_delete_internal_coalesce(void) {
   file_free_page_Expect(P4);
   file_free_page_Expect(ROOT_NUM);
 
-  delete_entry(P4, 60, NULL);
+  tree_path_t path = {{ROOT_NUM, P4}, 2};
+  delete_entry(&path, 1, 60, NULL);
 
   // Verification
   pagenum_t NEW_ROOT = h0->root_page_num;
@@ -263,15 +275,14 @@ void test_delete_internal_coalesce(void) {
   // check target status
   internal_page_t *i3_final = (internal_page_t *)&MOCK_PAGES[P3];
   TEST_ASSERT_EQUAL_INT(2, i3_final->num_of_keys);
-  TEST_ASSERT_EQUAL_INT64(10, i3_final->entries[0].key);
-  TEST_ASSERT_EQUAL_INT64(K_PRIME, i3_final->entries[1].key); // 50
-
-  TEST_ASSERT_EQUAL_HEX64(L6, i3_final->entries[1].page_num);
+  TEST_ASSERT_EQUAL_INT64(10, internal_key(i3_final, 0));
+  TEST_ASSERT_EQUAL_INT64(K_PRIME, internal_key(i3_final, 1)); // 50
 
-  TEST_ASSERT_EQUAL_HEX64(PAGE_NULL, i3_final->parent_page_num);
+  TEST_ASSERT_EQUAL_HEX64(L6, internal_child(i3_final, 1));
 
+  // 병합으로 옮겨진 자식 페이지는 다시 쓰지 않음
   page_header_t *l6_final = (page_header_t *)&MOCK_PAGES[L6];
-  TEST_ASSERT_EQUAL_HEX64(P3, l6_final->parent_page_num);
+  TEST_ASSERT_EQUAL_HEX64(P4, l6_final->parent_page_num);
 
   // l7은 체크 안해도 될듯
   // 원래라면 free 되었어야 하는 페이지지만 이 테스트케이스에선 중간 key만
@@ -294,7 +305,7 @@ void test_delete_leaf_redistribute_when_target_is_empty(void) {
   h0->root_page_num = ROOT_NUM;
   h0->num_of_pages = 4;
 
-  internal_page_t *i2 = (internal_page_t *)&MOCK_PAGES[ROOT_NUM];
+  legacy_internal_page_t *i2 = (legacy_internal_page_t *)&MOCK_PAGES[ROOT_NUM];
   i2->is_leaf = INTERNAL;
   i2->num_of_keys = 1;
   i2->one_more_page_num = P3;
@@ -302,7 +313,7 @@ void test_delete_leaf_redistribute_when_target_is_empty(void) {
   i2->entries[0].page_num = P4;
 
   // setup neighbor
-  leaf_page_t *l3 = (leaf_page_t *)&MOCK_PAGES[P3];
+  legacy_leaf_page_t *l3 = (legacy_leaf_page_t *)&MOCK_PAGES[P3];
   l3->parent_page_num = ROOT_NUM;
   l3->is_leaf = LEAF;
   l3->num_of_keys = RECORD_CNT;
@@ -315,7 +326,7 @@ void test_delete_leaf_redistribute_when_target_is_empty(void) {
   l3->right_sibling_page_num = P4;
 
   // setup target
-  leaf_page_t *l4 = (leaf_page_t *)&MOCK_PAGES[P4];
+  legacy_leaf_page_t *l4 = (legacy_leaf_page_t *)&MOCK_PAGES[P4];
   l4->parent_page_num = ROOT_NUM;
   l4->is_leaf = LEAF;
   l4->num_of_keys = 1;
@@ -326,7 +337,8 @@ void test_delete_leaf_redistribute_when_target_is_empty(void) {
   // EXPECTATION: No pages should be freed (Redistribution).
   // file_free_page_Expect(...) 없음
 
-  delete_entry(P4, 50, DELETE_VALUE);
+  tree_path_t path = {{ROOT_NUM, P4}, 2};
+  delete_entry(&path, 1, 50, DELETE_VALUE);
 
   // Verification
   pagenum_t NEW_ROOT = h0->root_page_num;
@@ -335,19 +347,525 @@ void test_delete_leaf_redistribute_when_target_is_empty(void) {
   // check target status
   leaf_page_t *l4_final = (leaf_page_t *)&MOCK_PAGES[P4];
   TEST_ASSERT_EQUAL_INT(1, l4_final->num_of_keys);
-  TEST_ASSERT_EQUAL_INT64(30, l4_final->records[0].key);
-  TEST_ASSERT_EQUAL_STRING("val30", l4_final->records[0].value);
+  TEST_ASSERT_EQUAL_INT64(30, leaf_key(l4_final, 0));
+  TEST_ASSERT_EQUAL_STRING("val30", get_leaf_value(l4_final, 0));
 
   // check neighbor status
   leaf_page_t *l3_final = (leaf_page_t *)&MOCK_PAGES[P3];
   TEST_ASSERT_EQUAL_INT(2, l3_final->num_of_keys);
-  TEST_ASSERT_EQUAL_INT64(10, l3_final->records[0].key);
-  TEST_ASSERT_EQUAL_STRING("val10", l3_final->records[0].value);
-  TEST_ASSERT_EQUAL_INT64(20, l3_final->records[1].key);
-  TEST_ASSERT_EQUAL_STRING("val20", l3_final->records[1].value);
+  TEST_ASSERT_EQUAL_INT64(10, leaf_key(l3_final, 0));
+  TEST_ASSERT_EQUAL_STRING("val10", get_leaf_value(l3_final, 0));
+  TEST_ASSERT_EQUAL_INT64(20, leaf_key(l3_final, 1));
+  TEST_ASSERT_EQUAL_STRING("val20", get_leaf_value(l3_final, 1));
 
   // check parent status
   internal_page_t *i2_final = (internal_page_t *)&MOCK_PAGES[ROOT_NUM];
-  TEST_ASSERT_EQUAL_INT64(30, i2_final->entries[0].key);
-  TEST_ASSERT_EQUAL_HEX64(P4, i2_final->entries[0].page_num);
+  TEST_ASSERT_EQUAL_INT64(30, internal_key(i2_final, 0));
+  TEST_ASSERT_EQUAL_HEX64(P4, internal_child(i2_final, 0));
+}
+
+static int read_count;
+static int write_count;
+
+static void counting_read_page(pagenum_t pagenum, page_t *dest,
+                               int num_calls) {
+  read_count++;
+  MOCK_file_read_page(pagenum, dest, num_calls);
+}
+
+static void counting_write_page(pagenum_t pagenum, const page_t *src,
+                                int num_calls) {
+  write_count++;
+  MOCK_file_write_page(pagenum, src, num_calls);
+}
+
+/**
+ * @brief delete_value는 한 번의 탐색으로 삭제하고 삭제된 값을 돌려주는지
+ * 확인. 재분배가 필요 없으면 헤더, 루트, leaf만 읽고 leaf만 씀
+ */
+void test_delete_value_in_one_descent(void) {
+  pagenum_t ROOT_NUM = 1;
+  pagenum_t P3 = 2;
+  pagenum_t P4 = 3;
+
+  header_page_t *h0 = (header_page_t *)&MOCK_PAGES[HEADER_PAGE_NUM];
+  h0->root_page_num = ROOT_NUM;
+  h0->num_of_pages = 4;
+
+  legacy_internal_page_t *i2 = (legacy_internal_page_t *)&MOCK_PAGES[ROOT_NUM];
+  i2->is_leaf = INTERNAL;
+  i2->num_of_keys = 1;
+  i2->one_more_page_num = P3;
+  i2->entries[0].key = 50;
+  i2->entries[0].page_num = P4;
+
+  legacy_leaf_page_t *l3 = (legacy_leaf_page_t *)&MOCK_PAGES[P3];
+  l3->is_leaf = LEAF;
+  l3->num_of_keys = RECORD_CNT;
+  l3->records[0].key = 10;
+  strcpy(l3->records[0].value, "val10");
+  l3->records[1].key = 20;
+  strcpy(l3->records[1].value, "val20");
+  l3->records[2].key = 30;
+  strcpy(l3->records[2].value, "val30");
+  l3->right_sibling_page_num = P4;
+
+  legacy_leaf_page_t *l4 = (legacy_leaf_page_t *)&MOCK_PAGES[P4];
+  l4->is_leaf = LEAF;
+  l4->num_of_keys = 1;
+  l4->records[0].key = 50;
+  strcpy(l4->records[0].value, "val50");
+  l4->right_sibling_page_num = PAGE_NULL;
+
+  char result_buf[VALUE_SIZE];
+  size_t value_size = 0;
+  read_count = 0;
+  write_count = 0;
+  file_read_page_Stub(counting_read_page);
+  file_write_page_Stub(counting_write_page);
+  TEST_ASSERT_EQUAL(SUCCESS,
+                    delete_value(20, result_buf, sizeof(result_buf),
+                                 &value_size));
+  TEST_ASSERT_EQUAL_INT(3, read_count);
+  TEST_ASSERT_EQUAL_INT(1, write_count);
+  TEST_ASSERT_EQUAL_STRING("val20", result_buf);
+  TEST_ASSERT_EQUAL_UINT64(5, value_size);
+
+  leaf_page_t *l3_final = (leaf_page_t *)&MOCK_PAGES[P3];
+  TEST_ASSERT_EQUAL_INT(2, l3_final->num_of_keys);
+  TEST_ASSERT_EQUAL_INT64(30, leaf_key(l3_final, 1));
+
+  // 없는 키는 아무것도 쓰지 않음
+  write_count = 0;
+  TEST_ASSERT_EQUAL(FAILURE, delete_value(20, result_buf, sizeof(result_buf),
+                                          NULL));
+  TEST_ASSERT_EQUAL_INT(0, write_count);
+
+  // 비게 된 P4는 P3와 병합되고 루트가 붕괴됨
+  file_free_page_Expect(P4);
+  file_free_page_Expect(ROOT_NUM);
+  TEST_ASSERT_EQUAL(SUCCESS, delete_value(50, result_buf, sizeof(result_buf),
+                                          NULL));
+  TEST_ASSERT_EQUAL_STRING("val50", result_buf);
+  TEST_ASSERT_EQUAL_HEX64(P3, h0->root_page_num);
+}
+
+static int visited_pages;
+
+/**
+ * @brief 모든 leaf의 깊이가 같고, 루트가 아닌 페이지가 MIN_KEYS 이상의 키를
+ * 가지며, 키가 [low, high] 안에 있는지 확인하고 레코드 수를 돌려줌
+ */
+static int check_subtree(pagenum_t page_num, int depth, int *leaf_depth,
+                         int64_t low, int64_t high) {
+  visited_pages++;
+  page_t page_buf;
+  MOCK_file_read_page(page_num, &page_buf, 0);
+  page_header_t *page_header = (page_header_t *)&page_buf;
+  if (depth > 0) {
+    TEST_ASSERT_GREATER_OR_EQUAL_INT(MIN_KEYS, page_header->num_of_keys);
+  }
+
+  if (page_header->is_leaf == LEAF) {
+    if (*leaf_depth < 0) {
+      *leaf_depth = depth;
+    }
+    TEST_ASSERT_EQUAL_INT(*leaf_depth, depth);
+    leaf_page_t *leaf = (leaf_page_t *)&page_buf;
+    for (int i = 0; i < leaf->num_of_keys; i++) {
+      TEST_ASSERT_TRUE(low <= leaf_key(leaf, i) && leaf_key(leaf, i) <= high);
+    }
+    return leaf->num_of_keys;
+  }
+
+  internal_page_t *internal = (internal_page_t *)&page_buf;
+  int n = internal->num_of_keys;
+  int records = check_subtree(internal->one_more_page_num, depth + 1,
+                              leaf_depth, low,
+                              n > 0 ? internal_key(internal, 0) - 1 : high);
+  for (int i = 0; i < n; i++) {
+    records += check_subtree(
+        internal_child(internal, i), depth + 1, leaf_depth,
+        internal_key(internal, i),
+        i + 1 < n ? internal_key(internal, i + 1) - 1 : high);
+  }
+  return records;
+}
+
+/**
+ * @brief delete_range는 범위 안의 서브트리를 통째로 떼어내고, 경계 leaf만
+ * 레코드 단위로 지운 뒤 leaf 체인과 경계 경로를 정리하는지 확인
+ */
+void test_delete_range(void) {
+  file_alloc_page_Stub(MOCK_file_alloc_page);
+  file_free_page_Stub(MOCK_file_free_page);
+  file_free_pages_Stub(MOCK_file_free_pages);
+  init_header_page_for_mock();
+
+  const int N = 150;
+  char value[VALUE_SIZE];
+  for (int key = 1; key <= N; key++) {
+    snprintf(value, sizeof(value), "val%d", key);
+    TEST_ASSERT_EQUAL(SUCCESS, insert(key, value));
+  }
+  TEST_ASSERT_EQUAL_INT64(0, delete_range(20, 10));
+  TEST_ASSERT_EQUAL_INT64(0, delete_range(N + 1, N + 100));
+  TEST_ASSERT_EQUAL_INT64(101, delete_range(20, 120));
+  TEST_ASSERT_EQUAL_INT64(0, delete_range(20, 120));
+
+  // 남은 키는 찾을 수 있고 leaf 체인은 정렬된 순서로 이어짐
+  int leaf_depth = -1;
+  visited_pages = 0;
+  pagenum_t root = get_header_page().root_page_num;
+  TEST_ASSERT_EQUAL_INT(N - 101, check_subtree(root, 0, &leaf_depth,
+                                               INT64_MIN, INT64_MAX));
+  int64_t expected = 1;
+  for (pagenum_t leaf_num = find_leaf(INT64_MIN); leaf_num != PAGE_NULL;) {
+    leaf_page_t leaf = get_leaf_page(leaf_num);
+    for (int i = 0; i < leaf.num_of_keys; i++) {
+      TEST_ASSERT_EQUAL_INT64(expected, leaf_key(&leaf, i));
+      expected = expected == 19 ? 121 : expected + 1;
+    }
+    leaf_num = leaf.right_sibling_page_num;
+  }
+  TEST_ASSERT_EQUAL_INT64(N + 1, expected);
+  TEST_ASSERT_EQUAL(FAILURE, find(20, value));
+  TEST_ASSERT_EQUAL(SUCCESS, find(121, value));
+  TEST_ASSERT_EQUAL_STRING("val121", value);
+
+  // 떼어낸 페이지는 모두 free list로 돌아감
+  header_page_t header = get_header_page();
+  int free_pages = 0;
+  for (pagenum_t p = header.free_page_num; p != PAGE_NULL;
+       p = ((free_page_t *)&MOCK_PAGES[p])->next_free_page_num) {
+    free_pages++;
+  }
+  TEST_ASSERT_GREATER_THAN(0, free_pages);
+  TEST_ASSERT_EQUAL_UINT64(header.num_of_pages - 1,
+                           visited_pages + free_pages);
+
+  // 양 끝이 열린 범위와 한 leaf 안의 범위
+  TEST_ASSERT_EQUAL_INT64(5, delete_range(INT64_MIN, 5));
+  TEST_ASSERT_EQUAL_INT64(11, delete_range(140, INT64_MAX));
+  TEST_ASSERT_EQUAL_INT64(1, delete_range(122, 122));
+  leaf_depth = -1;
+  root = get_header_page().root_page_num;
+  TEST_ASSERT_EQUAL_INT(N - 118, check_subtree(root, 0, &leaf_depth,
+                                               INT64_MIN, INT64_MAX));
+
+  TEST_ASSERT_EQUAL_INT64(N - 118, delete_range(INT64_MIN, INT64_MAX));
+  TEST_ASSERT_EQUAL_HEX64(PAGE_NULL, get_header_page().root_page_num);
+}
+
+/**
+ * @brief destroy_tree는 페이지를 하나씩 읽거나 해제하지 않고 파일을 헤더
+ * 페이지까지 잘라냄
+ */
+void test_destroy_tree_truncates_file(void) {
+  file_alloc_page_Stub(MOCK_file_alloc_page);
+  init_header_page_for_mock();
+  char value[VALUE_SIZE];
+  for (int key = 1; key <= 50; key++) {
+    snprintf(value, sizeof(value), "val%d", key);
+    TEST_ASSERT_EQUAL(SUCCESS, insert(key, value));
+  }
+
+  read_count = 0;
+  write_count = 0;
+  file_read_page_Stub(counting_read_page);
+  file_write_page_Stub(counting_write_page);
+  file_truncate_Expect();
+  destroy_tree();
+  TEST_ASSERT_EQUAL_INT(0, read_count);
+  TEST_ASSERT_EQUAL_INT(0, write_count);
+}
+
+static int count_leaves(void) {
+  int leaves = 0;
+  for (pagenum_t leaf_num = find_leaf(INT64_MIN); leaf_num != PAGE_NULL;
+       leaf_num = get_leaf_page(leaf_num).right_sibling_page_num) {
+    leaves++;
+  }
+  return leaves;
+}
+
+/**
+ * @brief defer_merges면 delete는 비게 된 leaf를 기록만 하고 페이지를 해제하지
+ * 않으며, rebalance_deferred가 나중에 병합하거나 이웃에서 채움
+ */
+void test_deferred_merges(void) {
+  file_alloc_page_Stub(MOCK_file_alloc_page);
+  file_free_page_Stub(MOCK_file_free_page);
+  init_header_page_for_mock();
+  const int N = 150;
+  char value[VALUE_SIZE];
+  for (int key = 1; key <= N; key++) {
+    snprintf(value, sizeof(value), "val%d", key);
+    TEST_ASSERT_EQUAL(SUCCESS, insert(key, value));
+  }
+  int leaves = count_leaves();
+
+  defer_merges = true;
+  leaf_page_t second =
+      get_leaf_page(get_leaf_page(find_leaf(1)).right_sibling_page_num);
+  int64_t low = leaf_key(&second, 0);
+  int64_t high = leaf_key(&second, second.num_of_keys - 1);
+  for (int64_t key = low; key <= high; key++) {
+    TEST_ASSERT_EQUAL(SUCCESS, delete (key));
+  }
+
+  // 빈 leaf가 트리에 남아 있어도 검색은 그대로 동작함
+  TEST_ASSERT_EQUAL_INT(leaves, count_leaves());
+  TEST_ASSERT_EQUAL_INT(0, get_leaf_page(find_leaf(low)).num_of_keys);
+  TEST_ASSERT_EQUAL_INT(1, deferred_merges());
+  TEST_ASSERT_EQUAL(FAILURE, find(low, value));
+  TEST_ASSERT_EQUAL(SUCCESS, find(high + 1, value));
+
+  // 이웃에서 레코드를 받아와 빈 leaf가 없어짐
+  TEST_ASSERT_EQUAL_INT(0, rebalance_deferred(DEFERRED_MERGE_BATCH));
+  int leaf_depth = -1;
+  pagenum_t root = get_header_page().root_page_num;
+  TEST_ASSERT_EQUAL_INT(N - (high - low + 1),
+                        check_subtree(root, 0, &leaf_depth, INT64_MIN,
+                                      INT64_MAX));
+
+
+  // 다시 채워진 leaf는 건너뜀
+  for (int64_t key = high + 1; key <= high + 3; key++) {
+    TEST_ASSERT_EQUAL(SUCCESS, delete (key));
+  }
+  TEST_ASSERT_EQUAL_INT(1, deferred_merges());
+  snprintf(value, sizeof(value), "val%d", (int)high + 1);
+  TEST_ASSERT_EQUAL(SUCCESS, insert(high + 1, value));
+  TEST_ASSERT_EQUAL_INT(0, rebalance_deferred(DEFERRED_MERGE_BATCH));
+  TEST_ASSERT_EQUAL_INT(1, get_leaf_page(find_leaf(high + 1)).num_of_keys);
+}
+
+/**
+ * @brief merge_threshold보다 키가 적어진 leaf는 바로 이웃과 병합되거나 이웃에서
+ * 레코드를 받아옴
+ */
+void test_merge_threshold(void) {
+  file_alloc_page_Stub(MOCK_file_alloc_page);
+  file_free_page_Stub(MOCK_file_free_page);
+  init_header_page_for_mock();
+  char value[VALUE_SIZE];
+  for (int key = 1; key <= 150; key++) {
+    snprintf(value, sizeof(value), "val%d", key);
+    TEST_ASSERT_EQUAL(SUCCESS, insert(key, value));
+  }
+  int leaves = count_leaves();
+  // 순서대로 넣으면 앞쪽 leaf는 가득 참: [1 2 3] [4 5 6] ...
+  TEST_ASSERT_EQUAL_INT(3, get_leaf_page(find_leaf(1)).num_of_keys);
+  TEST_ASSERT_EQUAL_INT(3, get_leaf_page(find_leaf(4)).num_of_keys);
+
+  merge_threshold = 2;
+  TEST_ASSERT_EQUAL(SUCCESS, delete (1));
+  TEST_ASSERT_EQUAL_INT(2, get_leaf_page(find_leaf(2)).num_of_keys);
+  // [3] [4 5 6] -> [3 4] [5 6]
+  TEST_ASSERT_EQUAL(SUCCESS, delete (2));
+  TEST_ASSERT_EQUAL_INT(2, get_leaf_page(find_leaf(3)).num_of_keys);
+  TEST_ASSERT_EQUAL_INT(2, get_leaf_page(find_leaf(5)).num_of_keys);
+  // [4] [5 6]: 합칠 수 없고 이웃도 기준 이하라 그대로 둠
+  TEST_ASSERT_EQUAL(SUCCESS, delete (3));
+  TEST_ASSERT_EQUAL_INT(1, get_leaf_page(find_leaf(4)).num_of_keys);
+  TEST_ASSERT_EQUAL_INT(2, get_leaf_page(find_leaf(5)).num_of_keys);
+  TEST_ASSERT_EQUAL_INT(leaves, count_leaves());
+  // [5 6]에서 하나를 지우면 [4] [6]이 합쳐짐
+  TEST_ASSERT_EQUAL(SUCCESS, delete (5));
+  TEST_ASSERT_EQUAL_INT(leaves - 1, count_leaves());
+  TEST_ASSERT_EQUAL(find_leaf(4), find_leaf(6));
+  TEST_ASSERT_EQUAL(SUCCESS, find(4, value));
+  for (int key = 6; key <= 150; key++) {
+    TEST_ASSERT_EQUAL(SUCCESS, find(key, value));
+  }
+}
+
+/**
+ * @brief delete_range도 경계 경로에서 merge_threshold보다 키가 적어진 leaf를
+ * 병합하고, 병합도 재분배도 못 하는 leaf는 건너뜀
+ */
+void test_delete_range_uses_merge_threshold(void) {
+  file_alloc_page_Stub(MOCK_file_alloc_page);
+  file_free_page_Stub(MOCK_file_free_page);
+  file_free_pages_Stub(MOCK_file_free_pages);
+  init_header_page_for_mock();
+  const int N = 150;
+  char value[VALUE_SIZE];
+  for (int key = 1; key <= N; key++) {
+    snprintf(value, sizeof(value), "val%d", key);
+    TEST_ASSERT_EQUAL(SUCCESS, insert(key, value));
+  }
+  int leaves = count_leaves();
+  merge_threshold = 2;
+
+  // [1 2 3] [4 5 6] -> [1] [6] -> [1 6]
+  TEST_ASSERT_EQUAL_INT64(4, delete_range(2, 5));
+  TEST_ASSERT_EQUAL_INT(leaves - 1, count_leaves());
+  TEST_ASSERT_EQUAL(find_leaf(1), find_leaf(6));
+
+  // [1 6] [7]: 합칠 수도 채울 수도 없는 leaf는 그대로 둠
+  TEST_ASSERT_EQUAL_INT64(2, delete_range(8, 9));
+  TEST_ASSERT_EQUAL_INT(1, get_leaf_page(find_leaf(7)).num_of_keys);
+  TEST_ASSERT_EQUAL_INT(leaves - 1, count_leaves());
+
+  // [7] [10] -> [7 10]
+  TEST_ASSERT_EQUAL_INT64(2, delete_range(11, 12));
+  TEST_ASSERT_EQUAL_INT(leaves - 2, count_leaves());
+  TEST_ASSERT_EQUAL(find_leaf(7), find_leaf(10));
+
+  int leaf_depth = -1;
+  pagenum_t root = get_header_page().root_page_num;
+  TEST_ASSERT_EQUAL_INT(N - 8, check_subtree(root, 0, &leaf_depth, INT64_MIN,
+                                             INT64_MAX));
+  for (int key = 13; key <= N; key++) {
+    TEST_ASSERT_EQUAL(SUCCESS, find(key, value));
+  }
+}
+
+/**
+ * @brief lazy_deletes면 delete는 leaf 한 페이지만 써서 레코드를 tombstone으로
+ * 표시하고, 검색과 범위 검색은 이를 건너뛰며, rebalance_deferred가 치움
+ */
+void test_lazy_deletes_leave_tombstones(void) {
+  file_alloc_page_Stub(MOCK_file_alloc_page);
+  file_free_page_Stub(MOCK_file_free_page);
+  init_header_page_for_mock();
+  const int N = 60;
+  char value[VALUE_SIZE];
+  for (int key = 1; key <= N; key++) {
+    snprintf(value, sizeof(value), "val%d", key);
+    TEST_ASSERT_EQUAL(SUCCESS, insert(key, value));
+  }
+  int leaves = count_leaves();
+
+  lazy_deletes = true;
+  write_count = 0;
+  file_write_page_Stub(counting_write_page);
+  for (int key = 10; key <= 30; key++) {
+    TEST_ASSERT_EQUAL(SUCCESS, delete (key));
+  }
+  TEST_ASSERT_EQUAL_INT(21, write_count);
+  file_write_page_Stub(MOCK_file_write_page);
+  TEST_ASSERT_EQUAL_INT(leaves, count_leaves());
+  TEST_ASSERT_EQUAL_INT(21, deferred_merges());
+
+  leaf_page_t leaf = get_leaf_page(find_leaf(20));
+  TEST_ASSERT_TRUE(leaf_is_tombstone(&leaf, leaf_lower_bound(&leaf, 20)));
+  TEST_ASSERT_EQUAL(FAILURE, find(20, value));
+  TEST_ASSERT_EQUAL(FAILURE, delete (20));
+  TEST_ASSERT_EQUAL(FAILURE, update(20, "again"));
+  int64_t keys[N];
+  pagenum_t pages[N];
+  int indices[N];
+  TEST_ASSERT_EQUAL_INT(2, find_range(9, 31, keys, pages, indices));
+  TEST_ASSERT_EQUAL_INT64(9, keys[0]);
+  TEST_ASSERT_EQUAL_INT64(31, keys[1]);
+
+  // tombstone이 된 키는 다시 넣을 수 있음
+  TEST_ASSERT_EQUAL(SUCCESS, insert(20, "again"));
+  TEST_ASSERT_EQUAL(SUCCESS, find(20, value));
+  TEST_ASSERT_EQUAL_STRING("again", value);
+  TEST_ASSERT_EQUAL_INT64(1, delete_range(19, 21));
+
+  // 쓸고 나면 tombstone이 없고 트리가 정리됨
+  TEST_ASSERT_EQUAL_INT(0, rebalance_deferred(DEFERRED_MERGE_CAPACITY));
+  for (pagenum_t leaf_num = find_leaf(INT64_MIN); leaf_num != PAGE_NULL;
+       leaf_num = leaf.right_sibling_page_num) {
+    leaf = get_leaf_page(leaf_num);
+    TEST_ASSERT_EQUAL_INT(leaf.num_of_keys, leaf_live_records(&leaf));
+  }
+  TEST_ASSERT_LESS_THAN(leaves, count_leaves());
+  int leaf_depth = -1;
+  pagenum_t root = get_header_page().root_page_num;
+  TEST_ASSERT_EQUAL_INT(N - 21, check_subtree(root, 0, &leaf_depth, INT64_MIN,
+                                              INT64_MAX));
+}
+
+/**
+ * @brief split, 병합, 재분배가 그 일을 한 연산의 카운터에 더해짐
+ */
+void test_stats_count_structure_changes(void) {
+  file_alloc_page_Stub(MOCK_file_alloc_page);
+  file_free_page_Stub(MOCK_file_free_page);
+  init_header_page_for_mock();
+  stats_reset();
+  char value[VALUE_SIZE];
+  for (int key = 1; key <= 150; key++) {
+    snprintf(value, sizeof(value), "val%d", key);
+    stats_begin(STAT_OP_INSERT);
+    TEST_ASSERT_EQUAL(SUCCESS, insert(key, value));
+  }
+  db_stats_t stats;
+  stats_snapshot(&stats);
+  TEST_ASSERT_EQUAL_UINT64(150, stats.calls[STAT_OP_INSERT]);
+  TEST_ASSERT_TRUE(stats.counters[STAT_OP_INSERT][STAT_SPLITS] >=
+                   (uint64_t)count_leaves() - 1);
+  TEST_ASSERT_EQUAL_UINT64(0, stats_total(&stats, STAT_MERGES));
+
+  // test_merge_threshold와 같은 순서: 2에서 재분배, 5에서 병합
+  merge_threshold = 2;
+  const int64_t deleted[] = {1, 2, 3, 5};
+  for (int i = 0; i < 4; i++) {
+    stats_begin(STAT_OP_DELETE);
+    TEST_ASSERT_EQUAL(SUCCESS, delete (deleted[i]));
+  }
+  stats_snapshot(&stats);
+  TEST_ASSERT_EQUAL_UINT64(4, stats.calls[STAT_OP_DELETE]);
+  TEST_ASSERT_EQUAL_UINT64(1, stats.counters[STAT_OP_DELETE][STAT_MERGES]);
+  TEST_ASSERT_EQUAL_UINT64(
+      1, stats.counters[STAT_OP_DELETE][STAT_REDISTRIBUTIONS]);
+  TEST_ASSERT_EQUAL_UINT64(1, stats_total(&stats, STAT_MERGES));
+  TEST_ASSERT_EQUAL_UINT64(0, stats.counters[STAT_OP_DELETE][STAT_SPLITS]);
+}
+
+/**
+ * @brief 파일 여기저기 흩어진 leaf들을 조금씩 옮겨서 leaf chain 순서대로
+ * 파일에 놓이게 하는지 확인
+ */
+void test_defragment_leaves_into_file_order(void) {
+  init_header_page_for_mock();
+  file_alloc_page_Stub(MOCK_file_alloc_page);
+  file_alloc_page_at_end_Stub(MOCK_file_alloc_page_at_end);
+
+  file_free_page_Stub(MOCK_file_free_page);
+
+  // 긴 value를 순서 없이 넣어서 leaf들이 파일 여기저기 흩어지게 함
+  char value[VALUE_SIZE];
+  memset(value, 'V', sizeof(value));
+  value[LEAF_INLINE_MAX] = '\0';
+  const int64_t key_count = 120;
+  uint32_t seed = 12345;
+  bool inserted[121] = {false};
+  for (int64_t i = 0; i < key_count; i++) {
+    seed = seed * 1103515245u + 12345u;
+    int64_t key = 1 + (seed >> 16) % key_count;
+    while (inserted[key]) {
+      key = key % key_count + 1;
+    }
+    inserted[key] = true;
+    TEST_ASSERT_EQUAL(SUCCESS, insert(key, value));
+  }
+
+  // 한 번에 4개씩 leaf를 방문하면서 옮김
+  int moved = 0;
+  for (int step = 0; step < 50; step++) {
+    moved += defragment_leaves(4);
+  }
+  TEST_ASSERT_GREATER_THAN(0, moved);
+
+  // leaf chain이 파일에서 연속된 페이지
+  pagenum_t leaf_num = find_leaf(1);
+  leaf_page_t leaf = get_leaf_page(leaf_num);
+  while (leaf.right_sibling_page_num != PAGE_NULL) {
+    TEST_ASSERT_EQUAL(leaf_num + 1, leaf.right_sibling_page_num);
+    leaf_num = leaf.right_sibling_page_num;
+    leaf = get_leaf_page(leaf_num);
+  }
+  TEST_ASSERT_EQUAL_INT(0, defragment_leaves(1000));
+
+  char result_buf[VALUE_SIZE];
+  for (int64_t key = 1; key <= key_count; key++) {
+    TEST_ASSERT_EQUAL(SUCCESS, find(key, result_buf));
+  }
 }
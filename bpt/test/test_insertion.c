@@ -1,14 +1,22 @@
 #include "bpt.h"
 #include "bpt_internal.h"
 #include "bptree.h"
+#include "bptree_defrag.h"
 #include "bptree_delete.h"
 #include "bptree_find.h"
 #include "bptree_insert.h"
+#include "bptree_internal.h"
+#include "bptree_leaf.h"
+#include "bptree_overflow.h"
+#include "bptree_search.h"
 #include "bptree_utils.h"
+#include "bptree_vlog.h"
 #include "helper_mock.h"
 #include "mock_file.h"
 #include "page.h"
+#include "stats.h"
 #include "unity.h"
+#include "vlog.h"
 
 #define RECORD_CNT 2
 #define ENTRY_CNT 16
@@ -25,6 +33,8 @@ void setUp(void) {
   file_alloc_page_Stub(MOCK_file_alloc_page);
   file_free_page_Stub(MOCK_file_free_page);
   init_header_page_for_mock();
+  // 아래 케이스들은 순서대로 삽입해도 반씩 나누는 분할을 기준으로 함
+  append_fill_factor = SPLIT_FILL_FACTOR;
 }
 
 void tearDown(void) {}
@@ -58,9 +68,8 @@ void test_insert_start_new_tree(void) {
   leaf_page_t root_page = get_leaf_page(final_header.root_page_num);
   TEST_ASSERT_EQUAL(LEAF, root_page.is_leaf);
   TEST_ASSERT_EQUAL_INT(1, root_page.num_of_keys);
-  TEST_ASSERT_EQUAL_INT64(PAGE_NULL, root_page.parent_page_num);
-  TEST_ASSERT_EQUAL_INT64(key, root_page.records[0].key);
-  TEST_ASSERT_EQUAL_STRING(value, root_page.records[0].value);
+  TEST_ASSERT_EQUAL_INT64(key, leaf_key(&root_page, 0));
+  TEST_ASSERT_EQUAL_STRING(value, get_leaf_value(&root_page, 0));
 }
 
 /**
@@ -77,12 +86,11 @@ void test_insert_into_leaf_simple(void) {
   // 결과 검증
   leaf_page_t leaf = get_leaf_page(1);
   TEST_ASSERT_EQUAL_INT(2, leaf.num_of_keys);
-  TEST_ASSERT_EQUAL_INT64(PAGE_NULL, leaf.parent_page_num);
 
-  TEST_ASSERT_EQUAL_INT64(5, leaf.records[0].key);
-  TEST_ASSERT_EQUAL_STRING(value_new, leaf.records[0].value);
-  TEST_ASSERT_EQUAL_INT64(10, leaf.records[1].key);
-  TEST_ASSERT_EQUAL_STRING("Value_10", leaf.records[1].value);
+  TEST_ASSERT_EQUAL_INT64(5, leaf_key(&leaf, 0));
+  TEST_ASSERT_EQUAL_STRING(value_new, get_leaf_value(&leaf, 0));
+  TEST_ASSERT_EQUAL_INT64(10, leaf_key(&leaf, 1));
+  TEST_ASSERT_EQUAL_STRING("Value_10", get_leaf_value(&leaf, 1));
 
   // 중복 삽입 시도
   TEST_ASSERT_EQUAL(FAILURE, insert(key_new, value_new));
@@ -122,8 +130,8 @@ void test_insert_split_leaf_and_new_root(void) {
 
   leaf_page_t leaf_full = get_leaf_page(1);
   TEST_ASSERT_EQUAL_INT(RECORD_CNT, leaf_full.num_of_keys);
-  TEST_ASSERT_EQUAL_INT64(1, leaf_full.records[0].key);
-  TEST_ASSERT_EQUAL_INT64(RECORD_CNT, leaf_full.records[RECORD_CNT - 1].key);
+  TEST_ASSERT_EQUAL_INT64(1, leaf_key(&leaf_full, 0));
+  TEST_ASSERT_EQUAL_INT64(RECORD_CNT, leaf_key(&leaf_full, RECORD_CNT - 1));
 
   // split 발생시키기
   int64_t key_new = 3;
@@ -140,27 +148,24 @@ void test_insert_split_leaf_and_new_root(void) {
   // Old Leaf (P2) 검증
   leaf_page_t old_leaf = get_leaf_page(1);
   TEST_ASSERT_EQUAL_INT(1, old_leaf.num_of_keys);
-  TEST_ASSERT_EQUAL_INT64(3, old_leaf.parent_page_num);
   TEST_ASSERT_EQUAL_INT64(2, old_leaf.right_sibling_page_num);
-  TEST_ASSERT_EQUAL_INT64(1, old_leaf.records[0].key);
+  TEST_ASSERT_EQUAL_INT64(1, leaf_key(&old_leaf, 0));
 
   // New Leaf (P3) 검증
   leaf_page_t new_leaf = get_leaf_page(2);
   TEST_ASSERT_EQUAL_INT(2, new_leaf.num_of_keys);
-  TEST_ASSERT_EQUAL_INT64(3, new_leaf.parent_page_num);
   TEST_ASSERT_EQUAL_INT64(PAGE_NULL, new_leaf.right_sibling_page_num);
-  TEST_ASSERT_EQUAL_INT64(2, new_leaf.records[0].key);
-  TEST_ASSERT_EQUAL_INT64(3, new_leaf.records[1].key);
+  TEST_ASSERT_EQUAL_INT64(2, leaf_key(&new_leaf, 0));
+  TEST_ASSERT_EQUAL_INT64(3, leaf_key(&new_leaf, 1));
 
   // New Root (P4) 검증
   internal_page_t new_root = get_internal_page(3);
   TEST_ASSERT_EQUAL(INTERNAL, new_root.is_leaf);
   TEST_ASSERT_EQUAL_INT(1, new_root.num_of_keys);
-  TEST_ASSERT_EQUAL_INT64(PAGE_NULL, new_root.parent_page_num);
 
   TEST_ASSERT_EQUAL_INT64(1, new_root.one_more_page_num);
-  TEST_ASSERT_EQUAL_INT64(2, new_root.entries[0].key);
-  TEST_ASSERT_EQUAL_INT64(2, new_root.entries[0].page_num);
+  TEST_ASSERT_EQUAL_INT64(2, internal_key(&new_root, 0));
+  TEST_ASSERT_EQUAL_INT64(2, internal_child(&new_root, 0));
 }
 
 /**
@@ -187,29 +192,26 @@ void test_insert_into_internal_node_simple(void) {
   // Old Leaf (P3) 검증 (2)
   leaf_page_t old_leaf = get_leaf_page(2);
   TEST_ASSERT_EQUAL_INT(1, old_leaf.num_of_keys);
-  TEST_ASSERT_EQUAL_INT64(3, old_leaf.parent_page_num);
   TEST_ASSERT_EQUAL_INT64(4, old_leaf.right_sibling_page_num);
-  TEST_ASSERT_EQUAL_INT64(2, old_leaf.records[0].key);
+  TEST_ASSERT_EQUAL_INT64(2, leaf_key(&old_leaf, 0));
 
   // New Leaf (P5) 검증 (3, 4)
   leaf_page_t new_leaf = get_leaf_page(4);
   TEST_ASSERT_EQUAL_INT(2, new_leaf.num_of_keys);
-  TEST_ASSERT_EQUAL_INT64(3, new_leaf.parent_page_num);
   TEST_ASSERT_EQUAL_INT64(PAGE_NULL, new_leaf.right_sibling_page_num);
-  TEST_ASSERT_EQUAL_INT64(3, new_leaf.records[0].key);
-  TEST_ASSERT_EQUAL_INT64(4, new_leaf.records[1].key);
+  TEST_ASSERT_EQUAL_INT64(3, leaf_key(&new_leaf, 0));
+  TEST_ASSERT_EQUAL_INT64(4, leaf_key(&new_leaf, 1));
 
   // Root (P4) 검증
   internal_page_t root = get_internal_page(3);
   TEST_ASSERT_EQUAL(INTERNAL, root.is_leaf);
   TEST_ASSERT_EQUAL_INT(2, root.num_of_keys);
-  TEST_ASSERT_EQUAL_INT64(PAGE_NULL, root.parent_page_num);
 
-  TEST_ASSERT_EQUAL_INT64(2, root.entries[0].key);
-  TEST_ASSERT_EQUAL_INT64(2, root.entries[0].page_num);
+  TEST_ASSERT_EQUAL_INT64(2, internal_key(&root, 0));
+  TEST_ASSERT_EQUAL_INT64(2, internal_child(&root, 0));
 
-  TEST_ASSERT_EQUAL_INT64(3, root.entries[1].key);
-  TEST_ASSERT_EQUAL_INT64(4, root.entries[1].page_num);
+  TEST_ASSERT_EQUAL_INT64(3, internal_key(&root, 1));
+  TEST_ASSERT_EQUAL_INT64(4, internal_child(&root, 1));
 
   TEST_ASSERT_EQUAL_INT64(1, root.one_more_page_num);
 }
@@ -233,7 +235,7 @@ void test_insert_split_internal_node(void) {
   // Root P4가 16 entries로 가득 찼는지 확인
   internal_page_t root_full = get_internal_page(3);
   TEST_ASSERT_EQUAL_INT(16, root_full.num_of_keys);
-  TEST_ASSERT_EQUAL_INT64(17, root_full.entries[15].key);
+  TEST_ASSERT_EQUAL_INT64(17, internal_key(&root_full, 15));
 
   // Root 분할 (3단계 트리 생성)
   // 키 19 삽입 -> Leaf Split (Promoted Key 18)
@@ -256,8 +258,8 @@ void test_insert_split_internal_node(void) {
   internal_page_t new_root = get_internal_page(new_root_num);
   TEST_ASSERT_EQUAL_INT(1, new_root.num_of_keys);
   TEST_ASSERT_EQUAL_INT64(old_root_num, new_root.one_more_page_num);
-  TEST_ASSERT_EQUAL_INT64(10, new_root.entries[0].key);
-  TEST_ASSERT_EQUAL_INT64(new_internal_num, new_root.entries[0].page_num);
+  TEST_ASSERT_EQUAL_INT64(10, internal_key(&new_root, 0));
+  TEST_ASSERT_EQUAL_INT64(new_internal_num, internal_child(&new_root, 0));
 
   // 내부 노드(P21)를 다시 채우기 (8 -> 16 entries)
   i = key_to_split_root + 1;
@@ -271,7 +273,7 @@ void test_insert_split_internal_node(void) {
   // Internal P21이 16 entries로 가득 찼는지 확인
   internal_page_t p21_full = get_internal_page(new_internal_num);
   TEST_ASSERT_EQUAL_INT(16, p21_full.num_of_keys);
-  TEST_ASSERT_EQUAL_INT64(26, p21_full.entries[15].key);
+  TEST_ASSERT_EQUAL_INT64(26, internal_key(&p21_full, 15));
 
   // 내부 노드(P21) 분할 강제 (Key 28 삽입) -> split internal test
   int64_t key_to_split_internal = 28;
@@ -285,25 +287,367 @@ void test_insert_split_internal_node(void) {
   // Root(P20) 검증
   internal_page_t final_root = get_internal_page(new_root_num);
   TEST_ASSERT_EQUAL_INT(2, final_root.num_of_keys);
-  TEST_ASSERT_EQUAL_INT64(10, final_root.entries[0].key);
-  TEST_ASSERT_EQUAL_INT64(19, final_root.entries[1].key);
-  TEST_ASSERT_EQUAL_INT64(p31_new_internal_num, final_root.entries[1].page_num);
+  TEST_ASSERT_EQUAL_INT64(10, internal_key(&final_root, 0));
+  TEST_ASSERT_EQUAL_INT64(19, internal_key(&final_root, 1));
+  TEST_ASSERT_EQUAL_INT64(p31_new_internal_num,
+                          internal_child(&final_root, 1));
 
   // Old Internal Node(P21) 검증
   internal_page_t p21_after_split = get_internal_page(new_internal_num);
   TEST_ASSERT_EQUAL_INT(8, p21_after_split.num_of_keys);
-  TEST_ASSERT_EQUAL_INT64(new_root_num, p21_after_split.parent_page_num);
-  TEST_ASSERT_EQUAL_INT64(18, p21_after_split.entries[7].key);
+  TEST_ASSERT_EQUAL_INT64(18, internal_key(&p21_after_split, 7));
 
   // New Internal Node(P31) 검증
   internal_page_t p31_new = get_internal_page(p31_new_internal_num);
   TEST_ASSERT_EQUAL_INT(8, p31_new.num_of_keys);
-  TEST_ASSERT_EQUAL_INT64(new_root_num, p31_new.parent_page_num);
-  TEST_ASSERT_EQUAL_INT64(20, p31_new.entries[0].key);
+  TEST_ASSERT_EQUAL_INT64(20, internal_key(&p31_new, 0));
 }
 
 /**
- * @brief Case 7: cut 함수 검증
+ * @brief Case 7: 이전 포맷(record_t 배열) leaf는 그대로 읽히고, 수정될 때
+ * LEAF_FORMAT_SLOTTED로 변환되는지 검증
+ */
+void test_insert_upgrades_legacy_leaf(void) {
+  pagenum_t root_num = file_alloc_page(PAGE_NULL);
+  legacy_leaf_page_t *legacy = (legacy_leaf_page_t *)&MOCK_PAGES[root_num];
+  legacy->parent_page_num = PAGE_NULL;
+  legacy->is_leaf = LEAF;
+  legacy->num_of_keys = 1;
+  legacy->format = LEAF_FORMAT_RECORDS;
+  legacy->right_sibling_page_num = PAGE_NULL;
+  legacy->records[0].key = 10;
+  strcpy(legacy->records[0].value, "Value_10");
+
+  char result_buf[VALUE_SIZE];
+  TEST_ASSERT_EQUAL(SUCCESS, find(10, result_buf));
+  TEST_ASSERT_EQUAL_STRING("Value_10", result_buf);
+
+  TEST_ASSERT_EQUAL(SUCCESS, insert(5, "Value_05"));
+
+  leaf_page_t leaf = get_leaf_page(root_num);
+  TEST_ASSERT_EQUAL_UINT32(LEAF_FORMAT_SLOTTED, leaf.format);
+  TEST_ASSERT_EQUAL_INT(2, leaf.num_of_keys);
+  TEST_ASSERT_EQUAL_INT64(5, leaf.keys[0]);
+  TEST_ASSERT_EQUAL_STRING("Value_05", get_leaf_value(&leaf, 0));
+  TEST_ASSERT_EQUAL_INT64(10, leaf.keys[1]);
+  TEST_ASSERT_EQUAL_STRING("Value_10", get_leaf_value(&leaf, 1));
+}
+
+/**
+ * @brief Case 8: slotted leaf에서 삭제 시 페이지가 압축되고, 분할 지점이
+ * 레코드 수가 아닌 바이트 기준으로 정해지는지 검증
+ */
+void test_slotted_leaf_compaction_and_split_point(void) {
+  page_t page;
+  memset(&page, 0, page_size);
+  leaf_page_t *leaf = (leaf_page_t *)&page;
+  leaf_clear_records(leaf);
+
+  leaf_insert_record(leaf, 0, 20, "a much longer value");
+  leaf_insert_record(leaf, 0, 10, "short");
+  TEST_ASSERT_EQUAL_UINT32(5 + 19, leaf->payload_size);
+  TEST_ASSERT_EQUAL_STRING("short", get_leaf_value(leaf, 0));
+  TEST_ASSERT_EQUAL_STRING("a much longer value", get_leaf_value(leaf, 1));
+
+  leaf_remove_record(leaf, 0);
+  TEST_ASSERT_EQUAL_INT(1, leaf->num_of_keys);
+  TEST_ASSERT_EQUAL_UINT32(19, leaf->payload_size);
+  TEST_ASSERT_EQUAL_INT64(20, leaf->keys[0]);
+  TEST_ASSERT_EQUAL_STRING("a much longer value", get_leaf_value(leaf, 0));
+  TEST_ASSERT_EQUAL_UINT64(LEAF_SLOT_SIZE + 19, leaf_used_size(leaf));
+  // 남은 공간은 0으로 비워짐
+  TEST_ASSERT_EQUAL_INT(0, leaf->body[leaf_used_size(leaf)]);
+
+  char long_value[101];
+  memset(long_value, 'x', 100);
+  long_value[100] = '\0';
+
+  leaf_slot_t records[3];
+  leaf_make_slot(1, long_value, &records[0]);
+  leaf_make_slot(2, "y", &records[1]);
+  leaf_make_slot(3, "z", &records[2]);
+  TEST_ASSERT_EQUAL_INT(1, leaf_split_point(records, 3, SPLIT_FILL_FACTOR));
+
+  leaf_make_slot(1, "x", &records[0]);
+  TEST_ASSERT_EQUAL_INT(1, leaf_split_point(records, 3, SPLIT_FILL_FACTOR));
+  leaf_make_slot(3, long_value, &records[2]);
+  TEST_ASSERT_EQUAL_INT(2, leaf_split_point(records, 3, SPLIT_FILL_FACTOR));
+}
+
+/**
+ * @brief Case 9: LEAF_INLINE_MAX보다 긴 값은 overflow 페이지 체인에 저장되고
+ * leaf에는 참조만 남으며, 삭제 시 체인이 해제되는지 검증
+ */
+void test_insert_large_value_uses_overflow_pages(void) {
+  const size_t length = 3 * page_size;
+  char *large_value = malloc(length + 1);
+  for (size_t i = 0; i < length; i++) {
+    large_value[i] = 'a' + i % 26;
+  }
+  large_value[length] = '\0';
+
+  TEST_ASSERT_EQUAL(SUCCESS, insert(10, large_value));
+  TEST_ASSERT_EQUAL(SUCCESS, insert(20, "small"));
+
+  // leaf(P1)에는 참조만 저장됨, 체인은 P2 ~ P5
+  leaf_page_t leaf = get_leaf_page(1);
+  TEST_ASSERT_EQUAL_INT(2, leaf.num_of_keys);
+  TEST_ASSERT_EQUAL_UINT32(sizeof(overflow_ref_t) + 5, leaf.payload_size);
+  TEST_ASSERT_EQUAL_UINT64(6, get_header_page().num_of_pages);
+
+  char *result_buf = malloc(length + 1);
+  size_t value_size = 0;
+  TEST_ASSERT_EQUAL(SUCCESS,
+                    find_value(10, result_buf, length + 1, &value_size));
+  TEST_ASSERT_EQUAL_UINT64(length, value_size);
+  TEST_ASSERT_EQUAL_STRING(large_value, result_buf);
+
+  // 작은 버퍼에는 잘린 값이 복사됨
+  char short_buf[VALUE_SIZE];
+  TEST_ASSERT_EQUAL(SUCCESS, find(10, short_buf));
+  TEST_ASSERT_EQUAL_INT(VALUE_SIZE - 1, strlen(short_buf));
+  TEST_ASSERT_EQUAL_MEMORY(large_value, short_buf, VALUE_SIZE - 1);
+
+  // 삭제하면 체인의 페이지가 free list로 돌아감
+  TEST_ASSERT_EQUAL(SUCCESS, delete (10));
+  header_page_t header = get_header_page();
+  TEST_ASSERT_NOT_EQUAL(PAGE_NULL, header.free_page_num);
+  int free_pages = 0;
+  for (pagenum_t p = header.free_page_num; p != PAGE_NULL;
+       p = ((free_page_t *)&MOCK_PAGES[p])->next_free_page_num) {
+    free_pages++;
+  }
+  TEST_ASSERT_EQUAL_INT(4, free_pages);
+
+  free(large_value);
+  free(result_buf);
+}
+
+/**
+ * @brief Case 10: value log가 열려 있으면 값은 log에 append되고 leaf에는
+ * (offset, length)만 남으며, GC가 죽은 레코드를 건너뛰고 살아있는 레코드를
+ * head로 옮기는지 검증
+ */
+void test_insert_with_value_log(void) {
+  const char *vlog_path = "test_insertion.vlog";
+  remove(vlog_path);
+  TEST_ASSERT_EQUAL_INT(0, vlog_open(vlog_path));
+
+  TEST_ASSERT_EQUAL(SUCCESS, insert(10, "value kept in the log"));
+  TEST_ASSERT_EQUAL(SUCCESS, insert(20, "another value in the log"));
+
+  leaf_page_t leaf = get_leaf_page(1);
+  TEST_ASSERT_EQUAL_INT(2, leaf.num_of_keys);
+  TEST_ASSERT_EQUAL_UINT32(2 * sizeof(vlog_ref_t), leaf.payload_size);
+
+  TEST_ASSERT_EQUAL(SUCCESS, insert(30, "short"));
+
+  char result_buf[VALUE_SIZE];
+  TEST_ASSERT_EQUAL(SUCCESS, find(20, result_buf));
+  TEST_ASSERT_EQUAL_STRING("another value in the log", result_buf);
+  // 참조보다 짧은 값은 leaf에 그대로 저장됨
+  TEST_ASSERT_EQUAL(SUCCESS, find(30, result_buf));
+  TEST_ASSERT_EQUAL_STRING("short", result_buf);
+
+  TEST_ASSERT_EQUAL(SUCCESS, delete (10));
+  uint64_t dead = sizeof(vlog_record_t) + strlen("value kept in the log");
+  TEST_ASSERT_EQUAL_UINT64(dead, vlog_garbage());
+
+  uint64_t head = vlog_head();
+  uint64_t moved = collect_value_log(VLOG_GC_STEP_BYTES);
+  TEST_ASSERT_EQUAL_UINT64(head - VLOG_HEADER_SIZE, moved);
+  TEST_ASSERT_EQUAL_UINT64(head, vlog_tail());
+  TEST_ASSERT_EQUAL_UINT64(0, vlog_garbage());
+
+  // 살아있는 값은 head 뒤로 옮겨졌고 여전히 읽힘
+  TEST_ASSERT_EQUAL(SUCCESS, find(20, result_buf));
+  TEST_ASSERT_EQUAL_STRING("another value in the log", result_buf);
+
+  vlog_close();
+  remove(vlog_path);
+}
+
+static int read_count;
+
+static void counting_read_page(pagenum_t pagenum, page_t *dest,
+                               int num_calls) {
+  read_count++;
+  MOCK_file_read_page(pagenum, dest, num_calls);
+}
+
+/**
+ * @brief Case 11: 중복 검사는 삽입 위치를 찾는 한 번의 탐색에서 이루어지고,
+ * upsert는 있는 값을 덮어쓰고 없는 키는 삽입하는지 검증
+ */
+void test_insert_duplicate_and_upsert(void) {
+  // Root P3 (Key 2) -> [P1 (1), P2 (2, 3)]
+  test_insert_split_leaf_and_new_root();
+
+  // 헤더, 루트, leaf만 읽음
+  read_count = 0;
+  file_read_page_Stub(counting_read_page);
+  TEST_ASSERT_EQUAL(FAILURE, insert(3, "dup"));
+  TEST_ASSERT_EQUAL_INT(3, read_count);
+  file_read_page_Stub(MOCK_file_read_page);
+
+  char result_buf[VALUE_SIZE];
+  TEST_ASSERT_EQUAL(SUCCESS, upsert(3, "replaced"));
+  TEST_ASSERT_EQUAL(SUCCESS, find(3, result_buf));
+  TEST_ASSERT_EQUAL_STRING("replaced", result_buf);
+  leaf_page_t leaf = get_leaf_page(2);
+  TEST_ASSERT_EQUAL_INT(2, leaf.num_of_keys);
+
+  // 없는 키는 삽입 (leaf 분할)
+  TEST_ASSERT_EQUAL(SUCCESS, upsert(4, "V_4"));
+  TEST_ASSERT_EQUAL(SUCCESS, find(4, result_buf));
+  TEST_ASSERT_EQUAL_STRING("V_4", result_buf);
+  TEST_ASSERT_EQUAL(SUCCESS, find(3, result_buf));
+  TEST_ASSERT_EQUAL_STRING("replaced", result_buf);
+}
+
+static int write_count;
+
+static void counting_write_page(pagenum_t pagenum, const page_t *src,
+                                int num_calls) {
+  write_count++;
+  MOCK_file_write_page(pagenum, src, num_calls);
+}
+
+static const char *increment(int64_t key, const char *value, void *arg) {
+  static char next[VALUE_SIZE];
+  snprintf(next, sizeof(next), "%d", atoi(value) + *(int *)arg);
+  return next;
+}
+
+/**
+ * @brief Case 12: update, compare_and_swap, modify는 leaf의 값만 바꾸고
+ * leaf 한 페이지만 쓰는지 검증
+ */
+void test_update_compare_and_swap_and_modify(void) {
+  // Root P3 (Key 2) -> [P1 (1), P2 (2, 3)]
+  test_insert_split_leaf_and_new_root();
+  char result_buf[VALUE_SIZE];
+
+  TEST_ASSERT_EQUAL(FAILURE, update(4, "none"));
+  TEST_ASSERT_EQUAL(FAILURE, compare_and_swap(4, "", "none"));
+
+  write_count = 0;
+  file_write_page_Stub(counting_write_page);
+  TEST_ASSERT_EQUAL(SUCCESS, update(2, "a longer value"));
+  TEST_ASSERT_EQUAL_INT(1, write_count);
+  TEST_ASSERT_EQUAL(SUCCESS, find(2, result_buf));
+  TEST_ASSERT_EQUAL_STRING("a longer value", result_buf);
+  TEST_ASSERT_EQUAL(SUCCESS, find(3, result_buf));
+  TEST_ASSERT_EQUAL_STRING("V_3", result_buf);
+
+  // 짧아진 값 뒤의 바이트는 지워짐
+  TEST_ASSERT_EQUAL(SUCCESS, update(2, "0"));
+  leaf_page_t leaf = get_leaf_page(2);
+  TEST_ASSERT_EQUAL_INT(2, leaf.num_of_keys);
+  TEST_ASSERT_EQUAL_UINT32(1 + strlen("V_3"), leaf.payload_size);
+  TEST_ASSERT_EQUAL_INT(0, leaf.body[leaf_used_size(&leaf)]);
+
+  TEST_ASSERT_EQUAL(VALUE_MISMATCH, compare_and_swap(2, "1", "2"));
+  TEST_ASSERT_EQUAL(SUCCESS, compare_and_swap(2, "0", "1"));
+
+  write_count = 0;
+  int step = 5;
+  for (int i = 0; i < 3; i++) {
+    TEST_ASSERT_EQUAL(SUCCESS, modify(2, increment, &step));
+  }
+  TEST_ASSERT_EQUAL_INT(3, write_count);
+  file_write_page_Stub(MOCK_file_write_page);
+  TEST_ASSERT_EQUAL(SUCCESS, find(2, result_buf));
+  TEST_ASSERT_EQUAL_STRING("16", result_buf);
+  TEST_ASSERT_EQUAL(FAILURE, modify(4, increment, &step));
+}
+
+static int count_leaves(int *full_leaves) {
+  int leaves = 0;
+  *full_leaves = 0;
+  for (pagenum_t leaf_num = find_leaf(INT64_MIN); leaf_num != PAGE_NULL;) {
+    leaf_page_t leaf = get_leaf_page(leaf_num);
+    leaves++;
+    if (leaf.num_of_keys == RECORD_CNT) {
+      (*full_leaves)++;
+    }
+    leaf_num = leaf.right_sibling_page_num;
+  }
+  return leaves;
+}
+
+/**
+ * @brief Case 13: 마지막 leaf 뒤로 추가되는 키는 append_fill_factor만큼
+ * 채워서 분할하고, 중간에 삽입되는 키는 반씩 나누는지 검증
+ */
+void test_append_split_fills_old_page(void) {
+  const int N = 100;
+  char value[VALUE_SIZE];
+  int full_leaves;
+
+  append_fill_factor = 100;
+  for (int key = 1; key <= N; key++) {
+    snprintf(value, sizeof(value), "V_%d", key);
+    TEST_ASSERT_EQUAL(SUCCESS, insert(key, value));
+  }
+  TEST_ASSERT_EQUAL_INT(N / RECORD_CNT, count_leaves(&full_leaves));
+  TEST_ASSERT_EQUAL_INT(N / RECORD_CNT, full_leaves);
+  for (int key = 1; key <= N; key++) {
+    TEST_ASSERT_EQUAL(SUCCESS, find(key, value));
+  }
+
+  // 중간에 삽입되는 키는 반씩 나눔
+  TEST_ASSERT_EQUAL(SUCCESS, insert(-1, "V_-1"));
+  leaf_page_t first = get_leaf_page(find_leaf(-1));
+  TEST_ASSERT_EQUAL_INT(1, first.num_of_keys);
+  TEST_ASSERT_EQUAL_INT64(-1, leaf_key(&first, 0));
+
+  // 반씩 나누면 순서대로 삽입한 leaf는 하나를 빼고 모두 반만 참
+  setup_data_store();
+  init_header_page_for_mock();
+  append_fill_factor = SPLIT_FILL_FACTOR;
+  for (int key = 1; key <= N; key++) {
+    snprintf(value, sizeof(value), "V_%d", key);
+    TEST_ASSERT_EQUAL(SUCCESS, insert(key, value));
+  }
+  TEST_ASSERT_EQUAL_INT(N - 1, count_leaves(&full_leaves));
+  TEST_ASSERT_EQUAL_INT(1, full_leaves);
+}
+
+/**
+ * @brief Case 14: 마지막 leaf보다 큰 키는 루트부터 내려가지 않고 기억해 둔
+ * 마지막 leaf에 바로 추가되는지 검증
+ */
+void test_append_to_rightmost_leaf(void) {
+  append_fill_factor = 100;
+  TEST_ASSERT_EQUAL(SUCCESS, insert(1, "V_1"));
+  TEST_ASSERT_EQUAL(SUCCESS, insert(2, "V_2"));
+  // append 분할 후 새 leaf [3]이 마지막 leaf로 기억됨
+  TEST_ASSERT_EQUAL(SUCCESS, insert(3, "V_3"));
+
+  read_count = 0;
+  file_read_page_Stub(counting_read_page);
+  TEST_ASSERT_EQUAL(SUCCESS, insert(4, "V_4"));
+  TEST_ASSERT_EQUAL_INT(1, read_count);
+
+  // 최댓값 이하의 키와 중복 키는 루트부터 탐색
+  read_count = 0;
+  TEST_ASSERT_EQUAL(FAILURE, insert(4, "dup"));
+  TEST_ASSERT_EQUAL_INT(3, read_count);
+  file_read_page_Stub(MOCK_file_read_page);
+
+  char result_buf[VALUE_SIZE];
+  for (int key = 1; key <= 4; key++) {
+    TEST_ASSERT_EQUAL(SUCCESS, find(key, result_buf));
+  }
+  TEST_ASSERT_EQUAL_STRING("V_4", result_buf);
+  leaf_page_t leaf = get_leaf_page(find_leaf(4));
+  TEST_ASSERT_EQUAL_INT(2, leaf.num_of_keys);
+  TEST_ASSERT_EQUAL_HEX64(PAGE_NULL, leaf.right_sibling_page_num);
+}
+
+/**
+ * @brief Case 15: cut 함수 검증
  */
 void test_cut(void) {
   TEST_ASSERT_EQUAL_INT(2, cut(4));
@@ -0,0 +1,123 @@
+#include "bpt.h"
+#include "bpt_internal.h"
+#include "bptree.h"
+#include "bptree_defrag.h"
+#include "bptree_delete.h"
+#include "bptree_find.h"
+#include "bptree_insert.h"
+#include "bptree_internal.h"
+#include "bptree_leaf.h"
+#include "bptree_overflow.h"
+#include "bptree_search.h"
+#include "bptree_utils.h"
+#include "bptree_vlog.h"
+#include "helper_mock.h"
+#include "mock_file.h"
+#include "page.h"
+#include "stats.h"
+#include "unity.h"
+#include "vlog.h"
+#include <stdlib.h>
+#include <string.h>
+
+/* 기본 페이지 구성 (RECORD_CNT, ENTRY_CNT를 바꾸지 않음) 에서 leaf를
+ * 바이트로 채워야 하는 merge, redistribution 테스트
+ */
+
+void setUp(void) {
+  page_size = DEFAULT_PAGE_SIZE;
+  setup_data_store();
+  init_header_page_for_mock();
+  merge_threshold = MIN_KEYS;
+  file_read_page_Stub(MOCK_file_read_page);
+  file_write_page_Stub(MOCK_file_write_page);
+}
+
+void tearDown(void) {}
+
+/**
+ * @brief merge_threshold가 커도 바이트로 가득 찬 leaf에는 이웃의 레코드를
+ * 옮기지 않고, 자리가 나면 하나씩 옮김 (왼쪽, 오른쪽 이웃 모두)
+ */
+void test_redistribution_respects_leaf_bytes(void) {
+  char big[VALUE_SIZE];
+  memset(big, 'b', LEAF_INLINE_MAX);
+  big[LEAF_INLINE_MAX] = '\0';
+  char value[VALUE_SIZE];
+
+  for (int full_on_right = 0; full_on_right < 2; full_on_right++) {
+    setup_data_store();
+    init_header_page_for_mock();
+    bump_smo_epoch();
+
+    // 2번 leaf는 키 0부터, 3번 leaf는 키 1000부터
+    page_t leaf_bufs[2];
+    int counts[2];
+    for (int i = 0; i < 2; i++) {
+      memset(&leaf_bufs[i], 0, page_size);
+      leaf_page_t *leaf = (leaf_page_t *)&leaf_bufs[i];
+      leaf->is_leaf = LEAF;
+      leaf_clear_records(leaf);
+      int64_t key = i * 1000;
+      if (i == full_on_right) {
+        while (leaf_has_room(leaf, big)) {
+          leaf_insert_record(leaf, leaf->num_of_keys, key++, big);
+        }
+      } else {
+        for (int n = 0; n < 100; n++) {
+          leaf_insert_record(leaf, n, key++, "s");
+        }
+      }
+      counts[i] = leaf->num_of_keys;
+    }
+    ((leaf_page_t *)&leaf_bufs[0])->right_sibling_page_num = 3;
+    MOCK_file_write_page(2, &leaf_bufs[0], 0);
+    MOCK_file_write_page(3, &leaf_bufs[1], 0);
+
+    page_t root_buf;
+    memset(&root_buf, 0, page_size);
+    internal_page_t *root = (internal_page_t *)&root_buf;
+    root->is_leaf = INTERNAL;
+    root->one_more_page_num = 2;
+    entry_t entry = {1000, 3};
+    internal_write_entries(root, &entry, 1);
+    MOCK_file_write_page(1, &root_buf, 0);
+    header_page_t header = get_header_page();
+    header.root_page_num = 1;
+    header.num_of_pages = 4;
+    MOCK_file_write_page(HEADER_PAGE_POS, (page_t *)&header, 0);
+
+    int full = full_on_right;
+    int64_t full_key = full * 1000;
+    TEST_ASSERT_TRUE(counts[full] < 40 && counts[1 - full] > 40);
+    merge_threshold = 40;
+    tree_path_t path;
+    TEST_ASSERT_EQUAL(2 + full, find_leaf_path(full_key + 1, &path, NULL));
+
+    // 합칠 수도 없고 받을 자리도 없으면 그대로 둠
+    TEST_ASSERT_EQUAL(SUCCESS, handle_underflow(&path, 1));
+    leaf_page_t full_leaf = get_leaf_page(2 + full);
+    TEST_ASSERT_EQUAL_INT(counts[full], full_leaf.num_of_keys);
+    TEST_ASSERT_TRUE(leaf_used_size(&full_leaf) <= LEAF_BODY_SIZE);
+    TEST_ASSERT_EQUAL_INT(counts[1 - full],
+                          get_leaf_page(3 - full).num_of_keys);
+
+    // 큰 레코드 하나를 지우면 이웃의 작은 레코드 하나를 받음
+    int64_t removed = full_on_right ? 1000 : counts[0] - 1;
+    leaf_remove_record(&full_leaf, full_on_right ? 0 : counts[full] - 1);
+    MOCK_file_write_page(2 + full, (page_t *)&full_leaf, 0);
+    TEST_ASSERT_EQUAL(SUCCESS, handle_underflow(&path, 1));
+    full_leaf = get_leaf_page(2 + full);
+    TEST_ASSERT_EQUAL_INT(counts[full], full_leaf.num_of_keys);
+    TEST_ASSERT_TRUE(leaf_used_size(&full_leaf) <= LEAF_BODY_SIZE);
+    TEST_ASSERT_EQUAL_INT(counts[1 - full] - 1,
+                          get_leaf_page(3 - full).num_of_keys);
+    for (int i = 0; i < 2; i++) {
+      for (int64_t key = i * 1000; key < i * 1000 + counts[i]; key++) {
+        TEST_ASSERT_EQUAL(key == removed ? FAILURE : SUCCESS,
+                          find(key, value));
+      }
+    }
+    merge_threshold = MIN_KEYS;
+  }
+}
@@ -1,14 +1,23 @@
 #include "bpt.h"
 #include "bpt_internal.h"
 #include "bptree.h"
+#include "bptree_defrag.h"
 #include "bptree_delete.h"
 #include "bptree_find.h"
 #include "bptree_insert.h"
+#include "bptree_internal.h"
+#include "bptree_leaf.h"
+#include "bptree_overflow.h"
+#include "bptree_search.h"
 #include "bptree_utils.h"
+#include "bptree_vlog.h"
 #include "helper_mock.h"
 #include "mock_file.h"
+#include "stats.h"
 #include "unity.h"
+#include "vlog.h"
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 static char captured_output[4096];
@@ -29,6 +38,7 @@ static void stop_capture(void) {
 }
 
 void setUp() {
+  page_size = DEFAULT_PAGE_SIZE;
   setup_data_store();
   init_header_page_for_mock();
   file_read_page_Stub(MOCK_file_read_page);
@@ -43,7 +53,7 @@ void test_find_range() {
   MOCK_file_write_page(HEADER_PAGE_POS, (page_t *)&header, 0);
 
   page_t page3 = {0};
-  leaf_page_t *leaf3 = (leaf_page_t *)&page3;
+  legacy_leaf_page_t *leaf3 = (legacy_leaf_page_t *)&page3;
   leaf3->is_leaf = LEAF;
   leaf3->num_of_keys = 3;
   leaf3->records[0].key = 10;
@@ -70,7 +80,7 @@ void test_find_and_print_range_output() {
   MOCK_file_write_page(HEADER_PAGE_POS, (page_t *)&header, 0);
 
   page_t page3 = {0};
-  leaf_page_t *leaf = (leaf_page_t *)&page3;
+  legacy_leaf_page_t *leaf = (legacy_leaf_page_t *)&page3;
   leaf->is_leaf = LEAF;
   leaf->num_of_keys = 2;
   leaf->records[0].key = 100;
@@ -95,7 +105,7 @@ void test_print_tree_output() {
   MOCK_file_write_page(HEADER_PAGE_POS, (page_t *)&header, 0);
 
   page_t page3 = {0};
-  leaf_page_t *leaf = (leaf_page_t *)&page3;
+  legacy_leaf_page_t *leaf = (legacy_leaf_page_t *)&page3;
   leaf->is_leaf = LEAF;
   leaf->num_of_keys = 2;
   leaf->records[0].key = 10;
@@ -110,3 +120,264 @@ void test_print_tree_output() {
   TEST_ASSERT_NOT_EQUAL(NULL, strstr(captured_output, "10"));
   TEST_ASSERT_NOT_EQUAL(NULL, strstr(captured_output, "20"));
 }
+
+static void fill_internal_page(legacy_internal_page_t *page, int n) {
+  memset(page, 0, sizeof(*page));
+  page->is_leaf = INTERNAL;
+  page->num_of_keys = n;
+  page->one_more_page_num = 1000;
+  for (int i = 0; i < n; i++) {
+    page->entries[i].key = (i + 1) * 10;
+    page->entries[i].page_num = 1001 + i;
+  }
+}
+
+void test_search_internal_key_matches_linear_scan() {
+  page_t buf;
+  legacy_internal_page_t *page = (legacy_internal_page_t *)&buf;
+  int sizes[] = {0, 1, 2, 3, 4, 5, 7, 31, 32, 33, 100, LEGACY_ENTRY_CNT};
+
+  for (int s = 0; s < (int)(sizeof(sizes) / sizeof(sizes[0])); s++) {
+    int n = sizes[s];
+    fill_internal_page(page, n);
+
+    for (int64_t key = -5; key <= (n + 1) * 10 + 5; key++) {
+      int expected = 0;
+      while (expected < n && page->entries[expected].key <= key) {
+        expected++;
+      }
+      TEST_ASSERT_EQUAL_INT(expected,
+                            search_internal_key((internal_page_t *)page, key));
+    }
+  }
+}
+
+void test_search_internal_child() {
+  page_t buf;
+  internal_page_t *page = (internal_page_t *)&buf;
+  fill_internal_page((legacy_internal_page_t *)page, LEGACY_ENTRY_CNT);
+
+  TEST_ASSERT_EQUAL_INT(-1, search_internal_child(page, 1000));
+  for (int i = 0; i < LEGACY_ENTRY_CNT; i++) {
+    TEST_ASSERT_EQUAL_INT(i, search_internal_child(page, 1001 + i));
+  }
+  TEST_ASSERT_EQUAL_INT(-2, search_internal_child(page, 5));
+
+  // entries past num_of_keys must not be matched
+  page->num_of_keys = 3;
+  TEST_ASSERT_EQUAL_INT(-2, search_internal_child(page, 1001 + 3));
+}
+
+void test_search_delta_internal_page() {
+  // spreads that need 16, 32 and 64-bit deltas, around a negative base
+  int64_t steps[] = {7, 100000, INT64_C(1) << 40};
+  int widths[] = {2, 4, 8};
+  int n = 300;
+  entry_t entries[300];
+
+  for (int s = 0; s < 3; s++) {
+    for (int i = 0; i < n; i++) {
+      entries[i].key = -1000 + i * steps[s];
+      entries[i].page_num = 70000 + i;
+    }
+    TEST_ASSERT_TRUE(internal_entries_fit(entries, n));
+
+    page_t buf;
+    memset(&buf, 0, sizeof(buf));
+    internal_page_t *page = (internal_page_t *)&buf;
+    page->one_more_page_num = 69999;
+    internal_write_entries(page, entries, n);
+
+    TEST_ASSERT_EQUAL_INT(INTERNAL_FORMAT_DELTA, page->format);
+    TEST_ASSERT_EQUAL_INT(widths[s], page->key_width);
+    TEST_ASSERT_EQUAL_INT(3, page->page_num_width);
+
+    for (int i = 0; i < n; i++) {
+      TEST_ASSERT_EQUAL_INT64(entries[i].key, internal_key(page, i));
+      TEST_ASSERT_EQUAL_UINT64(entries[i].page_num, internal_child(page, i));
+      TEST_ASSERT_EQUAL_INT(i + 1, search_internal_key(page, entries[i].key));
+      TEST_ASSERT_EQUAL_INT(i, search_internal_key(page, entries[i].key - 1));
+      TEST_ASSERT_EQUAL_INT(i, search_internal_child(page, 70000 + i));
+    }
+    TEST_ASSERT_EQUAL_INT(0, search_internal_key(page, INT64_MIN));
+    TEST_ASSERT_EQUAL_INT(n, search_internal_key(page, INT64_MAX));
+    TEST_ASSERT_EQUAL_INT(-1, search_internal_child(page, 69999));
+    TEST_ASSERT_EQUAL_INT(-2, search_internal_child(page, 70000 + n));
+  }
+
+  // 300 entries with full 8-byte keys and page numbers do not fit
+  entries[n - 1].page_num = UINT64_MAX;
+  TEST_ASSERT_FALSE(internal_entries_fit(entries, n));
+}
+
+void test_search_packed_child_widths() {
+  int n = 200;
+  entry_t entries[200];
+
+  for (int width = 1; width <= 8; width++) {
+    // 폭이 1보다 크면 하위 바이트를 모두 같게 해서 후보 검사를 거친다
+    pagenum_t base = width == 1 ? 10 : (pagenum_t)1 << (8 * (width - 1));
+    for (int i = 0; i < n; i++) {
+      entries[i].key = i * 2;
+      entries[i].page_num =
+          width == 1 ? base + i : base + ((pagenum_t)i << 8) + 0x5a;
+    }
+
+    page_t buf;
+    memset(&buf, 0, sizeof(buf));
+    internal_page_t *page = (internal_page_t *)&buf;
+    page->one_more_page_num = 1;
+    internal_write_entries(page, entries, n);
+    TEST_ASSERT_EQUAL_INT(INTERNAL_FORMAT_DELTA, page->format);
+    TEST_ASSERT_EQUAL_INT(width, page->page_num_width);
+
+    for (int i = 0; i < n; i++) {
+      TEST_ASSERT_EQUAL_INT(i,
+                            search_internal_child(page, entries[i].page_num));
+    }
+    pagenum_t absent =
+        width == 1 ? base + n : base + ((pagenum_t)n << 8) + 0x5a;
+    TEST_ASSERT_EQUAL_INT(-2, search_internal_child(page, absent));
+    if (width < 8) {
+      // 페이지의 폭보다 넓은 번호는 없다
+      pagenum_t wide = ((pagenum_t)1 << (8 * width)) + entries[0].page_num;
+      TEST_ASSERT_EQUAL_INT(-2, search_internal_child(page, wide));
+    }
+
+  }
+}
+
+void test_capacities_follow_page_size() {
+  // wide entries: 8-byte key deltas and page numbers
+  int n = 1000;
+  entry_t *entries = (entry_t *)malloc(n * sizeof(entry_t));
+  for (int i = 0; i < n; i++) {
+    entries[i].key = (int64_t)i << 40;
+    entries[i].page_num = UINT64_MAX - i;
+  }
+  page_t buf;
+  memset(&buf, 0, sizeof(buf));
+  leaf_page_t *leaf = (leaf_page_t *)&buf;
+  leaf_clear_records(leaf);
+  char value[VALUE_SIZE];
+  memset(value, 'v', VALUE_SIZE - 1);
+  value[VALUE_SIZE - 1] = '\0';
+
+  TEST_ASSERT_FALSE(internal_entries_fit(entries, n));
+  int default_records = 0;
+  while (leaf_has_room(leaf, value)) {
+    leaf_insert_record(leaf, default_records, default_records, value);
+    default_records++;
+  }
+
+  page_size = 4 * DEFAULT_PAGE_SIZE;
+  TEST_ASSERT_TRUE(internal_entries_fit(entries, n));
+  int records = default_records;
+  while (leaf_has_room(leaf, value)) {
+    leaf_insert_record(leaf, records, records, value);
+    records++;
+  }
+  TEST_ASSERT_GREATER_THAN(4 * default_records - 4, records);
+  free(entries);
+}
+
+static int read_count;
+
+static void counting_read_page(pagenum_t pagenum, page_t *dest,
+                               int num_calls) {
+  read_count++;
+  MOCK_file_read_page(pagenum, dest, num_calls);
+}
+
+void test_find_uses_finger_for_nearby_keys() {
+  file_alloc_page_Stub(MOCK_file_alloc_page);
+  for (int64_t key = 1; key <= 1000; key++) {
+    TEST_ASSERT_EQUAL(SUCCESS, insert(key, "V"));
+  }
+  header_page_t header = get_header_page();
+  TEST_ASSERT_EQUAL(INTERNAL, get_leaf_page(header.root_page_num).is_leaf);
+
+  char result_buf[VALUE_SIZE];
+  TEST_ASSERT_EQUAL(SUCCESS, find(1, result_buf));
+  leaf_page_t first = get_leaf_page(find_leaf(1));
+  int64_t last_key = leaf_key(&first, first.num_of_keys - 1);
+  leaf_page_t second = get_leaf_page(first.right_sibling_page_num);
+  int64_t sibling_key = leaf_key(&second, second.num_of_keys - 1);
+
+  // 같은 leaf의 키는 leaf 한 페이지만 읽고, find_leaf는 읽지 않음
+  file_read_page_Stub(counting_read_page);
+  read_count = 0;
+  TEST_ASSERT_EQUAL(SUCCESS, find(last_key, result_buf));
+  TEST_ASSERT_EQUAL_INT(1, read_count);
+  read_count = 0;
+  find_leaf(2);
+  TEST_ASSERT_EQUAL_INT(0, read_count);
+
+  // 오른쪽 이웃 leaf의 키는 두 페이지
+  read_count = 0;
+  TEST_ASSERT_EQUAL(SUCCESS, find(sibling_key, result_buf));
+  TEST_ASSERT_EQUAL_INT(2, read_count);
+  TEST_ASSERT_EQUAL(first.right_sibling_page_num, find_leaf(sibling_key - 1));
+
+  // 구조가 바뀌면 finger는 버려지고 루트부터 탐색
+  bump_smo_epoch();
+  read_count = 0;
+  TEST_ASSERT_EQUAL(SUCCESS, find(sibling_key, result_buf));
+  TEST_ASSERT_GREATER_THAN(2, read_count);
+  file_read_page_Stub(MOCK_file_read_page);
+
+  for (int64_t key = 1000; key >= 1; key--) {
+    TEST_ASSERT_EQUAL(SUCCESS, find(key, result_buf));
+  }
+  TEST_ASSERT_EQUAL(FAILURE, find(1001, result_buf));
+  TEST_ASSERT_EQUAL(FAILURE, find(0, result_buf));
+}
+
+/**
+ * @brief 여러 레코드를 한 번에 읽고 붙이고 지우는 leaf 연산이 하나씩 하는
+ * 연산과 같은 페이지를 만드는지 검증 (값 길이가 제각각인 경우)
+ */
+void test_leaf_bulk_slots_match_single_slots() {
+  page_t single_buf, bulk_buf;
+  leaf_page_t *single = (leaf_page_t *)&single_buf;
+  leaf_page_t *bulk = (leaf_page_t *)&bulk_buf;
+  memset(&single_buf, 0, page_size);
+  memset(&bulk_buf, 0, page_size);
+  leaf_clear_records(single);
+  leaf_clear_records(bulk);
+
+  char value[VALUE_SIZE];
+  for (int i = 0; i < 60; i++) {
+    memset(value, 'a' + i % 26, i % 40);
+    value[i % 40] = '\0';
+    leaf_insert_record(single, i, i, value);
+  }
+
+  // 한 번에 읽은 슬롯을 두 번에 나눠 붙여도 같은 페이지
+  leaf_slot_t *slots = leaf_alloc_slots(single->num_of_keys);
+  leaf_read_slots(single, slots);
+  leaf_append_slots(bulk, slots, 25);
+  leaf_append_slots(bulk, slots + 25, 35);
+  free(slots);
+  TEST_ASSERT_EQUAL_MEMORY(&single_buf, &bulk_buf, page_size);
+
+  // 구간 삭제는 하나씩 지운 것과 같고, 비워진 뒷부분은 0
+  for (int index = 29; index >= 10; index--) {
+    leaf_remove_record(single, index);
+  }
+  leaf_remove_records(bulk, 10, 30);
+  TEST_ASSERT_EQUAL_MEMORY(&single_buf, &bulk_buf, page_size);
+  TEST_ASSERT_EQUAL_INT(40, bulk->num_of_keys);
+  TEST_ASSERT_EQUAL_INT64(30, bulk->keys[10]);
+  memset(value, 'e', 30);
+  value[30] = '\0';
+  TEST_ASSERT_EQUAL_STRING(value, get_leaf_value(bulk, 10));
+
+  // tombstone 정리도 한 번에
+  leaf_set_tombstone(bulk, 0);
+  leaf_set_tombstone(bulk, 39);
+  TEST_ASSERT_EQUAL_INT(2, leaf_remove_tombstones(bulk));
+  leaf_remove_record(single, 39);
+  leaf_remove_record(single, 0);
+  TEST_ASSERT_EQUAL_MEMORY(&single_buf, &bulk_buf, page_size);
+}
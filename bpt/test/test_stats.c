@@ -0,0 +1,71 @@
+#include "bpt.h"
+#include "bpt_internal.h"
+#include "bptree.h"
+#include "bptree_defrag.h"
+#include "bptree_delete.h"
+#include "bptree_find.h"
+#include "bptree_insert.h"
+#include "bptree_internal.h"
+#include "bptree_leaf.h"
+#include "bptree_overflow.h"
+#include "bptree_search.h"
+#include "bptree_utils.h"
+#include "bptree_vlog.h"
+#include "helper_mock.h"
+#include "mock_file.h"
+#include "page.h"
+#include "stats.h"
+#include "unity.h"
+#include "vlog.h"
+#include <string.h>
+
+void setUp(void) {
+  page_size = DEFAULT_PAGE_SIZE;
+  setup_data_store();
+  init_header_page_for_mock();
+  file_read_page_Stub(MOCK_file_read_page);
+  file_write_page_Stub(MOCK_file_write_page);
+}
+
+void tearDown(void) {}
+
+/**
+ * @brief latency histogram의 percentile과 phase별 기록 확인
+ */
+void test_latency_histograms(void) {
+  // 8ns 미만은 값마다 bucket이 따로 있음
+  latency_histogram_t histogram;
+  memset(&histogram, 0, sizeof(histogram));
+  histogram.count = 1000;
+  histogram.max_ns = 7;
+  histogram.buckets[1] = 500;
+  histogram.buckets[5] = 490;
+  histogram.buckets[6] = 9;
+  histogram.buckets[7] = 1;
+  TEST_ASSERT_EQUAL_UINT64(1, latency_percentile(&histogram, 50));
+  TEST_ASSERT_EQUAL_UINT64(5, latency_percentile(&histogram, 99));
+  TEST_ASSERT_EQUAL_UINT64(6, latency_percentile(&histogram, 99.9));
+  TEST_ASSERT_EQUAL_UINT64(7, latency_percentile(&histogram, 100));
+
+  // 탐색 구간이 phase별로 기록되고, phase를 합치면 호출 전체가 됨
+  file_alloc_page_Stub(MOCK_file_alloc_page);
+  stats_reset();
+  for (int64_t key = 1; key <= 100; key++) {
+    stats_begin(STAT_OP_INSERT);
+    TEST_ASSERT_EQUAL(SUCCESS, insert(key, "V"));
+    stats_end();
+  }
+  latency_histogram_t total, traversal, sync;
+  latency_snapshot(STAT_OP_INSERT, STAT_PHASE_TOTAL, &total);
+  latency_snapshot(STAT_OP_INSERT, STAT_PHASE_TRAVERSAL, &traversal);
+  latency_snapshot(STAT_OP_INSERT, STAT_PHASE_SYNC, &sync);
+  TEST_ASSERT_EQUAL_UINT64(100, total.count);
+  TEST_ASSERT_EQUAL_UINT64(100, traversal.count);
+  TEST_ASSERT_TRUE(traversal.max_ns <= total.max_ns);
+  TEST_ASSERT_EQUAL_UINT64(0, sync.max_ns);
+
+  latency_reset();
+  latency_snapshot(STAT_OP_INSERT, STAT_PHASE_TOTAL, &total);
+  TEST_ASSERT_EQUAL_UINT64(0, total.count);
+  TEST_ASSERT_EQUAL_UINT64(0, latency_percentile(&total, 99));
+}